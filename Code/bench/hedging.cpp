@@ -0,0 +1,148 @@
+// Hedged call benchmark: the latency of sync calls to servers where a few
+// calls are slow, without hedging, hedging at p95 and p99 of the recent
+// latency, and hedging to a second server.
+//
+//   hedging [port] [calls] [slow percent] [slow ms]
+#include "XmlRpc.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace XmlRpc;
+
+static double now()
+{
+  return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Answers each request on a connection in turn, echoing its int, after 1 ms or
+// for 'slowPercent' percent of requests after 'slowMs'. Each connection has
+// its own thread, so a hedged copy isn't queued behind the slow call.
+static void server(int port, int slowPercent, int slowMs)
+{
+  int listener = socket(AF_INET, SOCK_STREAM, 0);
+  int one = 1;
+  setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  sockaddr_in addr = sockaddr_in();
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (bind(listener, (sockaddr*) &addr, sizeof(addr)) != 0 || listen(listener, 64) != 0) {
+    std::fprintf(stderr, "could not listen on port %d\n", port);
+    std::exit(1);
+  }
+
+  std::thread([=] {
+    for (;;) {
+      int fd = accept(listener, 0, 0);
+      if (fd < 0) continue;
+      int on = 1;
+      setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+      std::thread([=] {
+        unsigned seed = unsigned(port) * 31 + unsigned(fd);
+        std::string in;
+        char buffer[65536];
+        for (;;) {
+          size_t header, length;
+          while ((header = in.find("\r\n\r\n")) == std::string::npos ||
+                 (length = in.find("Content-length: ")) == std::string::npos ||
+                 in.size() < header + 4 + size_t(std::atoi(in.c_str() + length + 16))) {
+            ssize_t n = ::read(fd, buffer, sizeof(buffer));
+            if (n <= 0) {
+              ::close(fd);
+              return;
+            }
+            in.append(buffer, size_t(n));
+          }
+          size_t end = header + 4 + size_t(std::atoi(in.c_str() + length + 16));
+          std::string body = in.substr(header + 4, end - header - 4);
+          in.erase(0, end);
+
+          seed = seed * 1103515245 + 12345;
+          int ms = (int((seed >> 16) % 100) < slowPercent) ? slowMs : 1;
+          usleep(ms * 1000);
+
+          size_t value = body.find("<i4>");
+          std::string echoed = (value == std::string::npos) ? "0" : std::to_string(std::atoi(body.c_str() + value + 4));
+          std::string response = "<?xml version=\"1.0\"?><methodResponse><params><param><value><i4>" +
+                                 echoed + "</i4></value></param></params></methodResponse>";
+          std::string reply = "HTTP/1.1 200 OK\r\nContent-Type: text/xml\r\nContent-length: " +
+                              std::to_string(response.size()) + "\r\n\r\n" + response;
+          if (::write(fd, reply.data(), reply.size()) != ssize_t(reply.size())) {
+            ::close(fd);
+            return;
+          }
+        }
+      }).detach();
+    }
+  }).detach();
+}
+
+// Makes 'calls' sync calls and prints their latency, leaving out the calls made
+// before the client has enough timings to hedge
+static void run(const char* name, int port, int calls, double percentile, int hedgePort = 0)
+{
+  static const int WARMUP = 40;
+
+  XmlRpcClient client("127.0.0.1", port);
+  if (percentile > 0) {
+    client.setHedging(percentile, hedgePort ? "127.0.0.1" : 0, hedgePort);
+    client.setIdempotent("get");
+  }
+
+  std::vector<double> ms;
+  XmlRpcValue args, result;
+  for (int i = 0; i < calls; ++i) {
+    args[0] = i;
+    double t0 = now();
+    if ( ! client.execute("get", args, result) || int(result) != i) {
+      std::fprintf(stderr, "call %d failed\n", i);
+      std::exit(1);
+    }
+    if (i >= WARMUP)
+      ms.push_back((now() - t0) * 1e3);
+  }
+
+  std::sort(ms.begin(), ms.end());
+  double mean = 0;
+  for (double t : ms) mean += t;
+  mean /= ms.size();
+  std::printf("  %-24s %6.2f %6.2f %6.2f %6.2f", name,
+              ms[ms.size() / 2], ms[ms.size() * 95 / 100], ms[ms.size() * 99 / 100], mean);
+  if (percentile > 0)
+    std::printf(" %7.1f%% %6d", 100.0 * client.hedgesSent() / calls, client.hedgesWon());
+  std::printf("\n");
+}
+
+int main(int argc, char* argv[])
+{
+  int port = (argc > 1) ? std::atoi(argv[1]) : 18321;
+  int calls = (argc > 2) ? std::atoi(argv[2]) : 2000;
+  int slowPercent = (argc > 3) ? std::atoi(argv[3]) : 3;
+  int slowMs = (argc > 4) ? std::atoi(argv[4]) : 60;
+  XmlRpc::setVerbosity(0);
+
+  server(port, slowPercent, slowMs);
+  server(port + 1, slowPercent, slowMs);
+
+  std::printf("  %d sync calls, %d%% of them %d ms, 1 ms otherwise (ms)\n", calls, slowPercent, slowMs);
+  std::printf("  %-24s %6s %6s %6s %6s %8s %6s\n", "", "p50", "p95", "p99", "mean", "hedged", "won");
+  run("no hedging", port, calls, 0);
+  run("hedge at p95", port, calls, 0.95);
+  run("hedge at p99", port, calls, 0.99);
+  run("hedge at p95, 2nd server", port, calls, 0.95, port + 1);
+
+  std::fflush(stdout);
+  std::_Exit(0);   // The server threads are still running
+}
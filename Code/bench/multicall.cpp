@@ -0,0 +1,240 @@
+// Multicall batching benchmark: a client streams G-code-sized calls in bursts
+// of 50, starting each burst once the previous one is answered, with and
+// without pipelining and batching. It runs over loopback, and through a proxy
+// that adds a round trip delay and counts the HTTP requests passing.
+//
+//   multicall [port] [round trip ms]
+#include "XmlRpc.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace XmlRpc;
+
+class Echo : public XmlRpcServerMethod {
+public:
+  Echo(XmlRpcServer* s) : XmlRpcServerMethod("echo", s) {}
+
+  void execute(XmlRpcValue& params, XmlRpcValue& result) { result = params[0]; }
+};
+
+static double now()
+{
+  return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Process CPU time, client and server together
+static double cpuTime()
+{
+  rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec +
+         (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * 1e-6;
+}
+
+static int listenOn(int port)
+{
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  int one = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  sockaddr_in addr = sockaddr_in();
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (bind(fd, (sockaddr*) &addr, sizeof(addr)) != 0 || listen(fd, 64) != 0) {
+    std::fprintf(stderr, "could not listen on port %d\n", port);
+    std::exit(1);
+  }
+  return fd;
+}
+
+static int connectTo(int port)
+{
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  sockaddr_in addr = sockaddr_in();
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (connect(fd, (sockaddr*) &addr, sizeof(addr)) != 0) {
+    ::close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+// HTTP requests seen by the proxy
+static int httpRequests = 0;
+static std::mutex httpRequestsMutex;
+
+// Copies from one socket to another, holding each chunk back for 'delay'
+// seconds. Requests are counted by their "POST " lines.
+static void pump(int from, int to, double delay, bool countRequests)
+{
+  struct Queue {
+    std::mutex mutex;
+    std::condition_variable ready;
+    std::deque<std::pair<double, std::string> > chunks;
+    bool eof = false;
+  };
+  std::shared_ptr<Queue> queue = std::make_shared<Queue>();
+
+  std::thread([queue, to] {
+    for (;;) {
+      std::unique_lock<std::mutex> lock(queue->mutex);
+      queue->ready.wait(lock, [&] { return queue->eof || ! queue->chunks.empty(); });
+      if (queue->chunks.empty()) {
+        shutdown(to, SHUT_WR);
+        return;
+      }
+      std::pair<double, std::string> chunk = queue->chunks.front();
+      queue->chunks.pop_front();
+      lock.unlock();
+
+      double wait = chunk.first - now();
+      if (wait > 0)
+        usleep(useconds_t(wait * 1e6));
+      const char* p = chunk.second.data();
+      size_t left = chunk.second.size();
+      while (left > 0) {
+        ssize_t n = ::write(to, p, left);
+        if (n <= 0) return;
+        p += n;
+        left -= size_t(n);
+      }
+    }
+  }).detach();
+
+  char buffer[65536];
+  std::string tail;
+  for (;;) {
+    ssize_t n = ::read(from, buffer, sizeof(buffer));
+    std::lock_guard<std::mutex> lock(queue->mutex);
+    if (n <= 0) {
+      queue->eof = true;
+      queue->ready.notify_one();
+      return;
+    }
+    if (countRequests) {
+      // Keep the last few bytes, in case a "POST " is split between reads
+      tail.append(buffer, size_t(n));
+      size_t at;
+      while ((at = tail.find("POST ")) != std::string::npos) {
+        std::lock_guard<std::mutex> count(httpRequestsMutex);
+        ++httpRequests;
+        tail.erase(0, at + 5);
+      }
+      if (tail.size() > 4)
+        tail.erase(0, tail.size() - 4);
+    }
+    queue->chunks.emplace_back(now() + delay, std::string(buffer, size_t(n)));
+    queue->ready.notify_one();
+  }
+}
+
+// Forwards connections on 'port' to 'target', adding 'delay' seconds each way
+static void proxy(int port, int target, double delay)
+{
+  int listener = listenOn(port);
+  std::thread([=] {
+    for (;;) {
+      int client = accept(listener, 0, 0);
+      if (client < 0) continue;
+      int server = connectTo(target);
+      if (server < 0) {
+        ::close(client);
+        continue;
+      }
+      int one = 1;
+      setsockopt(client, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+      setsockopt(server, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+      std::thread(pump, client, server, delay, true).detach();
+      std::thread(pump, server, client, delay, false).detach();
+    }
+  }).detach();
+}
+
+static const int BURST = 50;
+
+// Streams 'calls' calls in bursts, and prints the rate, the CPU time per call
+// and the requests they took
+static void run(int port, int calls, int depth, int batch)
+{
+  XmlRpcDispatch dispatch;
+  XmlRpcClient client("127.0.0.1", port);
+  client.setDispatch(&dispatch);
+  client.setPipelineDepth(depth);
+  client.setMulticallBatch(batch);
+
+  XmlRpcValue line;
+  line[0] = std::string("G1 X10.5 Y20.25 F3000");
+  {
+    std::lock_guard<std::mutex> lock(httpRequestsMutex);
+    httpRequests = 0;
+  }
+
+  double t0 = now(), cpu0 = cpuTime();
+  for (int b = 0; b < calls / BURST; ++b) {
+    int answered = 0;
+    for (int i = 0; i < BURST; ++i)
+      client.executeAsync("echo", line, [&](bool ok, XmlRpcValue&, bool isFault) {
+        if ( ! ok || isFault) {
+          std::fprintf(stderr, "call failed\n");
+          std::exit(1);
+        }
+        if (++answered == BURST)
+          dispatch.exit();
+      });
+    dispatch.work(-1.0);
+  }
+  double t = now() - t0, cpu = cpuTime() - cpu0;
+
+  std::lock_guard<std::mutex> lock(httpRequestsMutex);
+  std::printf("    depth %-3s  batch %-3d    %8.0f %10.1f", depth ? "1" : "any", batch, calls / t, cpu / calls * 1e6);
+  if (httpRequests > 0)
+    std::printf(" %10d", httpRequests);
+  std::printf("\n");
+}
+
+int main(int argc, char* argv[])
+{
+  int port = (argc > 1) ? std::atoi(argv[1]) : 18311;
+  double roundTrip = ((argc > 2) ? std::atof(argv[2]) : 2.0) / 1000;
+  XmlRpc::setVerbosity(0);
+
+  XmlRpcServer server;
+  Echo echo(&server);
+  if ( ! server.bindAndListen(port, 64)) {
+    std::fprintf(stderr, "could not listen on port %d\n", port);
+    return 1;
+  }
+  std::thread([&server] { server.work(-1.0); }).detach();
+  proxy(port + 1, port, roundTrip / 2);
+
+  std::printf("  loopback, 20000 calls\n");
+  std::printf("    %-22s %8s %10s %10s\n", "", "calls/s", "us cpu", "requests");
+  for (int depth : {1, 0})
+    for (int batch : {0, 8, 50})
+      run(port, 20000, depth, batch);
+
+  std::printf("  %.1f ms round trip, 2000 calls\n", roundTrip * 1000);
+  for (int depth : {1, 0})
+    for (int batch : {0, 8, 50})
+      run(port + 1, 2000, depth, batch);
+
+  std::fflush(stdout);
+  std::_Exit(0);   // The server and proxy threads are still running
+}
@@ -0,0 +1,124 @@
+// Parse throughput benchmark: MB/s for a request holding an array of structs.
+// Walking its tags with the XmlRpcUtil helpers the parser used before
+// XmlRpcTokenizer is compared with walking them with the tokenizer, and the
+// full parses built on it, XmlRpcValue::fromXml and XmlRpcRequestParser.
+//
+//   parse [structs] [runs]
+#include "XmlRpc.h"
+#include "XmlRpcRequestParser.h"
+#include "XmlRpcTokenizer.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+using namespace XmlRpc;
+
+static double now()
+{
+  return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// A call with one param, an array of 'structs' structs of mixed members
+static std::string request(int structs)
+{
+  XmlRpcValue params;
+  XmlRpcValue& rows = params[0];
+  rows.setSize(structs);
+  for (int i = 0; i < structs; ++i) {
+    XmlRpcValue& row = rows[i];
+    row["id"] = i;
+    row["name"] = "row " + std::to_string(i) + " & <more>";
+    row["x"] = i * 0.25;
+    row["enabled"] = (i % 2) == 0;
+    row["tags"][0] = std::string("first");
+    row["tags"][1] = std::string("second");
+  }
+
+  std::string xml = "<?xml version=\"1.0\"?>\r\n<methodCall><methodName>load</methodName>\r\n<params><param>";
+  params[0].appendXml(xml);
+  xml += "</param></params></methodCall>\r\n";
+  return xml;
+}
+
+// The tags and text as the XmlRpcUtil helpers find them
+static int utilScan(std::string const& xml)
+{
+  int tags = 0, offset = 0, size = int(xml.size());
+  while (offset < size) {
+    if ( ! XmlRpcUtil::getNextTag(xml, &offset).empty())
+      ++tags;
+    else {
+      size_t lt = xml.find('<', size_t(offset));
+      if (lt == std::string::npos)
+        break;
+      offset = int(lt);
+    }
+  }
+  return tags;
+}
+
+// The tags and text as the tokenizer finds them
+static int tokenizerScan(std::string const& xml)
+{
+  int tags = 0;
+  XmlRpcTokenizer tok(xml, 0);
+  const char* begin;
+  const char* end;
+  while ( ! tok.atEnd()) {
+    if (tok.nextTag() != XmlRpcTokenizer::NoTag)
+      ++tags;
+    else if ( ! tok.text(&begin, &end))
+      break;
+  }
+  return tags;
+}
+
+static int valueParse(std::string const& xml)
+{
+  int offset = int(xml.find("<value>"));
+  XmlRpcValue value;
+  return value.fromXml(xml, &offset) ? value.size() : -1;
+}
+
+static int requestParse(std::string const& xml)
+{
+  XmlRpcRequestParser parser;
+  return (parser.parse(xml) == XmlRpcRequestParser::Done) ? parser.params()[0].size() : -1;
+}
+
+// Prints the best rate of 'runs' runs
+static void measure(const char* name, int (*parse)(std::string const&), std::string const& xml, int runs)
+{
+  double best = 0;
+  int result = 0;
+  for (int i = 0; i < runs; ++i) {
+    double t0 = now();
+    result = parse(xml);
+    double t = now() - t0;
+    if (best == 0 || t < best)
+      best = t;
+  }
+  if (result < 0) {
+    std::fprintf(stderr, "%s failed\n", name);
+    std::exit(1);
+  }
+  std::printf("  %-28s %9.1f\n", name, xml.size() / best / (1 << 20));
+}
+
+int main(int argc, char* argv[])
+{
+  int structs = (argc > 1) ? std::atoi(argv[1]) : 20000;
+  int runs = (argc > 2) ? std::atoi(argv[2]) : 10;
+  XmlRpc::setVerbosity(0);
+
+  std::string xml = request(structs);
+  std::printf("  %d structs, %.1f MB\n", structs, xml.size() / double(1 << 20));
+  std::printf("  %-28s %9s\n", "", "MB/s");
+  measure("tag scan, XmlRpcUtil", utilScan, xml, runs);
+  measure("tag scan, XmlRpcTokenizer", tokenizerScan, xml, runs);
+  measure("XmlRpcValue::fromXml", valueParse, xml, runs);
+  measure("XmlRpcRequestParser", requestParse, xml, runs);
+  return 0;
+}
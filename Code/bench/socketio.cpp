@@ -0,0 +1,95 @@
+// Socket io benchmark: the read and write calls made per MB moved, and the
+// time per call, for requests and responses of increasing size over loopback.
+// The library must be built with XMLRPC_IO_COUNTERS (make bench does this).
+//
+//   socketio [port] [megabytes per size]
+#include "XmlRpc.h"
+#include "XmlRpcSocket.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+
+using namespace XmlRpc;
+
+// Returns the length of the string it is sent, or a string of the length asked for
+class Transfer : public XmlRpcServerMethod {
+public:
+  Transfer(XmlRpcServer* s) : XmlRpcServerMethod("transfer", s) {}
+
+  void execute(XmlRpcValue& params, XmlRpcValue& result) {
+    if (params[0].getType() == XmlRpcValue::TypeString)
+      result = int(std::string(params[0]).size());
+    else
+      result = std::string(int(params[0]), 'x');
+  }
+};
+
+static double now()
+{
+  return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Makes calls moving 'size' bytes each way until 'total' bytes have gone, and
+// reports the io calls made by both ends per MB
+static void measure(XmlRpcClient& client, const char* direction, int size, double total)
+{
+  int calls = int(total / size) + 1;
+  XmlRpcValue args, result;
+  if (direction[0] == 'u')
+    args[0] = std::string(size, 'y');
+  else
+    args[0] = size;
+
+  XmlRpcSocket::IoCounters before = XmlRpcSocket::ioCounters();
+  double t0 = now();
+  for (int i = 0; i < calls; ++i)
+    if ( ! client.execute("transfer", args, result) || client.isFault()) {
+      std::fprintf(stderr, "call failed\n");
+      std::exit(1);
+    }
+  double t = now() - t0;
+  XmlRpcSocket::IoCounters after = XmlRpcSocket::ioCounters();
+
+  double mb = double(after.bytesRead - before.bytesRead) / (1 << 20);
+  std::printf("  %-8s %9d  %9.1f  %9.1f  %10.1f\n", direction, size,
+              (after.reads - before.reads) / mb, (after.writes - before.writes) / mb,
+              t / calls * 1e6);
+}
+
+int main(int argc, char* argv[])
+{
+  int port = (argc > 1) ? std::atoi(argv[1]) : 18301;
+  double total = ((argc > 2) ? std::atof(argv[2]) : 32.0) * (1 << 20);
+  XmlRpc::setVerbosity(0);
+
+  XmlRpcServer server;
+  Transfer transfer(&server);
+  if ( ! server.bindAndListen(port, 16)) {
+    std::fprintf(stderr, "could not listen on port %d\n", port);
+    return 1;
+  }
+  std::thread([&server] { server.work(-1.0); }).detach();
+
+  if (XmlRpcSocket::ioCounters().reads == 0) {
+    XmlRpcClient probe("127.0.0.1", port);
+    XmlRpcValue args, result;
+    args[0] = 0;
+    probe.execute("transfer", args, result);
+    if (XmlRpcSocket::ioCounters().reads == 0) {
+      std::fprintf(stderr, "the library was built without XMLRPC_IO_COUNTERS\n");
+      return 1;
+    }
+  }
+
+  XmlRpcClient client("127.0.0.1", port);
+  std::printf("  %-8s %9s  %9s  %9s  %10s\n", "", "bytes", "reads/MB", "writes/MB", "us/call");
+  for (const char* direction : {"upload", "download"})
+    for (int size : {4096, 65536, 1 << 20, 10 << 20})
+      measure(client, direction, size, total);
+
+  std::fflush(stdout);
+  std::_Exit(0);   // The server thread is still in work()
+}
@@ -0,0 +1,97 @@
+// Socket options benchmark: the round trip time of sync calls over loopback,
+// small and large, with the client and server both using each options preset:
+// the system defaults, lowLatency() and bulk().
+//
+//   sockopts [port] [small calls]
+#include "XmlRpc.h"
+#include "XmlRpcSocket.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace XmlRpc;
+
+class Echo : public XmlRpcServerMethod {
+public:
+  Echo(XmlRpcServer* s) : XmlRpcServerMethod("echo", s) {}
+
+  void execute(XmlRpcValue& params, XmlRpcValue& result) { result = params[0]; }
+};
+
+static double now()
+{
+  return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Starts a server using 'options' on its own thread
+static void serve(int port, XmlRpcSocket::Options const& options)
+{
+  XmlRpcServer* server = new XmlRpcServer;
+  new Echo(server);
+  server->setSocketOptions(options);
+  if ( ! server->bindAndListen(port, 16)) {
+    std::fprintf(stderr, "could not listen on port %d\n", port);
+    std::exit(1);
+  }
+  std::thread([server] { server->work(-1.0); }).detach();
+}
+
+// Makes 'calls' calls echoing 'size' bytes and prints the median, p99 and mean
+// round trip in microseconds
+static void run(const char* name, int port, XmlRpcSocket::Options const& options, int size, int calls)
+{
+  XmlRpcClient client("127.0.0.1", port);
+  client.setSocketOptions(options);
+
+  XmlRpcValue args, result;
+  args[0] = std::string(size, 'x');
+  std::vector<double> us;
+  for (int i = 0; i < calls + 10; ++i) {
+    double t0 = now();
+    if ( ! client.execute("echo", args, result) || client.isFault()) {
+      std::fprintf(stderr, "call failed\n");
+      std::exit(1);
+    }
+    if (i >= 10)   // The first calls connect and warm up
+      us.push_back((now() - t0) * 1e6);
+  }
+
+  std::sort(us.begin(), us.end());
+  double mean = 0;
+  for (double t : us) mean += t;
+  mean /= us.size();
+  std::printf("  %-12s %9d %10.1f %10.1f %10.1f\n", name, size,
+              us[us.size() / 2], us[us.size() * 99 / 100], mean);
+}
+
+int main(int argc, char* argv[])
+{
+  int port = (argc > 1) ? std::atoi(argv[1]) : 18331;
+  int calls = (argc > 2) ? std::atoi(argv[2]) : 20000;
+  XmlRpc::setVerbosity(0);
+
+  struct Preset {
+    const char* name;
+    XmlRpcSocket::Options options;
+  } presets[] = {
+    { "default", XmlRpcSocket::Options() },
+    { "lowLatency", XmlRpcSocket::Options::lowLatency() },
+    { "bulk", XmlRpcSocket::Options::bulk() },
+  };
+
+  for (int i = 0; i < 3; ++i)
+    serve(port + i, presets[i].options);
+
+  std::printf("  %-12s %9s %10s %10s %10s\n", "", "bytes", "p50 us", "p99 us", "mean us");
+  for (int size : {64, 1 << 20})
+    for (int i = 0; i < 3; ++i)
+      run(presets[i].name, port + i, presets[i].options, size, (size < 4096) ? calls : calls / 100);
+
+  std::fflush(stdout);
+  std::_Exit(0);   // The server threads are still in work()
+}
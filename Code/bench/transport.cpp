@@ -0,0 +1,88 @@
+// Transport benchmark: the round trip time of the same sync call, small and
+// large, over TCP loopback and over a unix domain socket.
+//
+//   transport [port] [socket path] [small calls]
+#include "XmlRpc.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace XmlRpc;
+
+class Echo : public XmlRpcServerMethod {
+public:
+  Echo(XmlRpcServer* s) : XmlRpcServerMethod("echo", s) {}
+
+  void execute(XmlRpcValue& params, XmlRpcValue& result) { result = params[0]; }
+};
+
+static double now()
+{
+  return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Starts a server on 'endpoint' on its own thread
+static void serve(std::string const& endpoint)
+{
+  XmlRpcServer* server = new XmlRpcServer;
+  new Echo(server);
+  if ( ! server->bindAndListen(endpoint, 16)) {
+    std::fprintf(stderr, "could not listen on %s\n", endpoint.c_str());
+    std::exit(1);
+  }
+  std::thread([server] { server->work(-1.0); }).detach();
+}
+
+// Makes 'calls' calls echoing 'size' bytes and prints the median, p99 and mean
+// round trip in microseconds
+static void run(const char* name, XmlRpcClient& client, int size, int calls)
+{
+  XmlRpcValue args, result;
+  args[0] = std::string(size, 'x');
+  std::vector<double> us;
+  for (int i = 0; i < calls + 10; ++i) {
+    double t0 = now();
+    if ( ! client.execute("echo", args, result) || client.isFault()) {
+      std::fprintf(stderr, "call failed\n");
+      std::exit(1);
+    }
+    if (i >= 10)   // The first calls connect and warm up
+      us.push_back((now() - t0) * 1e6);
+  }
+
+  std::sort(us.begin(), us.end());
+  double mean = 0;
+  for (double t : us) mean += t;
+  mean /= us.size();
+  std::printf("  %-6s %9d %10.1f %10.1f %10.1f\n", name, size,
+              us[us.size() / 2], us[us.size() * 99 / 100], mean);
+}
+
+int main(int argc, char* argv[])
+{
+  int port = (argc > 1) ? std::atoi(argv[1]) : 18341;
+  std::string path = (argc > 2) ? argv[2] : "/tmp/xmlrpc-transport.sock";
+  int calls = (argc > 3) ? std::atoi(argv[3]) : 20000;
+  XmlRpc::setVerbosity(0);
+
+  serve(std::to_string(port));
+  serve("unix:" + path);
+
+  XmlRpcClient tcp("127.0.0.1", port);
+  XmlRpcClient local(("unix:" + path).c_str(), 0);
+
+  std::printf("  %-6s %9s %10s %10s %10s\n", "", "bytes", "p50 us", "p99 us", "mean us");
+  for (int size : {64, 4096, 1 << 20}) {
+    int n = (size < 65536) ? calls : calls / 100;
+    run("tcp", tcp, size, n);
+    run("unix", local, size, n);
+  }
+
+  std::fflush(stdout);
+  std::_Exit(0);   // The server threads are still in work()
+}
@@ -0,0 +1,40 @@
+
+#ifndef _XMLRPCBASE64_H_
+#define _XMLRPCBASE64_H_
+//
+// XmlRpc++ Copyright (c) 2002-2003 by Chris Morley
+//
+#if defined(_MSC_VER)
+# pragma warning(disable:4786)    // identifier was truncated in debug info
+#endif
+
+#ifndef MAKEDEPEND
+# include <stddef.h>
+# include <string>
+# include <vector>
+#endif
+
+namespace XmlRpc {
+
+  //! Block-based base64 codec. Encoding and decoding write straight into the
+  //! destination buffer after a single size reservation. On x86 CPUs with AVX2,
+  //! 24 bytes are encoded (32 chars decoded) per step; elsewhere a table-driven
+  //! scalar path is used.
+  class XmlRpcBase64 {
+  public:
+    //! Number of chars produced by encode() for len bytes of data.
+    static size_t encodedLength(size_t len);
+
+    //! Append the base64 encoding of [data, data+len) to out. A '\n' is written
+    //! after every 72 chars, as base64 requires lines no longer than 76 chars.
+    static void encode(const char* data, size_t len, std::string& out);
+
+    //! Decode the base64 text in [text, text+len), appending the bytes to out.
+    //! Whitespace and other chars outside the alphabet are skipped, and decoding
+    //! stops at the '=' padding. Returns false if the input is malformed.
+    static bool decode(const char* text, size_t len, std::vector<char>& out);
+  };
+
+} // namespace XmlRpc
+
+#endif // _XMLRPCBASE64_H_
@@ -0,0 +1,53 @@
+
+#ifndef _XMLRPCBINARY_H_
+#define _XMLRPCBINARY_H_
+//
+// XmlRpc++ Copyright (c) 2002-2003 by Chris Morley
+//
+#if defined(_MSC_VER)
+# pragma warning(disable:4786)    // identifier was truncated in debug info
+#endif
+
+#ifndef MAKEDEPEND
+# include <string>
+# include <string_view>
+#endif
+
+#include "XmlRpcValue.h"
+
+namespace XmlRpc {
+
+  //! Calls and responses in a compact binary encoding, an alternative to xml
+  //! for clients that ask for it. A request sent with Content-Type CONTENT_TYPE
+  //! is answered in kind; xml requests are unaffected. Methods see the same
+  //! values either way.
+  //!
+  //! A message is a kind byte ('C' call, 'R' result or 'F' fault). A call
+  //! continues with the method name, as a varint length and the name bytes,
+  //! then the params as an array value; a response with the value. Values are
+  //! written by XmlRpcValue::appendBinary.
+  class XmlRpcBinary {
+  public:
+    //! The content type of binary messages
+    static const char CONTENT_TYPE[];
+
+    //! Return true if a Content-Type header value names the binary encoding.
+    static bool isContentType(const char* value);
+
+    //! Append a call. As for XmlRpcClient::execute, if params is an array each
+    //! element is a separate parameter.
+    static void appendCall(std::string& body, const char* methodName, XmlRpcValue const& params);
+
+    //! Decode a call. Returns false if the body is malformed.
+    static bool parseCall(std::string_view body, std::string& methodName, XmlRpcValue& params);
+
+    //! Append a response holding a result, or a fault struct if isFault.
+    static void appendResponse(std::string& body, XmlRpcValue const& result, bool isFault = false);
+
+    //! Decode a response. Returns false if the body is malformed.
+    static bool parseResponse(std::string_view body, XmlRpcValue& result, bool* isFault);
+  };
+
+} // namespace XmlRpc
+
+#endif // _XMLRPCBINARY_H_
@@ -0,0 +1,74 @@
+#ifndef _XMLRPCBUFFER_H_
+#define _XMLRPCBUFFER_H_
+//
+// XmlRpc++ Copyright (c) 2002-2003 by Chris Morley
+//
+#if defined(_MSC_VER)
+# pragma warning(disable:4786)    // identifier was truncated in debug info
+#endif
+
+#ifndef MAKEDEPEND
+# include <memory>
+# include <stddef.h>
+# include <string_view>
+#endif
+
+namespace XmlRpc {
+
+  //! A buffer of bytes read from a connection. Unlike a std::string, room can be
+  //! made at the end without first filling it, so a socket can read straight
+  //! into it: room() returns the free space, and commit() adds what was read.
+  //! Bytes consumed from the front are dropped without moving the rest, which is
+  //! only moved to the front when room is needed. The contents are always
+  //! followed by a nul, so c_str() can be used for text.
+  class XmlRpcBuffer {
+  public:
+    XmlRpcBuffer() : _begin(0), _size(0), _capacity(0) {}
+
+    const char* data() const { return _data ? _data.get() + _begin : ""; }
+    const char* c_str() const { return data(); }
+    size_t size() const { return _size; }
+    size_t length() const { return _size; }
+    bool empty() const { return _size == 0; }
+    size_t capacity() const { return _capacity; }
+    size_t spare() const { return _capacity - _begin - _size; }
+    std::string_view view() const { return std::string_view(data(), _size); }
+
+    //! Return space for at least n more bytes at the end. Storage grows at least
+    //! twofold, so a buffer filled in steps is moved a bounded number of times.
+    char* room(size_t n);
+
+    //! Add n bytes written into the space returned by room().
+    void commit(size_t n);
+
+    //! Append n bytes.
+    void append(const char* p, size_t n);
+
+    //! Replace the contents with n bytes.
+    void assign(const char* p, size_t n) { clear(); append(p, n); }
+
+    //! Drop the first n bytes.
+    void consume(size_t n);
+
+    //! Drop all but the first n bytes.
+    void truncate(size_t n);
+
+    //! Empty the buffer. Storage larger than KEEP_CAPACITY is freed, so a
+    //! connection that was sent one large message doesn't hold on to it.
+    void clear();
+
+    //! Exchange contents and storage with another buffer.
+    void swap(XmlRpcBuffer& other);
+
+    static const size_t KEEP_CAPACITY = 256 << 10;
+
+  private:
+    std::unique_ptr<char[]> _data;   // _capacity + 1 bytes, for the nul
+    size_t _begin;                   // Offset of the first byte
+    size_t _size;
+    size_t _capacity;
+  };
+
+} // namespace XmlRpc
+
+#endif // _XMLRPCBUFFER_H_
@@ -10,16 +10,26 @@
 
 
 #ifndef MAKEDEPEND
+# include <chrono>
+# include <deque>
+# include <functional>
+# include <future>
+# include <memory>
+# include <set>
 # include <string>
+# include <vector>
 #endif
 
+#include "XmlRpcBuffer.h"
 #include "XmlRpcDispatch.h"
+#include "XmlRpcSocket.h"
 #include "XmlRpcSource.h"
+#include "XmlRpcValue.h"
 
 namespace XmlRpc {
 
-  // Arguments and results are represented by XmlRpcValues
-  class XmlRpcValue;
+  // Shared memory connection to a server on the same host
+  class XmlRpcShmChannel;
 
   //! A class to send XML RPC requests to a server and return the results.
   class XmlRpcClient : public XmlRpcSource {
@@ -36,8 +46,18 @@ namespace XmlRpc {
     static const char METHODRESPONSE_TAG[];
     static const char FAULT_TAG[];
 
+    //! Called with the outcome of an asynchronous call.
+    //!  @param ok      true if a result was received (although it might be a fault)
+    //!  @param result  The result value, or the fault
+    //!  @param isFault true if the result is a fault response
+    typedef std::function<void(bool ok, XmlRpcValue& result, bool isFault)> Callback;
+
     //! Construct a client to connect to the server at the specified host:port address
-    //!  @param host The name of the remote machine hosting the server
+    //!  @param host The name of the remote machine hosting the server, or
+    //!              "unix:/path" for a server on the same host listening on a
+    //!              unix domain socket, or "shm:/path" to connect to such a
+    //!              server through shared memory (see XmlRpcShmChannel); the
+    //!              port is then not used
     //!  @param port The port on the remote machine where the server is listening
     //!  @param uri  An optional string to be sent as the URI in the HTTP GET header
     XmlRpcClient(const char* host, int port, const char* uri=0);
@@ -49,75 +69,338 @@ namespace XmlRpc {
     //!  @param method The name of the remote procedure to execute
     //!  @param params An array of the arguments for the method
     //!  @param result The result value to be returned to the client
+    //!  @param timeout Seconds to wait for the result, or negative to wait
+    //!   as long as it takes (see executeAsync)
     //!  @return true if the request was sent and a result received 
     //!   (although the result might be a fault).
     //!
-    //! Currently this is a synchronous (blocking) implementation (execute
-    //! does not return until it receives a response or an error). Use isFault()
-    //! to determine whether the result is a fault response.
-    bool execute(const char* method, XmlRpcValue const& params, XmlRpcValue& result);
+    //! This is a synchronous (blocking) call: execute does not return until it
+    //! receives a response, an error or the timeout, running the dispatcher
+    //! meanwhile (so a shared dispatcher serves its other sources too). It must
+    //! not be called from within the dispatcher's work(), such as from a
+    //! callback. Use isFault() to determine whether the result is a fault response.
+    bool execute(const char* method, XmlRpcValue const& params, XmlRpcValue& result, double timeout=-1.0);
+
+    //! Start executing the named procedure on the remote server, returning
+    //! without waiting for the result. Any number of calls may be outstanding:
+    //! they are written to the connection back to back, without waiting for
+    //! earlier ones to be answered, and the responses are matched to them in
+    //! order. The callback is called from the dispatcher's work() (see
+    //! setDispatch) when the call completes or fails. It may start more calls,
+    //! but must not delete the client.
+    //!
+    //! If timeout is not negative, the call fails once that many seconds have
+    //! passed without a result. A call not yet written is just dropped. One
+    //! written is left for its response to be read and thrown away, so that
+    //! the calls behind it keep the connection; but if none of the calls
+    //! written is still wanted, the connection is closed rather than left
+    //! waiting on a server that may be stuck, and the calls not yet written
+    //! are sent on a new one.
+    //!  @return false, without calling the callback, if the call could not be
+    //!   started (for example, if the server could not be connected to).
+    bool executeAsync(const char* method, XmlRpcValue const& params, Callback callback, double timeout=-1.0);
+
+    //! As executeAsync above, returning a future for the result. A fault
+    //! response is set as an XmlRpcException holding the fault string and code,
+    //! and a failed call as an XmlRpcException too. The future only becomes
+    //! ready as the dispatcher is run.
+    std::future<XmlRpcValue> executeAsync(const char* method, XmlRpcValue const& params, double timeout=-1.0);
+
+    //! Return the number of calls started and not yet completed.
+    int pending() const;
+
+    //! Specify the most calls written to the connection and not yet answered.
+    //! Later calls wait to be written until earlier ones are answered. Over a
+    //! slow link a few in flight hide the round trip; a limit keeps a server
+    //! that stops answering from being sent more work. Default (or 0) is no
+    //! limit.
+    //!
+    //! If the server closes the connection before answering every call
+    //! written, whether it says so (Connection: close) or not, the calls not
+    //! answered are sent again on a new connection. A call is only sent again
+    //! once for each response received, so a server that keeps failing fails
+    //! the calls rather than looping. As the server may have run a call before
+    //! the connection was lost, calls that must not run twice should not be
+    //! pipelined behind others on a connection the server may close.
+    void setPipelineDepth(int depth) { _pipelineDepth = depth; }
+
+    //! Return the most calls written to the connection and not yet answered.
+    int pipelineDepth() const { return _pipelineDepth; }
+
+    //! Specify that calls started close together are sent as one
+    //! system.multicall request, saving a round trip and a response for each:
+    //! up to maxCalls calls, started within window seconds of the first (0 for
+    //! those started before the dispatcher next runs). Each call still gets
+    //! its own result or fault through its callback; if the multicall as a
+    //! whole fails (as when the server doesn't support it) every call in it
+    //! gets that fault. The server runs the calls in a multicall one after
+    //! another, in order, so a slow call holds back the results of the calls
+    //! after it. A multicall fails as a whole at the earliest of its calls'
+    //! deadlines. execute() sends its call at once, along with any waiting.
+    //! Default (or maxCalls of 0 or 1) is to send each call alone.
+    void setMulticallBatch(int maxCalls, double window=0.0) { _batchSize = maxCalls; _batchWindow = window; }
+
+    //! Return the most calls sent as one system.multicall.
+    int multicallBatch() const { return _batchSize; }
+
+    //! Return how long, in seconds, calls are gathered for a system.multicall.
+    double multicallWindow() const { return _batchWindow; }
+
+    //! Specify that a call to an idempotent method (see setIdempotent) not
+    //! answered within the given percentile of recent call latencies (such as
+    //! 0.95) is sent again on a second connection, to the same server or to
+    //! host:port if given, and that whichever answer comes first is taken; a
+    //! call only fails if both do. This trades a few more calls (about 1 -
+    //! percentile of them) for a shorter tail, when the slow calls are slow
+    //! for reasons the other connection or server doesn't share. Calls are not
+    //! hedged until enough have been timed, nor calls sent in a
+    //! system.multicall. Default (or a percentile of 0) is not to hedge.
+    void setHedging(double percentile, const char* host=0, int port=0);
+
+    //! Return the percentile of call latencies after which calls are hedged.
+    double hedgingPercentile() const { return _hedgePercentile; }
+
+    //! Specify whether running the named method twice does no harm, so that
+    //! its calls may be hedged.
+    void setIdempotent(const char* method, bool idempotent=true);
+
+    //! Return true if calls to the named method may be hedged.
+    bool isIdempotent(const char* method) const { return _idempotent.count(method) != 0; }
+
+    //! Return the time, in seconds, after which calls are hedged, or a
+    //! negative value until enough calls have been timed.
+    double hedgeDelay() const { return _hedgeDelay; }
+
+    //! Return the number of calls hedged.
+    int hedgesSent() const { return _hedgesSent; }
+
+    //! Return the number of hedged calls the second connection answered first.
+    int hedgesWon() const { return _hedgesWon; }
+
+    //! Specify the dispatcher that drives the connection. Many clients (and
+    //! servers) can share one, so that a single thread running its work() can
+    //! keep many calls in flight. Default (or null) is a dispatcher of the
+    //! client's own, which only execute() runs.
+    void setDispatch(XmlRpcDispatch* dispatch);
+
+    //! Return the dispatcher that drives the connection.
+    XmlRpcDispatch* dispatch() const { return _dispatch; }
+
+    //! Return true if there is a connection to the server to use: one with
+    //! calls in flight, or an idle one that the server has not closed. An idle
+    //! connection that the server has closed is closed here, so that the next
+    //! call connects again at once.
+    bool checkConnection();
 
     //! Returns true if the result of the last execute() was a fault response.
     bool isFault() const { return _isFault; }
 
+    //! Specify whether requests are sent in the compact binary encoding (see
+    //! XmlRpcBinary) rather than xml. The client accepts either encoding in
+    //! the response, so a server that answers in xml still works. Default is
+    //! not enabled.
+    void setBinaryEncoding(bool enabled=true) { _binaryEncoding = enabled; }
+
+    //! Return true if requests are sent in the binary encoding.
+    bool binaryEncoding() const { return _binaryEncoding; }
+
+    //! Specify the TCP options for connections to the server, such as
+    //! XmlRpcSocket::Options::lowLatency(). They apply from the next connection.
+    //! Default is the system defaults. Over shared memory only busyPoll
+    //! applies, as the time to spin waiting for the server before sleeping.
+    void setSocketOptions(XmlRpcSocket::Options const& options) { _socketOptions = options; }
+
+    //! Return the TCP options for connections to the server.
+    XmlRpcSocket::Options const& socketOptions() const { return _socketOptions; }
+
 
     // XmlRpcSource interface implementation
-    //! Close the connection
+    //! Close the connection. Calls that have not completed fail.
     virtual void close();
 
-    //! Handle server responses. Called by the event dispatcher during execute.
+    //! Handle server responses. Called by the event dispatcher.
     //!  @param eventType The type of event that occurred. 
     //!  @see XmlRpcDispatch::EventType
     virtual unsigned handleEvent(unsigned eventType);
 
   protected:
+    typedef std::chrono::steady_clock Clock;
+
+    // A call sent on both connections (see setHedging)
+    struct Hedge;
+
+    // A call started and not yet completed
+    struct Call {
+      std::string request;      // The http header and body
+      Callback callback;        // Null once no one is waiting for the result
+      int count;                // Calls it carries (more for a system.multicall)
+      Clock::time_point started;    // When it was started, if it is timed
+      Clock::time_point deadline;   // When it fails unanswered
+      Clock::time_point hedgeAt;    // When to hedge it, if it may be
+      std::string method;           // What to call to hedge it
+      XmlRpcValue params;
+      std::shared_ptr<Hedge> hedge; // Set once it has been hedged
+    };
+
     // Execution processing helpers
     virtual bool doConnect();
     virtual bool setupConnection();
+    bool connectLocal();
+    void queueCall(Callback callback, int count, Clock::time_point deadline,
+                   const char* method=0, XmlRpcValue const* params=0);
+    void batchCall(const char* method, XmlRpcValue const& params, Callback callback, Clock::time_point deadline);
+    void flushBatch();
+    void failBatch();
+    void monitor();
+    void wakeBy(Clock::time_point at);
+    void cancelWakeup();
+    void handleTimers();
+    void hedgeCall(Call& call, Clock::time_point now);
+    void abandonCall(std::shared_ptr<Hedge> const& hedge);
+    bool dropAbandoned();
+    void recordLatency(double seconds);
+    unsigned handleIo();
+    unsigned handleShmEvent();
+    unsigned eventMask() const;
+    bool canWrite() const;
+    void completeCall();
+    unsigned failCalls();
+    bool writeFailed();
+    bool resendCalls();
+
+    // Read and write over the socket or shared memory channel
+    bool readData(XmlRpcBuffer& s, size_t expected = 0);
+    bool writeData(std::string& s);
+    void closeConnection();
 
     virtual bool generateRequest(const char* method, XmlRpcValue const& params);
     virtual std::string generateHeader(std::string const& body);
     virtual bool writeRequest();
     virtual bool readHeader();
     virtual bool readResponse();
-    virtual bool parseResponse(XmlRpcValue& result);
+    virtual bool parseResponse(XmlRpcValue& result, bool& isFault);
 
-    // Possible IO states for the connection
-    enum ClientConnectionState { NO_CONNECTION, CONNECTING, WRITE_REQUEST, READ_HEADER, READ_RESPONSE, IDLE };
+    // Possible IO states for the connection, as it reads responses. Requests
+    // are written alongside whenever there are calls not yet written.
+    enum ClientConnectionState { NO_CONNECTION, CONNECTING, READ_HEADER, READ_RESPONSE, IDLE };
     ClientConnectionState _connectionState;
 
     // Server location
     std::string _host;
     std::string _uri;
     int _port;
+    std::string _unixPath;    // Socket path if the server is on a unix domain socket
+    bool _sharedMemory;       // Whether to connect to it through shared memory
+
+    // The shared memory channel while connected through one
+    XmlRpcShmChannel* _shm;
 
-    // The xml-encoded request, http header of response, and response xml
+    // When to try again to connect to a unix domain server whose backlog was
+    // full; max() if no connect is waiting
+    Clock::time_point _connectRetryAt;
+
+    // The server address, and until when it may be used without asking the
+    // resolver again
+    XmlRpcSocket::Address _address;
+    Clock::time_point _addressExpires;
+
+    // The request being generated, http header of response (and whatever
+    // follows it), and response xml
     std::string _request;
-    std::string _header;
-    std::string _response;
+    XmlRpcBuffer _header;
+    XmlRpcBuffer _response;
+
+    // Calls in the order they were started. The first is the one being
+    // answered, and the first _callsWritten have been written in full.
+    std::deque<Call> _calls;
+    size_t _callsWritten;
+
+    // Calls waiting to be sent as one system.multicall: the array of structs
+    // naming each method and its params, and their callbacks
+    XmlRpcValue _batch;
+    std::vector<Callback> _batchCallbacks;
+
+    // Most calls in a system.multicall (0 or 1 to send each alone), and how
+    // long to wait for more after the first
+    int _batchSize;
+    double _batchWindow;
+
+    // When the calls waiting are to be sent together, and the earliest of
+    // their deadlines
+    Clock::time_point _batchDue;
+    Clock::time_point _batchDeadline;
 
-    // Number of times the client has attempted to send the request
+    // When the dispatcher is to wake the client next, for the batch, a
+    // deadline or a hedge; max() if it isn't
+    Clock::time_point _wakeAt;
+
+    // Hedging: the percentile of latencies to hedge after (0 not to hedge),
+    // where to send the copies, and the client sending them, made when first
+    // needed
+    double _hedgePercentile;
+    std::string _hedgeHost;
+    int _hedgePort;
+    XmlRpcClient* _hedgeClient;
+
+    // Methods whose calls may be hedged
+    std::set<std::string> _idempotent;
+
+    // The latencies of the most recent calls timed, the next to replace, and
+    // the number timed since the delay was last estimated from them
+    std::vector<double> _latencies;
+    size_t _latencyNext;
+    int _latencyUpdate;
+
+    // The latency after which calls are hedged (negative until estimated),
+    // and the number hedged and won by the copy
+    double _hedgeDelay;
+    int _hedgesSent;
+    int _hedgesWon;
+
+    // Number of times the client has attempted to send the outstanding calls
+    // since the last response
     int _sendAttempts;
 
-    // Number of bytes of the request that have been written to the socket so far
+    // Most calls written and not yet answered; 0 for no limit
+    int _pipelineDepth;
+
+    // True if no more calls are to be written to the connection: the server
+    // closes it after the response being read, or a write to it failed
+    bool _closing;
+
+    // Number of bytes of the next request that have been written to the socket so far
     int _bytesWritten;
 
-    // True if we are currently executing a request. If you want to multithread,
-    // each thread should have its own client.
+    // True if we are currently in execute(). A client is not thread safe; to
+    // make calls from several threads, share an XmlRpcClientPool instead.
     bool _executing;
 
     // True if the server closed the connection
     bool _eof;
 
-    // True if a fault response was returned by the server
+    // True if the last execute() got a fault response
     bool _isFault;
 
     // Number of bytes expected in the response body (parsed from response header)
     int _contentLength;
 
-    // Event dispatcher
+    // Whether requests are sent in the binary encoding
+    bool _binaryEncoding;
+
+    // Whether the current response is in the binary encoding
+    bool _binaryResponse;
+
+    // TCP options for connections to the server
+    XmlRpcSocket::Options _socketOptions;
+
+    // Event dispatcher of the client's own
     XmlRpcDispatch _disp;
 
+    // The dispatcher in use, _disp or a shared one, and whether the
+    // connection is being monitored by it
+    XmlRpcDispatch* _dispatch;
+    bool _monitored;
+
   };	// class XmlRpcClient
 
 }	// namespace XmlRpc
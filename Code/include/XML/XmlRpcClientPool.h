@@ -0,0 +1,130 @@
+
+#ifndef _XMLRPCCLIENTPOOL_H_
+#define _XMLRPCCLIENTPOOL_H_
+//
+// XmlRpc++ Copyright (c) 2002-2003 by Chris Morley
+//
+#if defined(_MSC_VER)
+# pragma warning(disable:4786)    // identifier was truncated in debug info
+#endif
+
+#ifndef MAKEDEPEND
+# include <atomic>
+# include <condition_variable>
+# include <memory>
+# include <mutex>
+# include <string>
+#endif
+
+#include "XmlRpcSocket.h"
+
+namespace XmlRpc {
+
+  class XmlRpcClient;
+  class XmlRpcValue;
+
+  //! A set of keep-alive connections to one server, shared by any number of
+  //! threads. A call takes an idle connection, or makes a new one up to a
+  //! limit, and gives it back afterwards, so threads don't each pay for
+  //! connecting.
+  //!
+  //! Taking and giving back connections is lock-free: each connection has a
+  //! slot with an atomic in-use flag. A thread only blocks when every
+  //! connection is in use and no more may be made. Connections idle for
+  //! longer than the idle timeout are closed, down to a minimum, and one idle
+  //! for longer than the check interval is checked before it is used, so that
+  //! a connection the server has closed is replaced rather than failing a call.
+  //! Idle connections are looked over as connections are given back.
+  class XmlRpcClientPool {
+  public:
+    //! Construct a pool of connections to the server at host:port (see
+    //! XmlRpcClient), making at most maxConnections.
+    XmlRpcClientPool(const char* host, int port, const char* uri=0, int maxConnections=16);
+
+    //! Destructor. Closes the connections; none may be in use.
+    ~XmlRpcClientPool();
+
+    //! Execute the named procedure on the server, on a connection from the
+    //! pool. As XmlRpcClient::execute, with isFault (unless null) set to
+    //! whether the result is a fault response. May be called from any thread.
+    bool execute(const char* method, XmlRpcValue const& params, XmlRpcValue& result, bool* isFault=0,
+                 double timeout=-1.0);
+
+    //! Take a connection for a series of calls, waiting while all are in use.
+    //! It must be given back with release().
+    XmlRpcClient* acquire();
+
+    //! Give back a connection taken with acquire().
+    void release(XmlRpcClient* client);
+
+    //! Specify the fewest connections kept open while idle. Default is 1.
+    void setMinIdle(int connections) { _minIdle = connections; }
+
+    //! Specify how long, in seconds, a connection beyond the minimum is kept
+    //! open while idle. Default is 30.
+    void setIdleTimeout(double seconds) { _idleTimeout = seconds; }
+
+    //! Specify how long, in seconds, a connection may be idle before it is
+    //! checked when next taken. Default is 1.
+    void setCheckInterval(double seconds) { _checkInterval = seconds; }
+
+    //! Specify whether the connections use the binary encoding (see
+    //! XmlRpcClient::setBinaryEncoding). Set before the pool is used.
+    void setBinaryEncoding(bool enabled=true) { _binaryEncoding = enabled; }
+
+    //! Specify the TCP options for the connections (see
+    //! XmlRpcClient::setSocketOptions). Set before the pool is used.
+    void setSocketOptions(XmlRpcSocket::Options const& options) { _socketOptions = options; }
+
+    //! The most connections the pool makes.
+    int maxConnections() const { return _maxConnections; }
+
+    //! The number of connections open, as of when each was last given back.
+    int connections() const;
+
+  protected:
+    typedef long long Ticks;      // steady_clock ticks
+
+    // A connection and its state
+    struct Slot {
+      std::atomic<bool> inUse;
+      std::atomic<bool> open;     // Whether the connection was open when given back
+      std::atomic<Ticks> idleSince;
+      std::atomic<XmlRpcClient*> client;    // Made by the first thread to take the slot
+    };
+
+    XmlRpcClient* tryAcquire();
+    void giveBack(Slot& slot);
+    void sweep(Ticks now);
+    static Ticks now();
+    static Ticks ticks(double seconds);
+
+    // Server location
+    std::string _host;
+    int _port;
+    std::string _uri;
+
+    // Slots [0, _slotsUsed) have been taken at least once
+    std::unique_ptr<Slot[]> _slots;
+    int _maxConnections;
+    std::atomic<int> _slotsUsed;
+
+    // Settings
+    int _minIdle;
+    double _idleTimeout;
+    double _checkInterval;
+    bool _binaryEncoding;
+    XmlRpcSocket::Options _socketOptions;
+
+    // When idle connections were last looked over
+    std::atomic<Ticks> _lastSweep;
+
+    // Threads waiting for a connection to be given back
+    std::mutex _mutex;
+    std::condition_variable _released;
+    std::atomic<int> _waiters;
+  };
+
+} // namespace XmlRpc
+
+#endif // _XMLRPCCLIENTPOOL_H_
@@ -29,7 +29,8 @@ namespace XmlRpc {
     enum EventType {
       ReadableEvent = 1,    //!< data available to read
       WritableEvent = 2,    //!< connected/data can be written without blocking
-      Exception     = 4     //!< uh oh
+      Exception     = 4,    //!< uh oh
+      TimeoutEvent  = 8     //!< the time set with setSourceWakeup has come
     };
     
     //! Monitor this source for the event types specified by the event mask
@@ -45,6 +46,13 @@ namespace XmlRpc {
     //! Modify the types of events to watch for on this source
     void setSourceEvents(XmlRpcSource* source, unsigned eventMask);
 
+    //! Call this source's event handler with TimeoutEvent once the specified
+    //! number of seconds has passed (0 for the next time through work()),
+    //! whatever other events it is watched for. Until then the source stays
+    //! monitored even if its handler returns no events to watch for. A
+    //! negative time cancels the wakeup.
+    void setSourceWakeup(XmlRpcSource* source, double seconds);
+
 
     //! Watch current set of sources and process events for the specified
     //! duration (in ms, -1 implies wait forever, or until exit is called)
@@ -63,11 +71,13 @@ namespace XmlRpc {
 
     // A source to monitor and what to monitor it for
     struct MonitoredSource {
-      MonitoredSource(XmlRpcSource* src, unsigned mask) : _src(src), _mask(mask) {}
+      MonitoredSource(XmlRpcSource* src, unsigned mask) : _src(src), _mask(mask), _wakeTime(-1.0) {}
       XmlRpcSource* getSource() const { return _src; }
       unsigned& getMask() { return _mask; }
+      double& getWakeTime() { return _wakeTime; }
       XmlRpcSource* _src;
       unsigned _mask;
+      double _wakeTime;     // When to report TimeoutEvent (-1 implies never)
     };
 
     // A list of sources to monitor
@@ -0,0 +1,61 @@
+
+#ifndef _XMLRPCJSON_H_
+#define _XMLRPCJSON_H_
+//
+// XmlRpc++ Copyright (c) 2002-2003 by Chris Morley
+//
+#if defined(_MSC_VER)
+# pragma warning(disable:4786)    // identifier was truncated in debug info
+#endif
+
+#ifndef MAKEDEPEND
+# include <string>
+# include <string_view>
+#endif
+
+#include "XmlRpcValue.h"
+
+namespace XmlRpc {
+
+  //! JSON-RPC 2.0 requests and responses. A request sent to the server with
+  //! Content-Type CONTENT_TYPE is handled as JSON-RPC by the same methods as
+  //! xml-rpc requests:
+  //!
+  //!   {"jsonrpc":"2.0","method":"login","params":[{"username":"u","password":"p"}],"id":1}
+  //!
+  //! Params given as an array are the method's params; params given as an
+  //! object are passed as a single struct param. A batch (an array of
+  //! requests) is run as one system.multicall.
+  class XmlRpcJson {
+  public:
+    //! The content type of JSON-RPC messages
+    static const char CONTENT_TYPE[];
+
+    //! JSON-RPC error codes. Invalid params are reported with
+    //! XmlRpcSchema::INVALID_PARAMS, and method faults with their own code.
+    static const int PARSE_ERROR = -32700;
+    static const int INVALID_REQUEST = -32600;
+    static const int METHOD_NOT_FOUND = -32601;
+
+    //! Return true if a Content-Type header value names JSON.
+    static bool isContentType(const char* value);
+
+    //! Decode a JSON text holding one value. Returns false if it is malformed.
+    static bool parse(std::string_view text, XmlRpcValue& value);
+
+    //! Take a request object apart. Returns false if it is not a valid request;
+    //! id is then still set if the request had a usable one. A request without
+    //! an id is a notification, which gets no response.
+    static bool parseCall(XmlRpcValue const& request, std::string& methodName, XmlRpcValue& params,
+                          XmlRpcValue& id, bool* notification);
+
+    //! Append a response object returning a result.
+    static void appendResult(std::string& body, XmlRpcValue const& result, XmlRpcValue const& id);
+
+    //! Append a response object returning an error.
+    static void appendError(std::string& body, int code, std::string const& message, XmlRpcValue const& id);
+  };
+
+} // namespace XmlRpc
+
+#endif // _XMLRPCJSON_H_
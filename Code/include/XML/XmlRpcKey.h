@@ -0,0 +1,107 @@
+
+#ifndef _XMLRPCKEY_H_
+#define _XMLRPCKEY_H_
+//
+// XmlRpc++ Copyright (c) 2002-2003 by Chris Morley
+//
+#if defined(_MSC_VER)
+# pragma warning(disable:4786)    // identifier was truncated in debug info
+#endif
+
+#ifndef MAKEDEPEND
+# include <stddef.h>
+# include <stdint.h>
+# include <string>
+# include <string_view>
+#endif
+
+namespace XmlRpc {
+
+  //! A struct member name known at compile time, such as "faultCode". Its length
+  //! is computed when it is defined, so it can be declared once as a constexpr
+  //! constant and then used to look up or add members without a temporary
+  //! std::string, and a key made from it refers to its text without interning:
+  //!
+  //!   static constexpr XmlRpcName STATUS("status");
+  //!   result[STATUS] = ...;
+  //!
+  //! The text must be a string literal, or otherwise outlive every use.
+  class XmlRpcName {
+  public:
+    constexpr explicit XmlRpcName(const char* name) : _data(name), _size(length(name)) {}
+
+    constexpr const char* data() const { return _data; }
+    constexpr size_t size() const { return _size; }
+    constexpr std::string_view view() const { return std::string_view(_data, _size); }
+    constexpr operator std::string_view() const { return view(); }
+
+  private:
+    static constexpr size_t length(const char* s)
+    {
+      size_t n = 0;
+      while (s[n]) ++n;
+      return n;
+    }
+
+    const char* _data;
+    size_t _size;
+  };
+
+
+  //! The name of a struct member, as stored in a struct. Names are interned in a
+  //! global table, so structs decoded from many requests refer to a single copy
+  //! of each name rather than each allocating its own. The table never shrinks
+  //! and is limited in size; names that don't fit in it (or are unusually long)
+  //! are copied into the key as a std::string would be. Keys made from an
+  //! XmlRpcName refer to its text directly.
+  //!
+  //! Keys order as their text does, and compare with XmlRpcName, std::string and
+  //! std::string_view through the transparent Less, so a struct can be searched
+  //! without building a key.
+  class XmlRpcKey {
+  public:
+    XmlRpcKey(std::string_view name);
+    XmlRpcKey(std::string const& name) : XmlRpcKey(std::string_view(name)) {}
+    XmlRpcKey(const char* name) : XmlRpcKey(std::string_view(name)) {}
+    XmlRpcKey(XmlRpcName const& name) :
+      _data(name.data()), _size(uint32_t(name.size())), _owned(false) {}
+
+    XmlRpcKey(XmlRpcKey const& rhs);
+    XmlRpcKey(XmlRpcKey&& rhs) noexcept :
+      _data(rhs._data), _size(rhs._size), _owned(rhs._owned) { rhs._owned = false; }
+    ~XmlRpcKey() { if (_owned) delete [] _data; }
+
+    XmlRpcKey& operator=(XmlRpcKey const& rhs);
+    XmlRpcKey& operator=(XmlRpcKey&& rhs) noexcept;
+
+    const char* data() const { return _data; }
+    size_t size() const { return _size; }
+    std::string_view view() const { return std::string_view(_data, _size); }
+    std::string str() const { return std::string(_data, _size); }
+    operator std::string_view() const { return view(); }
+
+    //! Interned keys share their text, so equal keys usually compare by address.
+    bool operator==(XmlRpcKey const& rhs) const
+    {
+      return _size == rhs._size && (_data == rhs._data || view() == rhs.view());
+    }
+    bool operator!=(XmlRpcKey const& rhs) const { return ! (*this == rhs); }
+
+    //! Orders keys, names and strings by their text.
+    struct Less {
+      typedef void is_transparent;
+      bool operator()(std::string_view a, std::string_view b) const { return a < b; }
+    };
+
+    //! Number of names interned so far.
+    static size_t internedCount();
+
+  private:
+    const char* _data;
+    uint32_t _size;
+    bool _owned;
+  };
+
+} // namespace XmlRpc
+
+#endif // _XMLRPCKEY_H_
@@ -0,0 +1,141 @@
+
+#ifndef _XMLRPCREQUESTPARSER_H_
+#define _XMLRPCREQUESTPARSER_H_
+//
+// XmlRpc++ Copyright (c) 2002-2003 by Chris Morley
+//
+#if defined(_MSC_VER)
+# pragma warning(disable:4786)    // identifier was truncated in debug info
+#endif
+
+#ifndef MAKEDEPEND
+# include <deque>
+# include <functional>
+# include <stdint.h>
+# include <string>
+# include <string_view>
+# include <vector>
+#endif
+
+#include "XmlRpcValue.h"
+
+namespace XmlRpc {
+
+  class XmlRpcTokenizer;
+  class XmlRpcSchema;
+
+  //! A resumable parser for methodCall requests. The request body can be passed in
+  //! repeatedly while it is being received: each call to parse() carries on from
+  //! where the previous call stopped and decodes as much as has arrived, keeping
+  //! the partly built params and a stack of the open arrays and structs between
+  //! calls. The params are then complete soon after the last byte arrives.
+  //!
+  //! If the method has a schema, the params are checked against it as they are
+  //! decoded, and parsing stops at the first value that doesn't match.
+  class XmlRpcRequestParser {
+  public:
+    enum Status {
+      NeedMore,     //!< the request is incomplete so far
+      Done,         //!< the method name and params have been parsed
+      Failed,       //!< the request can not be parsed incrementally
+      Invalid       //!< the params don't match the method's schema; see fault()
+    };
+
+    //! Returns the schema for a method name, or null if it has none.
+    typedef std::function<XmlRpcSchema const*(std::string const&)> SchemaLookup;
+
+    //! Constructor
+    XmlRpcRequestParser();
+
+    //! Specify how to find the schema for a method. Without one, params are not checked.
+    void setSchemaLookup(SchemaLookup lookup) { _lookup = lookup; }
+
+    //! Discard any state and prepare to parse a new request.
+    void reset();
+
+    //! Parse more of the request held in xml. Between calls for the same request
+    //! xml may only have been appended to. Returns Failed if the request is not in
+    //! the form the parser expects; the caller should then parse it as a whole.
+    Status parse(std::string_view xml);
+
+    //! Status after the last call to parse().
+    Status status() const { return _status; }
+
+    //! The method name, once parsed.
+    std::string const& methodName() const { return _methodName; }
+
+    //! The params, complete once parse() has returned Done.
+    XmlRpcValue const& params() const { return _params; }
+
+    //! Whether the params were checked against a schema.
+    bool validated() const { return _schema != 0; }
+
+    //! Why the params are Invalid, naming the byte offset and the value in error.
+    std::string const& fault() const { return _fault; }
+
+  protected:
+    // What the parser expects next
+    enum State {
+      MethodName, AfterMethodName, NextParam, EndParam,
+      ValueStart, ArrayData, ArrayItems, StructMembers, MemberName, EndMember,
+      CloseValue, Finished
+    };
+
+    // Result of one parsing step
+    enum Step { Advanced, Wait, Fail, Reject };
+
+    Step step(XmlRpcTokenizer& tok);
+    Step valueStart(XmlRpcTokenizer& tok);
+    Step valueDone();
+    bool scalarComplete(XmlRpcTokenizer const& tok);
+
+    // Schema checks
+    Step finish(const char* at);
+    bool accepts(XmlRpcValue::Type type) const;
+    Step reject(const char* at, size_t depth, XmlRpcValue const* value, std::string const& what);
+    std::string path(size_t depth, XmlRpcValue const* value) const;
+
+    // An array or struct whose elements are being parsed
+    struct Frame {
+      XmlRpcValue* value;
+      int tag;
+      int node;         // schema node, or -1
+      int required;     // required members seen, of the first 64
+      uint64_t seen;    // which of the first 64 members have been seen
+    };
+
+    Status _status;
+    State _state;
+
+    // Buffer being parsed, valid during parse()
+    std::string_view _xml;
+
+    // Offset at which the next step starts
+    int _offset;
+
+    // Offset from which to keep looking for the end of a scalar value that has
+    // not fully arrived, so large values are not rescanned from the start
+    size_t _scanFrom;
+
+    std::string _methodName;
+    XmlRpcValue _params;
+    int _nParams;
+
+    // The value being parsed, and the open arrays and structs that contain it
+    XmlRpcValue* _target;
+    std::vector<Frame> _frames;
+
+    // Values of struct members whose name was already given. As elsewhere the
+    // first value is kept; the later ones are parsed into here and dropped
+    std::deque<XmlRpcValue> _repeated;
+
+    // Schema of the method, and the node the value being parsed should match
+    SchemaLookup _lookup;
+    XmlRpcSchema const* _schema;
+    int _expect;
+    std::string _fault;
+  };
+
+} // namespace XmlRpc
+
+#endif // _XMLRPCREQUESTPARSER_H_
@@ -0,0 +1,68 @@
+
+#ifndef _XMLRPCRESOLVER_H_
+#define _XMLRPCRESOLVER_H_
+//
+// XmlRpc++ Copyright (c) 2002-2003 by Chris Morley
+//
+#if defined(_MSC_VER)
+# pragma warning(disable:4786)    // identifier was truncated in debug info
+#endif
+
+#ifndef MAKEDEPEND
+# include <chrono>
+# include <memory>
+# include <string>
+#endif
+
+#include "XmlRpcSocket.h"
+
+namespace XmlRpc {
+
+  //! Looks up host addresses on a thread of its own and caches them, so that
+  //! connecting to a server doesn't wait for DNS each time. An address is
+  //! kept for a fixed time to live; once that has passed, the old address is
+  //! still used while a new lookup runs in the background. Only the first
+  //! lookup of a host is waited for. Numeric addresses are never looked up.
+  class XmlRpcResolver {
+  public:
+    typedef std::chrono::steady_clock Clock;
+
+    //! Default time, in seconds, that an address is used before it is looked
+    //! up again.
+    static const int DEFAULT_TTL = 60;
+
+    //! Start the lookup thread.
+    XmlRpcResolver();
+
+    //! Stop the lookup thread. A lookup in progress is abandoned rather than
+    //! waited for.
+    ~XmlRpcResolver();
+
+    //! The resolver shared by the clients. Started on first use.
+    static XmlRpcResolver& shared();
+
+    //! Set the time, in seconds, that an address is used before it is looked
+    //! up again.
+    void setTtl(double seconds);
+
+    //! Return the time to live of addresses, in seconds.
+    double ttl() const;
+
+    //! Return the address of host:port, and the time until which it may be
+    //! used without asking again. Returns false if the host has never been
+    //! resolved and the lookup fails.
+    bool resolve(std::string const& host, int port, XmlRpcSocket::Address* address,
+                 Clock::time_point* expires);
+
+  protected:
+    struct State;
+
+    static void work(std::shared_ptr<State> state);
+
+    // Shared with the lookup thread, which may outlive the resolver
+    std::shared_ptr<State> _state;
+  };
+
+} // namespace XmlRpc
+
+#endif // _XMLRPCRESOLVER_H_
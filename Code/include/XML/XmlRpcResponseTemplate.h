@@ -0,0 +1,95 @@
+
+#ifndef _XMLRPCRESPONSETEMPLATE_H_
+#define _XMLRPCRESPONSETEMPLATE_H_
+//
+// XmlRpc++ Copyright (c) 2002-2003 by Chris Morley
+//
+#if defined(_MSC_VER)
+# pragma warning(disable:4786)    // identifier was truncated in debug info
+#endif
+
+#ifndef MAKEDEPEND
+# include <initializer_list>
+# include <string>
+# include <vector>
+#endif
+
+#include "XmlRpcValue.h"
+
+namespace XmlRpc {
+
+  //! A response of fixed shape, rendered to xml once with slots left for the
+  //! values that vary. Writing a response then copies the constant xml and
+  //! encodes only the slot values, rather than building and serializing an
+  //! XmlRpcValue each time. The output is the same as for the equivalent value.
+  //!
+  //! The shape is an ordinary value in which slot(n) marks the place of the
+  //! n-th value passed to render():
+  //!
+  //!   XmlRpcValue shape;
+  //!   shape["status"]["code"] = XmlRpcResponseTemplate::slot(0);
+  //!   shape["status"]["msg"] = XmlRpcResponseTemplate::slot(1);
+  //!   static const XmlRpcResponseTemplate ok(shape, XmlRpcResponseTemplate::Result);
+  //!   ok.render(body, { 0, "OK" });
+  class XmlRpcResponseTemplate {
+  public:
+    //! What render() writes
+    enum Kind {
+      Value,      //!< just the <value> xml
+      Result,     //!< a complete methodResponse body returning the value
+      Fault       //!< a complete methodResponse body returning the value as a fault
+    };
+
+    //! A slot value
+    class Arg {
+    public:
+      Arg(int i) : _type(XmlRpcValue::TypeInt) { _u.asInt = i; }
+      Arg(bool b) : _type(XmlRpcValue::TypeBoolean) { _u.asBool = b; }
+      Arg(double d) : _type(XmlRpcValue::TypeDouble) { _u.asDouble = d; }
+      Arg(std::string const& s) : _type(XmlRpcValue::TypeString) { _u.asString.data = s.data(); _u.asString.size = s.size(); }
+      Arg(const char* s);
+      Arg(XmlRpcValue const& v) : _type(XmlRpcValue::TypeInvalid) { _u.asValue = &v; }
+
+      //! Append the <value> xml
+      void appendXml(std::string& xml) const;
+
+    private:
+      XmlRpcValue::Type _type;    // TypeInvalid for an XmlRpcValue
+      union {
+        int asInt;
+        bool asBool;
+        double asDouble;
+        struct { const char* data; size_t size; } asString;
+        XmlRpcValue const* asValue;
+      } _u;
+    };
+
+    //! A value marking slot n in a shape.
+    static XmlRpcValue slot(int n);
+
+    //! Render the shape, finding its slots.
+    XmlRpcResponseTemplate(XmlRpcValue const& shape, Kind kind = Value);
+
+    //! Append the xml with each slot n replaced by args[n]. Slots without an
+    //! arg are written as empty strings.
+    void render(std::string& xml, std::initializer_list<Arg> args) const;
+
+    //! Number of slots in the shape.
+    int slots() const { return _slots; }
+
+  protected:
+    // Constant xml up to a slot (or the end, for the last part)
+    struct Part {
+      size_t offset;
+      size_t length;
+      int slot;         // -1 for the last part
+    };
+
+    std::string _xml;
+    std::vector<Part> _parts;
+    int _slots;
+  };
+
+} // namespace XmlRpc
+
+#endif // _XMLRPCRESPONSETEMPLATE_H_
@@ -0,0 +1,34 @@
+
+#ifndef _XMLRPCSCAN_H_
+#define _XMLRPCSCAN_H_
+//
+// XmlRpc++ Copyright (c) 2002-2003 by Chris Morley
+//
+#if defined(_MSC_VER)
+# pragma warning(disable:4786)    // identifier was truncated in debug info
+#endif
+
+namespace XmlRpc {
+
+  //! Byte scanning kernels used by the parser and the entity encoder.
+  //! On x86 an AVX2 or SSE2 implementation is selected at runtime according to
+  //! what the CPU supports; other platforms use a portable scalar version.
+  class XmlRpcScan {
+  public:
+    //! Returns a pointer to the first occurrence of c in [begin, end), or end.
+    static const char* findChar(const char* begin, const char* end, char c);
+
+    //! Returns a pointer to the first char in [begin, end) that must be replaced by
+    //! an xml entity (one of < > & ' "), or end.
+    static const char* findEntity(const char* begin, const char* end);
+
+    //! Returns true if the AVX2 kernels are in use.
+    static bool hasAvx2();
+
+    //! Name of the selected implementation ("avx2", "sse2" or "scalar").
+    static const char* implementation();
+  };
+
+} // namespace XmlRpc
+
+#endif // _XMLRPCSCAN_H_
@@ -0,0 +1,103 @@
+
+#ifndef _XMLRPCSCHEMA_H_
+#define _XMLRPCSCHEMA_H_
+//
+// XmlRpc++ Copyright (c) 2002-2003 by Chris Morley
+//
+#if defined(_MSC_VER)
+# pragma warning(disable:4786)    // identifier was truncated in debug info
+#endif
+
+#ifndef MAKEDEPEND
+# include <string>
+# include <string_view>
+# include <vector>
+#endif
+
+#include "XmlRpcValue.h"
+
+namespace XmlRpc {
+
+  //! The parameter types a method accepts, compiled from a short description:
+  //!
+  //!   "struct{username:string,password:string}"
+  //!   "string, int, array<double>"
+  //!
+  //! Each comma-separated type at the top level is one parameter. The types are
+  //! string, int (or i4), boolean, double, dateTime.iso8601, base64 and any;
+  //! array and array<T>, whose elements are all T; and struct and
+  //! struct{name:T,...}. Listed struct members are required unless written as
+  //! name?:T, and members that are not listed are allowed.
+  //!
+  //! The request parser checks a request against the schema of its method as it
+  //! decodes it, so invalid params are rejected at the first value in error.
+  class XmlRpcSchema {
+  public:
+    //! Fault code for params that don't match the schema (the code reserved for
+    //! "invalid method parameters" by the xml-rpc fault code conventions).
+    static const int INVALID_PARAMS = -32602;
+
+    //! A member of a struct type
+    struct Member {
+      std::string name;
+      int node;
+      bool optional;
+    };
+
+    //! A compiled type. Type TypeInvalid stands for any type.
+    struct Node {
+      XmlRpcValue::Type type;
+      int element;                  // for arrays, element node or -1
+      std::vector<Member> members;  // for structs
+      int required;                 // number of required members
+    };
+
+    //! Constructor
+    XmlRpcSchema() {}
+
+    //! Compile a description. Returns false, leaving the schema empty, if the
+    //! description is malformed; error() then describes the problem.
+    bool compile(std::string const& description);
+
+    //! Return the reason the last compile() failed.
+    std::string const& error() const { return _error; }
+
+    //! The number of params.
+    int params() const { return int(_params.size()); }
+
+    //! The node of param i, or -1 if there is no such param.
+    int param(int i) const { return (i < int(_params.size())) ? _params[i] : -1; }
+
+    //! The node with the given index.
+    Node const& node(int i) const { return _nodes[i]; }
+
+    //! The member of a struct node with the given name, or null.
+    Member const* member(int node, std::string_view name) const;
+
+    //! Return true if a value of type t is acceptable for node.
+    bool accepts(int node, XmlRpcValue::Type t) const
+    { return node < 0 || _nodes[node].type == XmlRpcValue::TypeInvalid || _nodes[node].type == t; }
+
+    //! Check complete params against the schema. On failure, message describes
+    //! the first value in error.
+    bool validate(XmlRpcValue const& params, std::string& message) const;
+
+    //! The parameter type names, as used by system.methodSignature.
+    std::vector<std::string> const& signature() const { return _signature; }
+
+    //! Return the xml-rpc name of a type.
+    static const char* typeName(XmlRpcValue::Type t);
+
+  protected:
+    int parseType(const char*& cp, const char* end);
+    bool validateValue(int node, XmlRpcValue const& value, std::string const& where, std::string& message) const;
+
+    std::vector<Node> _nodes;
+    std::vector<int> _params;
+    std::vector<std::string> _signature;
+    std::string _error;
+  };
+
+} // namespace XmlRpc
+
+#endif // _XMLRPCSCHEMA_H_
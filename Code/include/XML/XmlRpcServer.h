@@ -14,6 +14,7 @@
 #endif
 
 #include "XmlRpcDispatch.h"
+#include "XmlRpcSocket.h"
 #include "XmlRpcSource.h"
 
 namespace XmlRpc {
@@ -40,6 +41,42 @@ namespace XmlRpc {
     //! Specify whether introspection is enabled or not. Default is not enabled.
     void enableIntrospection(bool enabled=true);
 
+    //! Specify whether request params are decoded lazily. When enabled, arrays and
+    //! structs in the params are decoded the first time a method accesses them,
+    //! so a method that only looks at a few fields does not pay to decode the
+    //! rest of the request. The body is then only parsed once it has all
+    //! arrived, not while it is read, and params checked against a method's
+    //! schema are decoded in full by the check; so this only pays for methods
+    //! without a schema that look at little of large params. Default is not
+    //! enabled. See XmlRpcValue::fromXmlLazy.
+    void enableLazyParams(bool enabled=true) { _lazyParams = enabled; }
+
+    //! Return true if request params are decoded lazily.
+    bool lazyParams() const { return _lazyParams; }
+
+    //! Specify the size from which arrays in a result are encoded in parallel.
+    //! The elements of such an array are encoded concurrently on the shared
+    //! thread pool, and the pieces are written to the client without being
+    //! joined. The response is the same either way. 0 disables parallel
+    //! encoding. Default is 16384 elements.
+    void setParallelEncoding(int minElements) { _parallelElements = minElements; }
+
+    //! Return the size from which result arrays are encoded in parallel, or 0.
+    int parallelEncoding() const { return _parallelElements; }
+
+    //! Specify the TCP options for the listening socket and the connections it
+    //! accepts, such as XmlRpcSocket::Options::lowLatency(). Set them before
+    //! bindAndListen. Default is the system defaults. For shared memory
+    //! connections only busyPoll applies, as the time to spin waiting for the
+    //! next request before sleeping.
+    void setSocketOptions(XmlRpcSocket::Options const& options) { _socketOptions = options; }
+
+    //! Return the TCP options for the server's sockets.
+    XmlRpcSocket::Options const& socketOptions() const { return _socketOptions; }
+
+    //! Whether the server listens on a TCP port, rather than a unix domain socket.
+    bool listensOnTcp() const { return _unixPath.empty(); }
+
     //! Add a command to the RPC server
     void addMethod(XmlRpcServerMethod* method);
 
@@ -56,6 +93,14 @@ namespace XmlRpc {
     //! set it in listen mode to make it available for clients.
     bool bindAndListen(int port, int backlog = 5);
 
+    //! Listen on an endpoint: "unix:/path" for a unix domain socket, which
+    //! clients on the same host can reach without going through TCP;
+    //! "shm:/path" for a unix domain socket over which clients on the same host
+    //! set up shared memory connections (see XmlRpcShmChannel); or otherwise a
+    //! port number as for bindAndListen(int). The socket file of a unix domain
+    //! endpoint is removed on shutdown.
+    bool bindAndListen(std::string const& endpoint, int backlog = 5);
+
     //! Process client requests for the specified time
     void work(double msTime);
 
@@ -87,6 +132,21 @@ namespace XmlRpc {
     // Whether the introspection API is supported by this server
     bool _introspectionEnabled;
 
+    // Whether request params are decoded on demand
+    bool _lazyParams;
+
+    // Size from which result arrays are encoded in parallel (0 if never)
+    int _parallelElements;
+
+    // TCP options for the listening socket and client connections
+    XmlRpcSocket::Options _socketOptions;
+
+    // Socket path when listening on a unix domain socket
+    std::string _unixPath;
+
+    // Whether clients connect to the unix domain socket to set up shared memory
+    bool _sharedMemory;
+
     // Event dispatcher
     XmlRpcDispatch _disp;
 
@@ -97,6 +157,7 @@ namespace XmlRpc {
     // system methods
     XmlRpcServerMethod* _listMethods;
     XmlRpcServerMethod* _methodHelp;
+    XmlRpcServerMethod* _methodSignature;
 
   };
 } // namespace XmlRpc
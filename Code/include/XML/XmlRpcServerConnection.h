@@ -9,9 +9,12 @@
 
 #ifndef MAKEDEPEND
 # include <string>
+# include <vector>
 #endif
 
+#include "XmlRpcBuffer.h"
 #include "XmlRpcValue.h"
+#include "XmlRpcRequestParser.h"
 #include "XmlRpcSource.h"
 
 namespace XmlRpc {
@@ -21,6 +24,9 @@ namespace XmlRpc {
   class XmlRpcServer;
   class XmlRpcServerMethod;
 
+  // A fault returned to the client
+  class XmlRpcException;
+
   //! A class to handle XML RPC requests from a particular client
   class XmlRpcServerConnection : public XmlRpcSource {
   public:
@@ -31,6 +37,12 @@ namespace XmlRpc {
     static const char PARAM_TAG[];
     static const char PARAM_ETAG[];
 
+    // Text around the value in a response body
+    static const char RESPONSE_PREFIX[];
+    static const char RESPONSE_SUFFIX[];
+    static const char FAULT_PREFIX[];
+    static const char FAULT_SUFFIX[];
+
     static const std::string SYSTEM_MULTICALL;
     static const std::string METHODNAME;
     static const std::string PARAMS;
@@ -53,6 +65,13 @@ namespace XmlRpc {
     bool readHeader();
     bool readRequest();
     bool writeResponse();
+    void keepPipelined();
+
+    // Read available data, and write the pending response (_response or
+    // _responseBuffers). A connection over something other than a socket
+    // overrides these.
+    virtual bool readData(XmlRpcBuffer& s, bool* eof, size_t expected = 0);
+    virtual bool writeData(int* bytesSoFar);
 
     // Parses the request, runs the method, generates the response xml.
     virtual void executeRequest();
@@ -60,16 +79,29 @@ namespace XmlRpc {
     // Parse the methodName and parameters from the request.
     std::string parseRequest(XmlRpcValue& params);
 
-    // Execute a named method with the specified params.
-    bool executeMethod(const std::string& methodName, XmlRpcValue& params, XmlRpcValue& result);
+    // Execute a named method with the specified params. Returns false with the
+    // fault set if the method is unknown or fails.
+    bool executeMethod(const std::string& methodName, XmlRpcValue& params, XmlRpcValue& result,
+                       XmlRpcException& fault);
+    bool executeMethod(XmlRpcServerMethod* method, XmlRpcValue& params, XmlRpcValue& result,
+                       XmlRpcException& fault);
+
+    // Check params against the method's schema, if it has one.
+    bool checkParams(XmlRpcServerMethod* method, XmlRpcValue const& params, XmlRpcException& fault);
 
     // Execute multiple calls and return the results in an array.
-    bool executeMulticall(const std::string& methodName, XmlRpcValue& params, XmlRpcValue& result);
+    bool executeMulticall(XmlRpcValue& params, XmlRpcValue& result, XmlRpcException& fault);
+
+    // Run a JSON-RPC request or batch, generating the response.
+    void executeJsonRequest();
+    void executeJsonCall(XmlRpcValue const& request, std::string& body);
 
-    // Construct a response from the result XML.
-    void generateResponse(std::string const& resultXml);
+    // Construct a response from the result value.
+    void generateResponse(XmlRpcValue const& result);
     void generateFaultResponse(std::string const& msg, int errorCode = -1);
-    std::string generateHeader(std::string const& body);
+    std::string generateHeader(size_t bodyLength);
+    void setResponse(std::string const& body);
+    void setResponse(std::vector<std::string>& body);
 
 
     // The XmlRpc server that accepted this connection
@@ -79,23 +111,38 @@ namespace XmlRpc {
     enum ServerConnectionState { READ_HEADER, READ_REQUEST, WRITE_RESPONSE };
     ServerConnectionState _connectionState;
 
-    // Request headers
-    std::string _header;
+    // Request headers, and anything read after the request body: the start of
+    // the next request if the client pipelines them
+    XmlRpcBuffer _header;
 
     // Number of bytes expected in the request body (parsed from header)
     int _contentLength;
 
     // Request body
-    std::string _request;
+    XmlRpcBuffer _request;
+
+    // Encoding of the request, and so of the response
+    enum Encoding { XML_ENCODING, BINARY_ENCODING, JSON_ENCODING };
+    Encoding _encoding;
+
+    // Parses the request body as it arrives
+    XmlRpcRequestParser _parser;
 
     // Response
     std::string _response;
 
+    // A response too large to assemble in _response is kept as a list of
+    // buffers: the header, then the pieces of the body
+    std::vector<std::string> _responseBuffers;
+
     // Number of bytes of the response written so far
     int _bytesWritten;
 
     // Whether to keep the current client connection open for further requests
     bool _keepAlive;
+
+    // Whether the client has been seen to pipeline requests
+    bool _pipelined;
   };
 } // namespace XmlRpc
 
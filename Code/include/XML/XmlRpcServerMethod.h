@@ -9,6 +9,7 @@
 #endif
 
 #ifndef MAKEDEPEND
+# include <memory>
 # include <string>
 #endif
 
@@ -17,6 +18,12 @@ namespace XmlRpc {
   // Representation of a parameter or result value
   class XmlRpcValue;
 
+  // A fault returned to the client
+  class XmlRpcException;
+
+  // Parameter types accepted by a method
+  class XmlRpcSchema;
+
   // The XmlRpcServer processes client requests to call RPCs
   class XmlRpcServer;
 
@@ -31,16 +38,46 @@ namespace XmlRpc {
     //! Returns the name of the method
     std::string& name() { return _name; }
 
-    //! Execute the method. Subclasses must provide a definition for this method.
-    virtual void execute(XmlRpcValue& params, XmlRpcValue& result) = 0;
+    //! Execute the method, throwing an XmlRpcException to return a fault.
+    //! Subclasses must define this method or tryExecute(). The default throws
+    //! a "method not implemented" fault.
+    virtual void execute(XmlRpcValue& params, XmlRpcValue& result);
+
+    //! Execute the method, returning false with fault set to return a fault.
+    //! This is what the server calls. The default calls execute() and catches
+    //! what it throws; methods that often fail on bad input should define this
+    //! instead, as no exception is raised on their failure path.
+    virtual bool tryExecute(XmlRpcValue& params, XmlRpcValue& result, XmlRpcException& fault);
+
+    //! Execute the method, writing the whole methodResponse body (a result or a
+    //! fault) to body, typically with an XmlRpcResponseTemplate. Returns false if
+    //! the method leaves this to the server, as the default does. The server
+    //! tries this first for a direct call; calls within system.multicall still
+    //! go through tryExecute().
+    virtual bool executeXml(XmlRpcValue& params, std::string& body);
 
     //! Returns a help string for the method.
     //! Subclasses should define this method if introspection is being used.
     virtual std::string help() { return std::string(); }
 
+    //! Declare the types of the params, e.g. "struct{username:string,password:string}"
+    //! (see XmlRpcSchema), and optionally of the result. Requests whose params
+    //! don't match are rejected with a fault before the method is called. The
+    //! types are also reported by system.methodSignature. Returns false if the
+    //! description is malformed, leaving the params unchecked.
+    bool setSignature(std::string const& params, std::string const& result = std::string());
+
+    //! Returns the schema of the params, or null if none was declared.
+    XmlRpcSchema const* schema() const { return _schema.get(); }
+
+    //! Returns the type name of the result declared by setSignature().
+    std::string const& resultType() const { return _resultType; }
+
   protected:
     std::string _name;
     XmlRpcServer* _server;
+    std::unique_ptr<XmlRpcSchema> _schema;
+    std::string _resultType;
   };
 } // namespace XmlRpc
 
@@ -0,0 +1,117 @@
+
+#ifndef _XMLRPCSHMCHANNEL_H_
+#define _XMLRPCSHMCHANNEL_H_
+//
+// XmlRpc++ Copyright (c) 2002-2003 by Chris Morley
+//
+#if defined(_MSC_VER)
+# pragma warning(disable:4786)    // identifier was truncated in debug info
+#endif
+
+#ifndef MAKEDEPEND
+# include <stddef.h>
+# include <string>
+# include <vector>
+#endif
+
+namespace XmlRpc {
+
+  class XmlRpcBuffer;
+
+  //! A connection between a client and server on the same host through shared
+  //! memory, for calls at rates where the socket system calls and copies
+  //! dominate. The endpoint is written "shm:/path/to/socket".
+  //!
+  //! The client connects to the server's unix domain socket at the path and
+  //! passes it a memory segment holding two single-producer, single-consumer
+  //! rings, one for each direction, and an eventfd for each side. The same
+  //! HTTP framed requests and responses as over a socket are then copied
+  //! through the rings. A side only signals the other's eventfd when the other
+  //! is waiting, so a busy connection makes no system calls. The socket stays
+  //! open, so that either side sees the other go away.
+  //!
+  //! Only available on Linux; elsewhere connect and accept fail.
+  class XmlRpcShmChannel {
+  public:
+    //! Bytes in each ring. Larger messages are streamed through.
+    static const size_t RING_SIZE = 1 << 20;
+
+    //! Return true if endpoint is a shared memory endpoint, setting path to
+    //! the path of the server's socket.
+    static bool isEndpoint(std::string const& endpoint, std::string* path);
+
+    //! Set up a channel over a unix domain socket connected to the server, and
+    //! send it to the server. On success the channel owns the socket.
+    static XmlRpcShmChannel* connect(int socket);
+
+    //! Receive a channel sent by a client over a socket accepted by the server.
+    //! Returns null with wouldBlock set if it hasn't arrived yet. On success the
+    //! channel owns the socket.
+    static XmlRpcShmChannel* accept(int socket, bool* wouldBlock);
+
+    //! Destructor. Tells the other side the channel is closed.
+    ~XmlRpcShmChannel();
+
+    //! The descriptor to monitor for readable events. It becomes readable when
+    //! the other side signals or goes away.
+    int fd() const { return _epollFd; }
+
+    //! Reset the signal after fd() has become readable.
+    void clearWakeup();
+
+    //! Make fd() readable, as if the other side had signalled, so that work
+    //! can be picked up by the dispatcher.
+    void wake();
+
+    //! Read available text, appending it to s, as XmlRpcSocket::nbRead. eof is
+    //! set once the other side has closed and everything it sent has been read.
+    //! Returns false on error.
+    bool read(XmlRpcBuffer& s, bool* eof, size_t expected = 0);
+
+    //! Write text as XmlRpcSocket::nbWrite, as much as fits in the ring.
+    bool write(std::string const& s, int* bytesSoFar);
+
+    //! Write a list of buffers as XmlRpcSocket::nbWriteV.
+    bool writeV(std::vector<std::string> const& buffers, int* bytesSoFar);
+
+    //! Wait for something to do: if reading, data to read and, if writing,
+    //! room to write. Spins for up to spinMicroseconds (if there is more than
+    //! one cpu), then returns false after arranging to be signalled through
+    //! fd(). Returns true if there is something to do now.
+    bool wait(bool reading, bool writing, int spinMicroseconds);
+
+  protected:
+    struct Segment;
+
+    XmlRpcShmChannel(Segment* segment, size_t mappedSize, size_t ringSize, int side,
+                     int socket, int wakeFd, int peerWakeFd, int epollFd);
+
+    // Watch the descriptors and construct the channel; returns null on failure,
+    // leaving the caller to release what it passed.
+    static XmlRpcShmChannel* create(Segment* segment, size_t mappedSize, size_t ringSize, int side,
+                                    int socket, int wakeFd, int peerWakeFd);
+
+    bool ready(bool reading, bool writing) const;
+    int append(const char* data, size_t length);
+    void signalPeer();
+
+    Segment* _segment;
+    size_t _mappedSize;
+    size_t _ringSize;           // Power of 2
+    int _side;                  // 0 for the client, 1 for the server
+    char* _in;                  // Ring the other side writes
+    char* _out;                 // Ring this side writes
+    // Positions are kept here as well as in the segment, so that the other
+    // side can't make this one read or write outside its rings.
+    unsigned long long _readPosition;
+    unsigned long long _writePosition;
+    int _socket;
+    int _wakeFd;                // Signalled by the other side
+    int _peerWakeFd;            // Signals the other side
+    int _epollFd;               // Watches _wakeFd and _socket
+    bool _peerGone;
+  };
+
+} // namespace XmlRpc
+
+#endif // _XMLRPCSHMCHANNEL_H_
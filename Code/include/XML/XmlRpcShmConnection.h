@@ -0,0 +1,44 @@
+
+#ifndef _XMLRPCSHMCONNECTION_H_
+#define _XMLRPCSHMCONNECTION_H_
+//
+// XmlRpc++ Copyright (c) 2002-2003 by Chris Morley
+//
+#if defined(_MSC_VER)
+# pragma warning(disable:4786)    // identifier was truncated in debug info
+#endif
+
+#include "XmlRpcServerConnection.h"
+
+namespace XmlRpc {
+
+  class XmlRpcShmChannel;
+
+  //! A connection from a client on the same host over shared memory (see
+  //! XmlRpcShmChannel), accepted by a server listening on a "shm:" endpoint.
+  //! Requests are handled as on a socket connection.
+  class XmlRpcShmConnection : public XmlRpcServerConnection {
+  public:
+    //! Constructor. fd is the accepted unix domain socket, over which the
+    //! client sends the channel.
+    XmlRpcShmConnection(int fd, XmlRpcServer* server, bool deleteOnClose = false);
+    //! Destructor
+    virtual ~XmlRpcShmConnection();
+
+    //! Receive the channel, then handle requests for as long as the client
+    //! keeps sending them, waiting for it through the channel.
+    virtual unsigned handleEvent(unsigned eventType);
+
+    //! Close the channel and the socket
+    virtual void close();
+
+  protected:
+    virtual bool readData(XmlRpcBuffer& s, bool* eof, size_t expected = 0);
+    virtual bool writeData(int* bytesSoFar);
+
+    // Null until the client has sent it
+    XmlRpcShmChannel* _channel;
+  };
+} // namespace XmlRpc
+
+#endif // _XMLRPCSHMCONNECTION_H_
@@ -9,14 +9,56 @@
 
 #ifndef MAKEDEPEND
 # include <string>
+# include <vector>
 #endif
 
 namespace XmlRpc {
 
+  class XmlRpcBuffer;
+
   //! A platform-independent socket API.
   class XmlRpcSocket {
   public:
 
+    //! TCP options for the sockets of a server or client. The default options
+    //! leave every socket option at the system default. Options the system
+    //! doesn't support are ignored.
+    struct Options {
+      bool noDelay;         //!< TCP_NODELAY: send small writes at once, without waiting to coalesce them
+      bool quickAck;        //!< TCP_QUICKACK: acknowledge data at once rather than delaying the ack. The system clears it again on its own, so it only affects the first acks
+      int deferAccept;      //!< TCP_DEFER_ACCEPT: seconds a server waits for data before accepting, 0 for off
+      int fastOpen;         //!< TCP_FASTOPEN: pending fast opens a server queues, 0 for off; clients use TCP_FASTOPEN_CONNECT if non-zero
+      int receiveBuffer;    //!< SO_RCVBUF bytes, 0 for the default
+      int sendBuffer;       //!< SO_SNDBUF bytes, 0 for the default
+      int busyPoll;         //!< SO_BUSY_POLL: microseconds to poll the device on reads, 0 for off
+
+      Options() : noDelay(false), quickAck(false), deferAccept(0), fastOpen(0),
+                  receiveBuffer(0), sendBuffer(0), busyPoll(0) {}
+
+      //! Options for small, frequent request/response pairs: no coalescing, fast
+      //! open, and a short busy poll. quickAck is left off: the system turns it
+      //! off again after a few segments, so keeping acks quick would take a
+      //! setsockopt() after every read.
+      static Options lowLatency();
+
+      //! Options for large transfers: large buffers, writes left to coalesce.
+      static Options bulk();
+    };
+
+    //! Apply the per-connection options to a socket, such as one a server has
+    //! accepted. Returns false if an option could not be set; the others are
+    //! still applied.
+    static bool setOptions(int socket, Options const& options);
+
+    //! Apply the per-connection options and fast open to a client socket. Should
+    //! be done before connect(). Returns false if an option could not be set.
+    static bool setConnectOptions(int socket, Options const& options);
+
+    //! Apply the options for a listening socket (defer accept and fast open),
+    //! and the per-connection options that accepted sockets inherit. Should be
+    //! done before listen(). Returns false if an option could not be set.
+    static bool setListenOptions(int socket, Options const& options);
+
     //! Creates a stream (TCP) socket. Returns -1 on failure.
     static int socket();
 
@@ -24,15 +66,62 @@ namespace XmlRpc {
     static void close(int socket);
 
 
+    // Unix domain sockets, for a client and server on the same host. The
+    // endpoint is written "unix:/path/to/socket", and the same HTTP framing is
+    // used as over TCP.
+
+    //! Return true if endpoint is a unix domain socket endpoint, setting path
+    //! to the socket path.
+    static bool isUnixEndpoint(std::string const& endpoint, std::string* path);
+
+    //! Creates a unix domain stream socket. Returns -1 on failure.
+    static int unixSocket();
+
+    //! Bind to a unix domain socket path. A socket file left at the path by a
+    //! server that is no longer running is replaced. Returns false on failure.
+    static bool bindUnix(int socket, std::string const& path);
+
+    //! Connect a unix domain socket to a server. Returns false on failure. A
+    //! non-blocking socket fails with EAGAIN while the server's backlog is
+    //! full, and is left unconnected: that sets wouldBlock, if given, and
+    //! returns true, and the connect must be made again later.
+    static bool connectUnix(int socket, std::string const& path, bool* wouldBlock = 0);
+
+    //! Remove the socket file of a unix domain server.
+    static void removeUnix(std::string const& path);
+
+
     //! Sets a stream (TCP) socket to perform non-blocking IO. Returns false on failure.
     static bool setNonBlocking(int socket);
 
-    //! Read text from the specified socket. Returns false on error.
-    static bool nbRead(int socket, std::string& s, bool *eof);
+    //! Read text from the specified socket straight into the free space of s.
+    //! expected is the number of bytes the caller is waiting for, if known (such
+    //! as the rest of a body of known Content-length), so reads are sized for
+    //! it; s still only grows as the data arrives. Returns false on error.
+    static bool nbRead(int socket, XmlRpcBuffer& s, bool *eof, size_t expected = 0);
 
-    //! Write text to the specified socket. Returns false on error.
+    //! Write text to the specified socket. Returns false on error, including
+    //! if the other end has closed the connection (without raising SIGPIPE,
+    //! where the system allows).
     static bool nbWrite(int socket, std::string& s, int *bytesSoFar);
 
+    //! Write a list of buffers to the specified socket as one stream of text,
+    //! without first joining them. bytesSoFar counts from the start of the first
+    //! buffer. Returns false on error.
+    static bool nbWriteV(int socket, std::vector<std::string> const& buffers, int *bytesSoFar);
+
+    //! Counts of the read and write calls made on sockets by nbRead, nbWrite
+    //! and nbWriteV, and of the bytes they moved, since the program started.
+    //! Only counted when the library is built with XMLRPC_IO_COUNTERS defined;
+    //! otherwise all zero.
+    struct IoCounters {
+      unsigned long long reads;
+      unsigned long long bytesRead;
+      unsigned long long writes;
+      unsigned long long bytesWritten;
+    };
+    static IoCounters ioCounters();
+
 
     // The next four methods are appropriate for servers.
 
@@ -54,6 +143,31 @@ namespace XmlRpc {
     static bool connect(int socket, std::string& host, int port);
 
 
+    //! A resolved (IPv4) socket address.
+    struct Address {
+      int length;                 //!< Size of the sockaddr in data, 0 if not resolved
+      unsigned char data[32];
+      Address() : length(0) {}
+    };
+
+    //! Convert a numeric address such as "127.0.0.1", without a lookup.
+    //! Returns false if host is not a numeric address.
+    static bool numericAddress(std::string const& host, int port, Address* address);
+
+    //! Look up the address of a host. This blocks for as long as the lookup
+    //! takes; XmlRpcResolver caches the results and refreshes them on a
+    //! thread of its own. Returns false on failure.
+    static bool resolve(std::string const& host, int port, Address* address);
+
+    //! Connect a socket to a resolved address
+    static bool connect(int socket, Address const& address);
+
+    //! Return true if an idle non-blocking connection should not be reused:
+    //! the other end has closed or reset it, or has sent something while no
+    //! request was outstanding. Nothing is consumed.
+    static bool isStale(int socket);
+
+
     //! Returns last errno
     static int getError();
 
@@ -0,0 +1,61 @@
+
+#ifndef _XMLRPCTHREADPOOL_H_
+#define _XMLRPCTHREADPOOL_H_
+//
+// XmlRpc++ Copyright (c) 2002-2003 by Chris Morley
+//
+#if defined(_MSC_VER)
+# pragma warning(disable:4786)    // identifier was truncated in debug info
+#endif
+
+#ifndef MAKEDEPEND
+# include <condition_variable>
+# include <deque>
+# include <functional>
+# include <memory>
+# include <mutex>
+# include <thread>
+# include <vector>
+#endif
+
+namespace XmlRpc {
+
+  //! A fixed set of worker threads for splitting one large job, such as
+  //! encoding a very large array, into parts that run concurrently.
+  class XmlRpcThreadPool {
+  public:
+    //! Start the worker threads.
+    explicit XmlRpcThreadPool(int threads);
+
+    //! Stop and join the worker threads.
+    ~XmlRpcThreadPool();
+
+    //! Number of worker threads.
+    int threads() const { return int(_threads.size()); }
+
+    //! Call task(i) for each i in [0, tasks), on the workers and the calling
+    //! thread, and return when all calls are done. An exception thrown by a
+    //! task is rethrown here once the others have finished. Tasks may call
+    //! run() themselves.
+    void run(int tasks, std::function<void(int)> const& task);
+
+    //! The pool shared by the library, with a worker per processor beyond the
+    //! calling thread. Started on first use.
+    static XmlRpcThreadPool& shared();
+
+  protected:
+    struct Batch;
+
+    void work();
+    static void runTasks(Batch& batch);
+
+    std::vector<std::thread> _threads;
+    std::mutex _mutex;
+    std::condition_variable _ready;
+    std::deque< std::shared_ptr<Batch> > _batches;
+    bool _stop;
+  };
+
+} // namespace XmlRpc
+
+#endif // _XMLRPCTHREADPOOL_H_
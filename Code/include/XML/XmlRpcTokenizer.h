@@ -0,0 +1,115 @@
+
+#ifndef _XMLRPCTOKENIZER_H_
+#define _XMLRPCTOKENIZER_H_
+//
+// XmlRpc++ Copyright (c) 2002-2003 by Chris Morley
+//
+#if defined(_MSC_VER)
+# pragma warning(disable:4786)    // identifier was truncated in debug info
+#endif
+
+#ifndef MAKEDEPEND
+# include <stddef.h>
+# include <string>
+# include <string_view>
+#endif
+
+namespace XmlRpc {
+
+  //! A pull tokenizer for xml-rpc messages. The buffer is walked once, front to
+  //! back, and each tag is classified into a Tag id by its length and first
+  //! bytes rather than by building and comparing strings.
+  class XmlRpcTokenizer {
+  public:
+
+    //! Tag ids. An end tag is reported as the start tag id with EndTag or'd in.
+    enum Tag {
+      NoTag = 0,          //!< the next non-whitespace char is not '<' (text follows)
+      EndOfInput,         //!< the buffer ended, possibly in the middle of a tag
+      UnknownTag,         //!< a tag that is not part of the xml-rpc vocabulary
+
+      ValueTag,
+      BooleanTag,
+      IntTag,
+      I4Tag,
+      DoubleTag,
+      StringTag,
+      DateTimeTag,
+      Base64Tag,
+      ArrayTag,
+      DataTag,
+      StructTag,
+      MemberTag,
+      NameTag,
+
+      MethodCallTag,
+      MethodNameTag,
+      MethodResponseTag,
+      ParamsTag,
+      ParamTag,
+      FaultTag,
+
+      EndTag = 0x40
+    };
+
+    //! Tokenize the chars in [begin, end).
+    XmlRpcTokenizer(const char* begin, const char* end) :
+      _base(begin), _cp(begin), _end(end) {}
+
+    //! Tokenize xml starting offset chars into the string.
+    XmlRpcTokenizer(std::string_view xml, int offset) :
+      _base(xml.data()), _cp(xml.data() + offset), _end(xml.data() + xml.size())
+    { if (_cp > _end) _cp = _end; }
+
+    //! Returns the id of the next tag (after any whitespace) and moves past it.
+    //! If the next non-whitespace char is not '<', NoTag is returned and the
+    //! position is left unchanged.
+    int nextTag();
+
+    //! Returns the id of the next tag without consuming it.
+    int peekTag() const;
+
+    //! Consumes the next tag if it has the specified id, else leaves the position unchanged.
+    bool nextTagIs(int tag);
+
+    //! Moves past the next occurrence of the specified tag, skipping anything in between.
+    //! Returns false (position unchanged) if there is no such tag.
+    bool skipTo(int tag);
+
+    //! Moves past the end tag that closes an element whose start tag has just been
+    //! consumed, skipping any nested elements with the same tag. Returns false
+    //! (position unchanged) if the element is not closed.
+    bool skipElement(int tag);
+
+    //! Returns the chars from the current position up to the next '<' and moves to that '<'.
+    //! Returns false (position unchanged) if no '<' follows.
+    bool text(const char** begin, const char** end);
+
+    //! Returns true if there is nothing but whitespace left.
+    bool atEnd() const;
+
+    //! Current position in the buffer.
+    const char* position() const { return _cp; }
+    void setPosition(const char* cp) { _cp = cp; }
+
+    //! Current position as an offset from the start of the buffer.
+    int offset() const { return int(_cp - _base); }
+
+    //! Classify the tag name in [name, name+len). Returns UnknownTag if not recognized.
+    static int classify(const char* name, size_t len);
+
+  protected:
+    // Scans the tag starting at the '<' at cp. Returns its id and sets *next to the
+    // char following the closing '>'.
+    int scanTag(const char* cp, const char** next) const;
+
+    const char* skipSpace(const char* cp) const;
+
+    const char* _base;
+    const char* _cp;
+    const char* _end;
+  };
+
+} // namespace XmlRpc
+
+#endif // _XMLRPCTOKENIZER_H_
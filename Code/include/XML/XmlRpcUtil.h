@@ -45,9 +45,15 @@ namespace XmlRpc {
     //! Convert raw text to encoded xml.
     static std::string xmlEncode(const std::string& raw);
 
+    //! Convert raw text to encoded xml, appending to the encoded string.
+    static void xmlEncode(const char* raw, size_t len, std::string& encoded);
+
     //! Convert encoded xml to raw text
     static std::string xmlDecode(const std::string& encoded);
 
+    //! Convert encoded xml to raw text, appending to the decoded string.
+    static void xmlDecode(const char* encoded, size_t len, std::string& decoded);
+
 
     //! Dump messages somewhere
     static void log(int level, const char* fmt, ...);
@@ -9,16 +9,33 @@
 #endif
 
 #ifndef MAKEDEPEND
+# include <atomic>
 # include <map>
+# include <memory>
 # include <string>
+# include <string_view>
 # include <vector>
 # include <time.h>
 #endif
 
+#include "XmlRpcKey.h"
+
 namespace XmlRpc {
 
-  //! RPC method arguments and results are represented by Values
-  //   should probably refcount them...
+  // Pull tokenizer used to decode values
+  class XmlRpcTokenizer;
+
+  // Builds arrays and structs element by element as a request arrives
+  class XmlRpcRequestParser;
+
+  //! RPC method arguments and results are represented by Values.
+  //! Array and struct payloads are reference counted and shared between copies,
+  //! so copying a value is O(1) however large it is. A payload is copied the
+  //! first time a value that shares it is modified (copy-on-write).
+  //!
+  //! As with other implicitly shared containers, a reference obtained from a
+  //! non-const operator[] is only safe to write through until the value is
+  //! next copied; after that, writes through it are seen by the copy as well.
   class XmlRpcValue {
   public:
 
@@ -38,7 +55,10 @@ namespace XmlRpc {
     // Non-primitive types
     typedef std::vector<char> BinaryData;
     typedef std::vector<XmlRpcValue> ValueArray;
-    typedef std::map<std::string, XmlRpcValue> ValueStruct;
+    typedef std::map<XmlRpcKey, XmlRpcValue, XmlRpcKey::Less> ValueStruct;
+
+    //! Xml text shared by lazily decoded values
+    typedef std::shared_ptr<const std::string> SharedXml;
 
 
     //! Constructors
@@ -91,11 +111,12 @@ namespace XmlRpc {
     operator BinaryData&()    { assertTypeOrInvalid(TypeBase64); return *_value.asBinary; }
     operator struct tm&()     { assertTypeOrInvalid(TypeDateTime); return *_value.asTime; }
 
-    XmlRpcValue const& operator[](int i) const { assertArray(i+1); return _value.asArray->at(i); }
-    XmlRpcValue& operator[](int i)             { assertArray(i+1); return _value.asArray->at(i); }
+    XmlRpcValue const& operator[](int i) const { assertArray(i+1); return arrayData().at(i); }
+    XmlRpcValue& operator[](int i)             { assertArray(i+1); return mutableArray().at(i); }
 
-    XmlRpcValue& operator[](std::string const& k) { assertStruct(); return (*_value.asStruct)[k]; }
-    XmlRpcValue& operator[](const char* k) { assertStruct(); std::string s(k); return (*_value.asStruct)[s]; }
+    XmlRpcValue& operator[](std::string const& k) { assertStruct(); return member(k); }
+    XmlRpcValue& operator[](const char* k) { assertStruct(); return member(k); }
+    XmlRpcValue& operator[](XmlRpcName const& k) { assertStruct(); return member(k); }
 
     // Accessors
     //! Return true if the value has been set to something.
@@ -111,14 +132,73 @@ namespace XmlRpc {
     void setSize(int size)    { assertArray(size); }
 
     //! Check for the existence of a struct member by name.
-    bool hasMember(const std::string& name) const;
+    bool hasMember(std::string_view name) const;
+
+    // Non-throwing accessors. The conversion operators, operator[] and size()
+    // throw an XmlRpcException on a type mismatch; these report it by returning
+    // null instead, which is much cheaper when bad input is expected.
+
+    //! Return a pointer to the value held if it is a T (bool, int, double,
+    //! std::string, BinaryData, struct tm, ValueArray or ValueStruct), or null.
+    //! Unlike the conversion operators, an invalid value is not converted.
+    template <class T> T const* tryGet() const
+    { static_assert(sizeof(T) == 0, "XmlRpcValue::tryGet: unsupported type"); return 0; }
+    template <class T> T* tryGet()
+    { return const_cast<T*>(static_cast<XmlRpcValue const*>(this)->tryGet<T>()); }
+
+    //! Return the struct member with the given name, or null if this is not a
+    //! struct or has no such member.
+    XmlRpcValue const* find(std::string_view name) const;
+    XmlRpcValue* find(std::string_view name);
 
     //! Decode xml. Destroys any existing value.
     bool fromXml(std::string const& valueXml, int* offset);
 
+    //! Decode xml from a tokenizer positioned at a <value> tag. Destroys any existing value.
+    //! On failure the tokenizer position is left unchanged.
+    bool fromXml(XmlRpcTokenizer& tok);
+
+    //! Decode xml lazily from a tokenizer reading the text held by xml. Scalars are
+    //! decoded now; arrays and structs are only delimited, and their elements are
+    //! decoded (lazily in turn) the first time the value is accessed. The value
+    //! keeps xml alive until then. Accessing a lazy value whose contents turn out
+    //! to be malformed throws an XmlRpcException, or for tryGet() and find(),
+    //! returns null.
+    bool fromXmlLazy(XmlRpcTokenizer& tok, SharedXml const& xml);
+
     //! Encode the Value in xml
     std::string toXml() const;
 
+    //! Append the xml encoding of the Value to a caller-supplied buffer.
+    //! Each nested value is written once, directly into the buffer.
+    void appendXml(std::string& xml) const;
+
+    //! Append the xml encoding of the Value to a list of buffers, whose
+    //! concatenation is the text appendXml(std::string&) would write. The
+    //! elements of an array with at least parallelElements elements are split
+    //! into runs that are encoded concurrently on the shared thread pool, each
+    //! into a buffer of its own, so the caller can write the buffers out in
+    //! turn rather than joining them. Other values are appended to the last
+    //! buffer. A parallelElements of 0 encodes everything serially.
+    void appendXml(std::vector<std::string>& buffers, int parallelElements) const;
+
+    //! Append the compact binary encoding of the Value (see XmlRpcBinary).
+    void appendBinary(std::string& data) const;
+
+    //! Decode the binary encoding of a value starting at cp, and advance cp past
+    //! it. Destroys any existing value. Returns false if the data is malformed.
+    bool fromBinary(const char*& cp, const char* end);
+
+    //! Append the JSON encoding of the Value. Dates and base64 data are written
+    //! as strings, and invalid values as null.
+    void appendJson(std::string& json) const;
+
+    //! Decode the JSON value starting at cp, and advance cp past it. Destroys
+    //! any existing value. Numbers without a fraction or exponent that fit an
+    //! int decode as ints, other numbers as doubles, and null as an invalid
+    //! value. Returns false if the text is malformed.
+    bool fromJson(const char*& cp, const char* end);
+
     //! Write the value (no xml encoding)
     std::ostream& write(std::ostream& os) const;
 
@@ -126,11 +206,109 @@ namespace XmlRpc {
     //! Return the format used to write double values.
     static std::string const& getDoubleFormat() { return _doubleFormat; }
 
-    //! Specify the format used to write double values.
+    //! Specify a printf format used to write double values. The default, an empty
+    //! format, writes the shortest string without an exponent that reads back to
+    //! the identical double. NaN and infinities, which xml-rpc can't represent,
+    //! are written as 0 and the largest finite values.
     static void setDoubleFormat(const char* f) { _doubleFormat = f; }
 
 
   protected:
+    friend class XmlRpcRequestParser;
+
+    // Location of the xml of a lazily decoded payload
+    struct LazyXml;
+    static void releaseLazy(LazyXml* lazy);
+
+    //! Reference-counted array or struct payload. The count is atomic, so values
+    //! that share a payload may be copied and destroyed on different threads.
+    //! A lazily decoded payload is pending until its xml has been decoded into data.
+    template <class T>
+    struct Shared {
+      Shared() : refs(1), pending(false), lazy(0) {}
+      explicit Shared(T const& d) : refs(1), pending(false), lazy(0), data(d) {}
+      ~Shared() { if (lazy) releaseLazy(lazy); }
+
+      Shared* ref() { refs.fetch_add(1, std::memory_order_relaxed); return this; }
+
+      void unref()
+      {
+        if (refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+          delete this;
+      }
+
+      bool shared() const { return refs.load(std::memory_order_acquire) != 1; }
+
+      //! Returns a copy of a shared payload, dropping the caller's reference to this one.
+      //! The copy is shallow: elements share their own payloads with the original.
+      Shared* unshare()
+      {
+        Shared* copy = new Shared(data);
+        unref();
+        return copy;
+      }
+
+      std::atomic<int> refs;
+      std::atomic<bool> pending;
+      LazyXml* lazy;
+      T data;
+    };
+
+    typedef Shared<ValueArray> SharedArray;
+    typedef Shared<ValueStruct> SharedStruct;
+
+    // Payload access for reading; decodes a pending payload first, throwing if
+    // its xml is malformed
+    ValueArray const& arrayData() const
+    {
+      if (_value.asArray->pending.load(std::memory_order_acquire)) requireDecoded();
+      return _value.asArray->data;
+    }
+    ValueStruct const& structData() const
+    {
+      if (_value.asStruct->pending.load(std::memory_order_acquire)) requireDecoded();
+      return _value.asStruct->data;
+    }
+
+    // Decodes the array or struct payload if it is pending, without throwing.
+    // Returns false if its xml is malformed.
+    bool payloadReady() const
+    {
+      bool pending = (_type == TypeArray) ? _value.asArray->pending.load(std::memory_order_acquire)
+                                          : _value.asStruct->pending.load(std::memory_order_acquire);
+      return ! pending || decodePending();
+    }
+
+    // Payload access for modification; detaches from any other values sharing it
+    ValueArray& mutableArray()
+    {
+      (void) arrayData();
+      if (_value.asArray->shared()) _value.asArray = _value.asArray->unshare();
+      return _value.asArray->data;
+    }
+    ValueStruct& mutableStruct()
+    {
+      (void) structData();
+      if (_value.asStruct->shared()) _value.asStruct = _value.asStruct->unshare();
+      return _value.asStruct->data;
+    }
+
+    // Return the struct member with the given name, adding it if it is missing.
+    // No key is built unless the member is added.
+    template <class Name>
+    XmlRpcValue& member(Name const& name)
+    {
+      ValueStruct& members = mutableStruct();
+      ValueStruct::iterator it = members.lower_bound(name);
+      if (it == members.end() || it->first.view() != std::string_view(name))
+        it = members.emplace_hint(it, XmlRpcKey(name), XmlRpcValue());
+      return it->second;
+    }
+
+    // Decode the xml of a pending array or struct payload. Returns false if it is malformed.
+    bool decodePending() const;
+    void requireDecoded() const;
+
     // Clean up
     void invalidate();
 
@@ -140,25 +318,37 @@ namespace XmlRpc {
     void assertArray(int size);
     void assertStruct();
 
-    // XML decoding
-    bool boolFromXml(std::string const& valueXml, int* offset);
-    bool intFromXml(std::string const& valueXml, int* offset);
-    bool doubleFromXml(std::string const& valueXml, int* offset);
-    bool stringFromXml(std::string const& valueXml, int* offset);
-    bool timeFromXml(std::string const& valueXml, int* offset);
-    bool binaryFromXml(std::string const& valueXml, int* offset);
-    bool arrayFromXml(std::string const& valueXml, int* offset);
-    bool structFromXml(std::string const& valueXml, int* offset);
+    // XML decoding. With a non-null xml, arrays and structs are decoded lazily.
+    bool valueFromXml(XmlRpcTokenizer& tok, SharedXml const* xml);
+    bool lazyFromXml(XmlRpcTokenizer& tok, int tag, SharedXml const& xml);
+    bool boolFromXml(XmlRpcTokenizer& tok);
+    bool intFromXml(XmlRpcTokenizer& tok);
+    bool doubleFromXml(XmlRpcTokenizer& tok);
+    bool stringFromXml(XmlRpcTokenizer& tok);
+    bool timeFromXml(XmlRpcTokenizer& tok);
+    bool binaryFromXml(XmlRpcTokenizer& tok);
+    bool arrayFromXml(XmlRpcTokenizer& tok, SharedXml const* xml);
+    bool structFromXml(XmlRpcTokenizer& tok, SharedXml const* xml);
+    static bool elementsFromXml(XmlRpcTokenizer& tok, ValueArray& elements, SharedXml const* xml);
+    static bool membersFromXml(XmlRpcTokenizer& tok, ValueStruct& members, SharedXml const* xml);
 
     // XML encoding
-    std::string boolToXml() const;
-    std::string intToXml() const;
-    std::string doubleToXml() const;
-    std::string stringToXml() const;
-    std::string timeToXml() const;
-    std::string binaryToXml() const;
-    std::string arrayToXml() const;
-    std::string structToXml() const;
+    void boolToXml(std::string& xml) const;
+    void intToXml(std::string& xml) const;
+    void doubleToXml(std::string& xml) const;
+    void stringToXml(std::string& xml) const;
+    void timeToXml(std::string& xml) const;
+    void binaryToXml(std::string& xml) const;
+    void arrayToXml(std::string& xml) const;
+    void structToXml(std::string& xml) const;
+    void arrayToXml(std::vector<std::string>& buffers, int parallelElements) const;
+    void structToXml(std::vector<std::string>& buffers, int parallelElements) const;
+
+    // Binary encoding
+    bool valueFromBinary(const char*& cp, const char* end, int depth);
+
+    // JSON encoding
+    bool valueFromJson(const char*& cp, const char* end, int depth);
 
     // Format strings
     static std::string _doubleFormat;
@@ -166,8 +356,7 @@ namespace XmlRpc {
     // Type tag and values
     Type _type;
 
-    // At some point I will split off Arrays and Structs into
-    // separate ref-counted objects for more efficient copying.
+    // Arrays and Structs are ref-counted and shared between copies.
     union {
       bool          asBool;
       int           asInt;
@@ -175,11 +364,44 @@ namespace XmlRpc {
       struct tm*    asTime;
       std::string*  asString;
       BinaryData*   asBinary;
-      ValueArray*   asArray;
-      ValueStruct*  asStruct;
+      SharedArray*  asArray;
+      SharedStruct* asStruct;
     } _value;
     
   };
+
+
+  // tryGet() for each supported type
+  template <> inline bool const* XmlRpcValue::tryGet<bool>() const
+  { return (_type == TypeBoolean) ? &_value.asBool : 0; }
+
+  template <> inline int const* XmlRpcValue::tryGet<int>() const
+  { return (_type == TypeInt) ? &_value.asInt : 0; }
+
+  template <> inline double const* XmlRpcValue::tryGet<double>() const
+  { return (_type == TypeDouble) ? &_value.asDouble : 0; }
+
+  template <> inline std::string const* XmlRpcValue::tryGet<std::string>() const
+  { return (_type == TypeString) ? _value.asString : 0; }
+
+  template <> inline XmlRpcValue::BinaryData const* XmlRpcValue::tryGet<XmlRpcValue::BinaryData>() const
+  { return (_type == TypeBase64) ? _value.asBinary : 0; }
+
+  template <> inline struct tm const* XmlRpcValue::tryGet<struct tm>() const
+  { return (_type == TypeDateTime) ? _value.asTime : 0; }
+
+  template <> inline XmlRpcValue::ValueArray const* XmlRpcValue::tryGet<XmlRpcValue::ValueArray>() const
+  { return (_type == TypeArray && payloadReady()) ? &_value.asArray->data : 0; }
+
+  template <> inline XmlRpcValue::ValueStruct const* XmlRpcValue::tryGet<XmlRpcValue::ValueStruct>() const
+  { return (_type == TypeStruct && payloadReady()) ? &_value.asStruct->data : 0; }
+
+  // Writable arrays and structs are detached from any other values sharing them
+  template <> inline XmlRpcValue::ValueArray* XmlRpcValue::tryGet<XmlRpcValue::ValueArray>()
+  { return (_type == TypeArray && payloadReady()) ? &mutableArray() : 0; }
+
+  template <> inline XmlRpcValue::ValueStruct* XmlRpcValue::tryGet<XmlRpcValue::ValueStruct>()
+  { return (_type == TypeStruct && payloadReady()) ? &mutableStruct() : 0; }
 } // namespace XmlRpc
 
 
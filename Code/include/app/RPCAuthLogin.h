@@ -6,7 +6,9 @@ class RpcAuthLogin : public XmlRpc::XmlRpcServerMethod {
 public:
   RpcAuthLogin(XmlRpc::XmlRpcServer* srv, AppServer& app);
 
-  void execute(XmlRpc::XmlRpcValue& params, XmlRpc::XmlRpcValue& result) override;
+  bool executeXml(XmlRpc::XmlRpcValue& params, std::string& body) override;
+  bool tryExecute(XmlRpc::XmlRpcValue& params, XmlRpc::XmlRpcValue& result,
+                  XmlRpc::XmlRpcException& fault) override;
   std::string help() override { return "auth.login: {username, password} -> token"; }
 
 private:
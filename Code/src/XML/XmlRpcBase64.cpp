@@ -0,0 +1,280 @@
+
+#include "XmlRpcBase64.h"
+#include "XmlRpcScan.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__)
+# define XMLRPC_BASE64_X86
+#endif
+
+#ifndef MAKEDEPEND
+# include <stdint.h>
+# ifdef XMLRPC_BASE64_X86
+#  include <immintrin.h>
+# endif
+#endif
+
+using namespace XmlRpc;
+
+
+static const char ENCODE_TABLE[] =
+  "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+// Decoding table values outside the 0..63 alphabet range
+static const unsigned char DEC_PAD  = 0xFE;   // '='
+static const unsigned char DEC_SKIP = 0xFF;   // whitespace and anything else
+
+// Input bytes per encoded line of 72 chars
+static const size_t LINE_BYTES = 54;
+
+// Room left past the end of the output for the 32-byte vector stores
+static const size_t STORE_SLACK = 32;
+
+
+namespace {
+  struct DecodeTable {
+    unsigned char value[256];
+    DecodeTable() {
+      for (int i = 0; i < 256; ++i) value[i] = DEC_SKIP;
+      for (int i = 0; i < 64; ++i) value[(unsigned char) ENCODE_TABLE[i]] = (unsigned char) i;
+      value[(unsigned char) '='] = DEC_PAD;
+    }
+  };
+}
+
+static const unsigned char* decodeTable()
+{
+  static const DecodeTable table;
+  return table.value;
+}
+
+
+// Scalar code
+
+static inline char* encodeTriples(const unsigned char* in, size_t n, char* out)
+{
+  for ( ; n >= 3; n -= 3, in += 3, out += 4) {
+    uint32_t v = (uint32_t(in[0]) << 16) | (uint32_t(in[1]) << 8) | in[2];
+    out[0] = ENCODE_TABLE[v >> 18];
+    out[1] = ENCODE_TABLE[(v >> 12) & 0x3F];
+    out[2] = ENCODE_TABLE[(v >> 6) & 0x3F];
+    out[3] = ENCODE_TABLE[v & 0x3F];
+  }
+  return out;
+}
+
+// Encode the last 1 or 2 bytes with padding
+static inline char* encodeTail(const unsigned char* in, size_t n, char* out)
+{
+  uint32_t v = uint32_t(in[0]) << 16;
+  if (n == 2) v |= uint32_t(in[1]) << 8;
+  out[0] = ENCODE_TABLE[v >> 18];
+  out[1] = ENCODE_TABLE[(v >> 12) & 0x3F];
+  out[2] = (n == 2) ? ENCODE_TABLE[(v >> 6) & 0x3F] : '=';
+  out[3] = '=';
+  return out + 4;
+}
+
+
+#ifdef XMLRPC_BASE64_X86
+
+// AVX2 code, after the algorithms described by Wojciech Mula and Daniel Lemire
+// ("Faster Base64 Encoding and Decoding Using AVX2 Instructions").
+
+// Encode 24 bytes from in (28 bytes must be readable) into 32 chars at out.
+__attribute__((target("avx2")))
+static void encodeBlockAvx2(const unsigned char* in, char* out)
+{
+  __m128i lo = _mm_loadu_si128((const __m128i*) in);
+  __m128i hi = _mm_loadu_si128((const __m128i*) (in + 12));
+  __m256i v = _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+
+  // Spread each 3-byte group over a 32-bit lane as [b1 b0 b2 b1]
+  v = _mm256_shuffle_epi8(v, _mm256_setr_epi8(
+        1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10,
+        1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10));
+
+  // Extract the four 6-bit indices of each lane
+  __m256i t0 = _mm256_and_si256(v, _mm256_set1_epi32(0x0fc0fc00));
+  __m256i t1 = _mm256_mulhi_epu16(t0, _mm256_set1_epi32(0x04000040));
+  __m256i t2 = _mm256_and_si256(v, _mm256_set1_epi32(0x003f03f0));
+  __m256i t3 = _mm256_mullo_epi16(t2, _mm256_set1_epi32(0x01000010));
+  __m256i indices = _mm256_or_si256(t1, t3);
+
+  // Map indices to ascii by adding a per-range offset
+  __m256i reduced = _mm256_subs_epu8(indices, _mm256_set1_epi8(51));
+  __m256i less = _mm256_cmpgt_epi8(_mm256_set1_epi8(26), indices);
+  reduced = _mm256_or_si256(reduced, _mm256_and_si256(less, _mm256_set1_epi8(13)));
+  const __m256i shiftLut = _mm256_setr_epi8(
+        'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+        '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0,
+        'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+        '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+  __m256i chars = _mm256_add_epi8(_mm256_shuffle_epi8(shiftLut, reduced), indices);
+
+  _mm256_storeu_si256((__m256i*) out, chars);
+}
+
+// Decode 32 chars from in into 24 bytes at out (32 bytes are stored). Returns
+// false, writing nothing, if any of the chars is outside the base64 alphabet.
+__attribute__((target("avx2")))
+static bool decodeBlockAvx2(const unsigned char* in, unsigned char* out)
+{
+  const __m256i lutLo = _mm256_setr_epi8(
+        0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A,
+        0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+  const __m256i lutHi = _mm256_setr_epi8(
+        0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10,
+        0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+  const __m256i lutRoll = _mm256_setr_epi8(
+        0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+  const __m256i mask2F = _mm256_set1_epi8(0x2F);
+
+  __m256i str = _mm256_loadu_si256((const __m256i*) in);
+
+  // Validate: a char is in the alphabet iff its nibble classes do not intersect
+  __m256i hiNibbles = _mm256_and_si256(_mm256_srli_epi32(str, 4), mask2F);
+  __m256i loNibbles = _mm256_and_si256(str, mask2F);
+  __m256i hi = _mm256_shuffle_epi8(lutHi, hiNibbles);
+  __m256i lo = _mm256_shuffle_epi8(lutLo, loNibbles);
+  if ( ! _mm256_testz_si256(lo, hi))
+    return false;
+
+  // Translate chars to 6-bit values
+  __m256i eq2F = _mm256_cmpeq_epi8(str, mask2F);
+  __m256i roll = _mm256_shuffle_epi8(lutRoll, _mm256_add_epi8(eq2F, hiNibbles));
+  str = _mm256_add_epi8(str, roll);
+
+  // Pack four 6-bit values into three bytes per 32-bit lane, then compact the lanes
+  __m256i merged = _mm256_maddubs_epi16(str, _mm256_set1_epi32(0x01400140));
+  __m256i packed = _mm256_madd_epi16(merged, _mm256_set1_epi32(0x00011000));
+  packed = _mm256_shuffle_epi8(packed, _mm256_setr_epi8(
+        2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+        2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+  packed = _mm256_permutevar8x32_epi32(packed, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, -1, -1));
+
+  _mm256_storeu_si256((__m256i*) out, packed);
+  return true;
+}
+
+#endif // XMLRPC_BASE64_X86
+
+
+// Encode n bytes (a multiple of 3) from in
+static char* encodeRun(const unsigned char* in, size_t n, char* out, bool avx2)
+{
+#ifdef XMLRPC_BASE64_X86
+  if (avx2)
+    for ( ; n >= 28; n -= 24, in += 24, out += 32)
+      encodeBlockAvx2(in, out);
+#else
+  (void) avx2;
+#endif
+  return encodeTriples(in, n, out);
+}
+
+
+size_t
+XmlRpcBase64::encodedLength(size_t len)
+{
+  return ((len + 2) / 3) * 4 + len / LINE_BYTES;
+}
+
+
+void
+XmlRpcBase64::encode(const char* data, size_t len, std::string& out)
+{
+  size_t start = out.size();
+  out.resize(start + encodedLength(len) + STORE_SLACK);
+
+  const unsigned char* in = (const unsigned char*) data;
+  char* op = &out[start];
+  bool avx2 = XmlRpcScan::hasAvx2();
+
+  // Full lines
+  for ( ; len >= LINE_BYTES; len -= LINE_BYTES, in += LINE_BYTES) {
+    op = encodeRun(in, LINE_BYTES, op, avx2);
+    *op++ = '\n';
+  }
+
+  // Last, partial line
+  size_t whole = len - len % 3;
+  op = encodeRun(in, whole, op, avx2);
+  if (len > whole)
+    op = encodeTail(in + whole, len - whole, op);
+
+  out.resize(size_t(op - out.data()));
+}
+
+
+bool
+XmlRpcBase64::decode(const char* text, size_t len, std::vector<char>& out)
+{
+  const unsigned char* dec = decodeTable();
+  const unsigned char* in = (const unsigned char*) text;
+  const unsigned char* end = in + len;
+
+  size_t start = out.size();
+  out.resize(start + (len / 4) * 3 + 3 + STORE_SLACK);
+  unsigned char* base = (unsigned char*) &out[0];
+  unsigned char* op = base + start;
+
+#ifdef XMLRPC_BASE64_X86
+  bool avx2 = XmlRpcScan::hasAvx2();
+#endif
+
+  bool ok = true;
+  for (;;) {
+#ifdef XMLRPC_BASE64_X86
+    if (avx2)
+      for ( ; end - in >= 32 && decodeBlockAvx2(in, op); in += 32, op += 24)
+        ;
+#endif
+
+    // Groups of 4 alphabet chars
+    for ( ; end - in >= 4; in += 4, op += 3) {
+      unsigned a = dec[in[0]], b = dec[in[1]], c = dec[in[2]], d = dec[in[3]];
+      if ((a | b | c | d) & 0xC0)
+        break;
+      uint32_t v = (a << 18) | (b << 12) | (c << 6) | d;
+      op[0] = (unsigned char) (v >> 16);
+      op[1] = (unsigned char) (v >> 8);
+      op[2] = (unsigned char) v;
+    }
+
+    // One group that contains line breaks, padding or other chars, or runs off the end
+    uint32_t v = 0;
+    int n = 0;
+    while (n < 4 && in < end) {
+      unsigned char d = dec[*in++];
+      if (d < 64) {
+        v = (v << 6) | d;
+        ++n;
+      } else if (d == DEC_PAD)
+        break;
+    }
+
+    if (n == 4) {
+      op[0] = (unsigned char) (v >> 16);
+      op[1] = (unsigned char) (v >> 8);
+      op[2] = (unsigned char) v;
+      op += 3;
+      continue;
+    }
+
+    // Padding or end of input: flush a partial group and stop
+    if (n == 1)
+      ok = false;
+    else if (n == 2)
+      *op++ = (unsigned char) (v >> 4);
+    else if (n == 3) {
+      op[0] = (unsigned char) (v >> 10);
+      op[1] = (unsigned char) (v >> 2);
+      op += 2;
+    }
+    break;
+  }
+
+  out.resize(size_t(op - base));
+  return ok;
+}
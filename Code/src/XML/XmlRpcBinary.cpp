@@ -0,0 +1,83 @@
+
+#include "XmlRpcBinary.h"
+
+#ifndef MAKEDEPEND
+# include <string.h>
+# include <strings.h>
+#endif
+
+using namespace XmlRpc;
+
+
+const char XmlRpcBinary::CONTENT_TYPE[] = "application/x-xmlrpc-binary";
+
+static const char CALL = 'C';
+static const char RESULT = 'R';
+static const char FAULT = 'F';
+
+
+bool
+XmlRpcBinary::isContentType(const char* value)
+{
+  size_t n = sizeof(CONTENT_TYPE) - 1;
+  return strncasecmp(value, CONTENT_TYPE, n) == 0 &&
+         (value[n] == 0 || strchr(";\r\n \t", value[n]) != 0);
+}
+
+
+void
+XmlRpcBinary::appendCall(std::string& body, const char* methodName, XmlRpcValue const& params)
+{
+  body += CALL;
+  XmlRpcValue(std::string(methodName)).appendBinary(body);
+
+  if (params.getType() == XmlRpcValue::TypeArray)
+    params.appendBinary(body);
+  else {
+    XmlRpcValue wrapped;
+    wrapped.setSize(0);
+    if (params.valid())
+      wrapped[0] = params;
+    wrapped.appendBinary(body);
+  }
+}
+
+
+bool
+XmlRpcBinary::parseCall(std::string_view body, std::string& methodName, XmlRpcValue& params)
+{
+  const char* cp = body.data();
+  const char* end = cp + body.size();
+  if (cp == end || *cp++ != CALL)
+    return false;
+
+  XmlRpcValue name;
+  if ( ! name.fromBinary(cp, end) || name.getType() != XmlRpcValue::TypeString)
+    return false;
+  if ( ! params.fromBinary(cp, end) || params.getType() != XmlRpcValue::TypeArray || cp != end)
+    return false;
+
+  methodName = std::string(name);
+  return true;
+}
+
+
+void
+XmlRpcBinary::appendResponse(std::string& body, XmlRpcValue const& result, bool isFault)
+{
+  body += isFault ? FAULT : RESULT;
+  result.appendBinary(body);
+}
+
+
+bool
+XmlRpcBinary::parseResponse(std::string_view body, XmlRpcValue& result, bool* isFault)
+{
+  const char* cp = body.data();
+  const char* end = cp + body.size();
+  if (cp == end || (*cp != RESULT && *cp != FAULT))
+    return false;
+
+  *isFault = (*cp++ == FAULT);
+  return result.fromBinary(cp, end) && cp == end;
+}
@@ -0,0 +1,103 @@
+
+#include "XmlRpcBuffer.h"
+
+#ifndef MAKEDEPEND
+# include <string.h>
+# include <utility>
+#endif
+
+using namespace XmlRpc;
+
+
+char*
+XmlRpcBuffer::room(size_t n)
+{
+  if (_capacity - _begin - _size >= n)
+    return _data.get() + _begin + _size;
+
+  // Move the contents to the front if that makes enough room, and they are
+  // small next to what has been consumed before them
+  if (_capacity - _size >= n && _size <= _begin) {
+    memmove(_data.get(), _data.get() + _begin, _size);
+    _begin = 0;
+    return _data.get() + _size;
+  }
+
+  size_t capacity = 2 * _capacity;
+  if (capacity < _size + n)
+    capacity = _size + n;
+  std::unique_ptr<char[]> data(new char[capacity + 1]);
+  if (_size > 0)
+    memcpy(data.get(), _data.get() + _begin, _size);
+  data[_size] = 0;
+  _data = std::move(data);
+  _begin = 0;
+  _capacity = capacity;
+  return _data.get() + _size;
+}
+
+
+void
+XmlRpcBuffer::commit(size_t n)
+{
+  _size += n;
+  _data[_begin + _size] = 0;
+}
+
+
+void
+XmlRpcBuffer::append(const char* p, size_t n)
+{
+  if (n == 0) return;
+  memcpy(room(n), p, n);
+  commit(n);
+}
+
+
+void
+XmlRpcBuffer::consume(size_t n)
+{
+  if (n >= _size) {
+    _begin = 0;
+    _size = 0;
+  } else {
+    _begin += n;
+    _size -= n;
+  }
+  if (_data)
+    _data[_begin + _size] = 0;
+}
+
+
+void
+XmlRpcBuffer::truncate(size_t n)
+{
+  if (n < _size) {
+    _size = n;
+    _data[_begin + _size] = 0;
+  }
+}
+
+
+void
+XmlRpcBuffer::clear()
+{
+  _begin = 0;
+  _size = 0;
+  if (_capacity > KEEP_CAPACITY) {
+    _data.reset();
+    _capacity = 0;
+  } else if (_data) {
+    _data[0] = 0;
+  }
+}
+
+
+void
+XmlRpcBuffer::swap(XmlRpcBuffer& other)
+{
+  std::swap(_data, other._data);
+  std::swap(_begin, other._begin);
+  std::swap(_size, other._size);
+  std::swap(_capacity, other._capacity);
+}
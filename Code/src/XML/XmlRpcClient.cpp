@@ -2,10 +2,15 @@
 #include <stdlib.h>
 #include <strings.h>
 #include <string.h>
+#include <algorithm>
 using namespace std;
 
 #include "XmlRpcClient.h"
 #include "XmlRpcSocket.h"
+#include "XmlRpcTokenizer.h"
+#include "XmlRpcBinary.h"
+#include "XmlRpcShmChannel.h"
+#include "XmlRpcResolver.h"
 #include "XmlRpc.h"
 using namespace XmlRpc;
 
@@ -22,6 +27,34 @@ const char XmlRpcClient::REQUEST_END[] = "</methodCall>\r\n";
 const char XmlRpcClient::METHODRESPONSE_TAG[] = "<methodResponse>";
 const char XmlRpcClient::FAULT_TAG[] = "<fault>";
 
+// Calls sent together
+static const char MULTICALL[] = "system.multicall";
+static const XmlRpcName METHODNAME("methodName");
+static const XmlRpcName PARAMS("params");
+static const XmlRpcName FAULTCODE("faultCode");
+
+// The most recent call latencies kept to estimate the hedging delay from, the
+// fewest to estimate it from, and the number timed between estimates
+static const size_t LATENCY_SAMPLES = 256;
+static const size_t MIN_LATENCY_SAMPLES = 20;
+static const int LATENCY_UPDATE = 16;
+
+// How long to wait before connecting again to a unix domain server whose
+// backlog is full
+static const double CONNECT_RETRY = 0.001;
+
+typedef std::chrono::steady_clock Clock;
+
+static double seconds(Clock::duration d)
+{
+  return std::chrono::duration<double>(d).count();
+}
+
+static Clock::duration duration(double seconds)
+{
+  return std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(seconds));
+}
+
 
 
 XmlRpcClient::XmlRpcClient(const char* host, int port, const char* uri/*=0*/)
@@ -30,13 +63,41 @@ XmlRpcClient::XmlRpcClient(const char* host, int port, const char* uri/*=0*/)
 
   _host = host;
   _port = port;
+  _sharedMemory = XmlRpcShmChannel::isEndpoint(_host, &_unixPath);
+  if (_sharedMemory || XmlRpcSocket::isUnixEndpoint(_host, &_unixPath))
+    _host = "localhost";
+  _shm = 0;
+  _connectRetryAt = Clock::time_point::max();
   if (uri)
     _uri = uri;
   else
     _uri = "/RPC2";
   _connectionState = NO_CONNECTION;
+  _callsWritten = 0;
+  _sendAttempts = 0;
+  _pipelineDepth = 0;
+  _closing = false;
+  _batchSize = 0;
+  _batchWindow = 0.0;
+  _batchDeadline = Clock::time_point::max();
+  _wakeAt = Clock::time_point::max();
+  _hedgePercentile = 0.0;
+  _hedgeHost = host;
+  _hedgePort = port;
+  _hedgeClient = 0;
+  _latencyNext = 0;
+  _latencyUpdate = 0;
+  _hedgeDelay = -1.0;
+  _hedgesSent = 0;
+  _hedgesWon = 0;
+  _bytesWritten = 0;
   _executing = false;
   _eof = false;
+  _isFault = false;
+  _binaryEncoding = false;
+  _binaryResponse = false;
+  _dispatch = &_disp;
+  _monitored = false;
 
   // Default to keeping the connection open until an explicit close is done
   setKeepOpen();
@@ -45,6 +106,10 @@ XmlRpcClient::XmlRpcClient(const char* host, int port, const char* uri/*=0*/)
 
 XmlRpcClient::~XmlRpcClient()
 {
+  if (_monitored)
+    _dispatch->removeSource(this);
+  delete _shm;
+  delete _hedgeClient;
 }
 
 // Close the owned fd
@@ -52,10 +117,101 @@ void
 XmlRpcClient::close()
 {
   XmlRpcUtil::log(4, "XmlRpcClient::close: fd %d.", getfd());
-  _connectionState = NO_CONNECTION;
-  _disp.exit();
-  _disp.removeSource(this);
+  if (_monitored) {
+    _dispatch->removeSource(this);
+    _monitored = false;
+  }
+  _wakeAt = Clock::time_point::max();
+  closeConnection();
+  (void) failCalls();
+  failBatch();
+  if (_hedgeClient)
+    _hedgeClient->close();
+}
+
+// Close the socket, or the shared memory channel that owns it
+void
+XmlRpcClient::closeConnection()
+{
+  if (_shm) {
+    setfd(-1);
+    delete _shm;
+    _shm = 0;
+  }
   XmlRpcSource::close();
+  _connectionState = NO_CONNECTION;
+  _connectRetryAt = Clock::time_point::max();
+}
+
+
+void
+XmlRpcClient::setDispatch(XmlRpcDispatch* dispatch)
+{
+  if ( ! dispatch)
+    dispatch = &_disp;
+  if (_monitored) {
+    _dispatch->removeSource(this);
+    dispatch->addSource(this, eventMask());
+    if (_wakeAt != Clock::time_point::max())
+      dispatch->setSourceWakeup(this, std::max(0.0, seconds(_wakeAt - Clock::now())));
+  }
+  _dispatch = dispatch;
+  if (_hedgeClient)
+    _hedgeClient->setDispatch(dispatch);
+}
+
+
+void
+XmlRpcClient::setHedging(double percentile, const char* host/*=0*/, int port/*=0*/)
+{
+  _hedgePercentile = percentile;
+  if (host) {
+    _hedgeHost = host;
+    _hedgePort = port;
+  }
+  _latencies.clear();
+  _latencyNext = 0;
+  _latencyUpdate = 0;
+  _hedgeDelay = -1.0;
+
+  // Copies in flight to the old endpoint fail, leaving their calls to the
+  // first connection
+  if (_hedgeClient && host) {
+    _hedgeClient->close();
+    delete _hedgeClient;
+    _hedgeClient = 0;
+  }
+}
+
+
+void
+XmlRpcClient::setIdempotent(const char* method, bool idempotent/*=true*/)
+{
+  if (idempotent)
+    _idempotent.insert(method);
+  else
+    _idempotent.erase(method);
+}
+
+
+int
+XmlRpcClient::pending() const
+{
+  int n = int(_batchCallbacks.size());
+  for (size_t i = 0; i < _calls.size(); ++i)
+    n += _calls[i].count;
+  return n;
+}
+
+
+bool
+XmlRpcClient::checkConnection()
+{
+  if (_connectionState == IDLE && ! _shm && (_eof || XmlRpcSocket::isStale(getfd()))) {
+    XmlRpcUtil::log(3, "XmlRpcClient::checkConnection: the server closed the connection on fd %d.", getfd());
+    closeConnection();
+  }
+  return _connectionState != NO_CONNECTION;
 }
 
 
@@ -71,7 +227,7 @@ struct ClearFlagOnExit {
 // Returns true if the request was sent and a result received (although the result
 // might be a fault).
 bool 
-XmlRpcClient::execute(const char* method, XmlRpcValue const& params, XmlRpcValue& result)
+XmlRpcClient::execute(const char* method, XmlRpcValue const& params, XmlRpcValue& result, double timeout/*=-1.0*/)
 {
   XmlRpcUtil::log(1, "XmlRpcClient::execute: method %s (_connectionState %d).", method, _connectionState);
 
@@ -84,55 +240,655 @@ XmlRpcClient::execute(const char* method, XmlRpcValue const& params, XmlRpcValue
   _executing = true;
   ClearFlagOnExit cf(_executing);
 
-  _sendAttempts = 0;
   _isFault = false;
+  result.clear();
 
-  if ( ! setupConnection())
+  bool done = false;
+  bool ok = false;
+  XmlRpcDispatch* dispatch = _dispatch;
+  if ( ! executeAsync(method, params, [&](bool callOk, XmlRpcValue& value, bool isFault) {
+         done = true;
+         ok = callOk;
+         _isFault = isFault;
+         result = value;
+         dispatch->exit();
+       }, timeout))
     return false;
 
-  if ( ! generateRequest(method, params))
-    return false;
+  // Don't wait for more calls to send with this one
+  flushBatch();
 
-  result.clear();
-  double msTime = -1.0;   // Process until exit is called
-  _disp.work(msTime);
+  double msTime = -1.0;   // Process until exit is called, by the deadline at the latest
+  _dispatch->work(msTime);
+  if ( ! done)
+    close();      // The call fails
 
-  if (_connectionState != IDLE || ! parseResponse(result))
+  if ( ! ok)
     return false;
 
   XmlRpcUtil::log(1, "XmlRpcClient::execute: method %s completed.", method);
-  _response = "";
   return true;
 }
 
+
+// Start executing the named procedure on the remote server. The callback is
+// called from the dispatcher when the response arrives.
+bool
+XmlRpcClient::executeAsync(const char* method, XmlRpcValue const& params, Callback callback, double timeout/*=-1.0*/)
+{
+  XmlRpcUtil::log(1, "XmlRpcClient::executeAsync: method %s (_connectionState %d, %d pending).",
+                  method, _connectionState, int(_calls.size()));
+
+  if ( ! setupConnection())
+    return false;
+
+  Clock::time_point deadline = Clock::time_point::max();
+  if (timeout >= 0.0)
+    deadline = Clock::now() + duration(timeout);
+
+  if (_batchSize > 1) {
+    batchCall(method, params, std::move(callback), deadline);
+    return true;
+  }
+
+  // Calls still waiting to be sent together go first
+  flushBatch();
+
+  if ( ! generateRequest(method, params))
+    return false;
+
+  queueCall(std::move(callback), 1, deadline, method, &params);
+  return true;
+}
+
+// Queue the request just generated to be written. A single call is timed, if
+// calls are hedged, and is hedged later if the method allows.
+void
+XmlRpcClient::queueCall(Callback callback, int count, Clock::time_point deadline,
+                        const char* method/*=0*/, XmlRpcValue const* params/*=0*/)
+{
+  _calls.push_back(Call());
+  Call& call = _calls.back();
+  call.request.swap(_request);
+  call.callback = std::move(callback);
+  call.count = count;
+  call.deadline = deadline;
+  call.hedgeAt = Clock::time_point::max();
+  if (_hedgePercentile > 0.0 && count == 1) {
+    call.started = Clock::now();
+    if (method && _hedgeDelay >= 0.0 && isIdempotent(method)) {
+      call.hedgeAt = call.started + duration(_hedgeDelay);
+      call.method = method;
+      call.params = *params;
+    }
+  }
+  if (_connectionState == IDLE)
+    _connectionState = READ_HEADER;
+
+  // A shared memory channel has no writable event, so it is woken instead
+  if (_shm)
+    _shm->wake();
+  monitor();
+  wakeBy(std::min(call.deadline, call.hedgeAt));
+}
+
+// Notify the dispatcher to listen on this source for the events it now needs
+// (calls handleEvent when the socket is writable), or to stop if it needs none
+void
+XmlRpcClient::monitor()
+{
+  unsigned mask = eventMask();
+  if (mask == 0 && _wakeAt == Clock::time_point::max()) {
+    if (_monitored)
+      _dispatch->removeSource(this);
+    _monitored = false;
+  } else if (_monitored)
+    _dispatch->setSourceEvents(this, mask);
+  else {
+    _dispatch->addSource(this, mask);
+    _monitored = true;
+  }
+}
+
+// Have the dispatcher report TimeoutEvent by the given time
+void
+XmlRpcClient::wakeBy(Clock::time_point at)
+{
+  if (at >= _wakeAt)
+    return;
+
+  _wakeAt = at;
+  if ( ! _monitored) {
+    _dispatch->addSource(this, eventMask());
+    _monitored = true;
+  }
+  _dispatch->setSourceWakeup(this, std::max(0.0, seconds(at - Clock::now())));
+}
+
+// Cancel the wakeup, once there is nothing left to wake for
+void
+XmlRpcClient::cancelWakeup()
+{
+  if (_wakeAt == Clock::time_point::max())
+    return;
+
+  _wakeAt = Clock::time_point::max();
+  if (_monitored)
+    _dispatch->setSourceWakeup(this, -1.0);
+}
+
+
+// Add a call to those waiting to be sent as one system.multicall. The batch is
+// sent when it is full, or when the dispatcher wakes the client at the end of
+// the window.
+void
+XmlRpcClient::batchCall(const char* method, XmlRpcValue const& params, Callback callback, Clock::time_point deadline)
+{
+  XmlRpcValue& call = _batch[int(_batchCallbacks.size())];
+  call[METHODNAME] = method;
+
+  // If params is an array, each element is a separate parameter
+  if (params.getType() == XmlRpcValue::TypeArray)
+    call[PARAMS] = params;
+  else {
+    XmlRpcValue& list = call[PARAMS];
+    list.setSize(0);
+    if (params.valid())
+      list[0] = params;
+  }
+  _batchCallbacks.push_back(std::move(callback));
+  if (_batchCallbacks.size() == 1 || deadline < _batchDeadline)
+    _batchDeadline = deadline;
+
+  if (int(_batchCallbacks.size()) >= _batchSize)
+    flushBatch();
+  else if (_batchCallbacks.size() == 1) {
+    _batchDue = Clock::now() + duration(_batchWindow);
+    wakeBy(_batchDue);
+  }
+}
+
+// Pass each call in a system.multicall its own result or fault
+static void completeBatch(std::vector<XmlRpcClient::Callback> const& callbacks,
+                          bool ok, XmlRpcValue& result, bool isFault)
+{
+  XmlRpcValue::ValueArray* results = (ok && ! isFault) ? result.tryGet<XmlRpcValue::ValueArray>() : 0;
+  if (ok && ! isFault && ( ! results || results->size() != callbacks.size())) {
+    XmlRpcUtil::error("Error in XmlRpcClient: invalid %s response for %d calls.", MULTICALL, int(callbacks.size()));
+    ok = false;
+  }
+
+  for (size_t i = 0; i < callbacks.size(); ++i) {
+    XmlRpcValue none;
+    if ( ! ok)
+      callbacks[i](false, none, false);
+    else if (isFault) {
+      XmlRpcValue fault = result;     // The multicall as a whole failed
+      callbacks[i](true, fault, true);
+    } else {
+      // Each result is an array of the one value, or a fault struct
+      XmlRpcValue& r = (*results)[i];
+      XmlRpcValue::ValueArray* value = r.tryGet<XmlRpcValue::ValueArray>();
+      if (value && value->size() == 1)
+        callbacks[i](true, (*value)[0], false);
+      else if (r.find(FAULTCODE))
+        callbacks[i](true, r, true);
+      else {
+        XmlRpcUtil::error("Error in XmlRpcClient: invalid result for call %d of a %s.", int(i), MULTICALL);
+        callbacks[i](false, none, false);
+      }
+    }
+  }
+}
+
+// Send the calls waiting in the batch: one alone as itself, more as a
+// system.multicall
+void
+XmlRpcClient::flushBatch()
+{
+  if (_batchCallbacks.empty())
+    return;
+
+  XmlRpcValue params;
+  params[0] = _batch;
+  _batch.clear();
+  std::vector<Callback> callbacks;
+  callbacks.swap(_batchCallbacks);
+  Clock::time_point deadline = _batchDeadline;
+
+  // The connection may have been lost since the calls were started
+  if ( ! setupConnection()) {
+    for (size_t i = 0; i < callbacks.size(); ++i) {
+      XmlRpcValue none;
+      callbacks[i](false, none, false);
+    }
+    return;
+  }
+
+  XmlRpcUtil::log(3, "XmlRpcClient::flushBatch: sending %d calls.", int(callbacks.size()));
+  if (callbacks.size() == 1) {
+    XmlRpcValue& call = params[0][0];
+    std::string& method = call[METHODNAME];
+    (void) generateRequest(method.c_str(), call[PARAMS]);
+    queueCall(std::move(callbacks[0]), 1, deadline, method.c_str(), &call[PARAMS]);
+  } else {
+    int count = int(callbacks.size());
+    (void) generateRequest(MULTICALL, params);
+    queueCall([callbacks](bool ok, XmlRpcValue& result, bool isFault) {
+                completeBatch(callbacks, ok, result, isFault);
+              }, count, deadline);
+  }
+}
+
+// Fail the calls waiting in the batch
+void
+XmlRpcClient::failBatch()
+{
+  std::vector<Callback> failed;
+  failed.swap(_batchCallbacks);
+  _batch.clear();
+  for (size_t i = 0; i < failed.size(); ++i) {
+    XmlRpcValue none;
+    failed[i](false, none, false);
+  }
+}
+
+
+// The exception a failed call or fault response is reported with through a future
+static XmlRpcException callException(bool ok, XmlRpcValue const& result)
+{
+  if ( ! ok)
+    return XmlRpcException("XmlRpcClient: the call failed");
+
+  XmlRpcValue const* code = result.find("faultCode");
+  XmlRpcValue const* message = result.find("faultString");
+  int const* c = code ? code->tryGet<int>() : 0;
+  std::string const* m = message ? message->tryGet<std::string>() : 0;
+  return XmlRpcException(m ? *m : std::string("fault"), c ? *c : -1);
+}
+
+std::future<XmlRpcValue>
+XmlRpcClient::executeAsync(const char* method, XmlRpcValue const& params, double timeout/*=-1.0*/)
+{
+  std::shared_ptr<std::promise<XmlRpcValue> > promise = std::make_shared<std::promise<XmlRpcValue> >();
+  std::future<XmlRpcValue> future = promise->get_future();
+
+  bool started = executeAsync(method, params, [promise](bool ok, XmlRpcValue& result, bool isFault) {
+    if (ok && ! isFault)
+      promise->set_value(result);
+    else
+      promise->set_exception(std::make_exception_ptr(callException(ok, result)));
+  }, timeout);
+  if ( ! started)
+    promise->set_exception(std::make_exception_ptr(XmlRpcException("XmlRpcClient: could not start the call")));
+  return future;
+}
+
+
 // XmlRpcSource interface implementation
-// Handle server responses. Called by the event dispatcher during execute.
+// Handle server responses. Called by the event dispatcher.
 unsigned
 XmlRpcClient::handleEvent(unsigned eventType)
 {
-  if (eventType == XmlRpcDispatch::Exception)
+  // The window for calls to send together has ended, or a deadline or a
+  // hedge has come
+  if (eventType == XmlRpcDispatch::TimeoutEvent)
+    handleTimers();
+
+  unsigned mask;
+  if (_calls.empty())
+    mask = 0;       // Another event reported with one that completed the last call
+  else if (eventType == XmlRpcDispatch::Exception)
   {
-    if (_connectionState == WRITE_REQUEST && _bytesWritten == 0)
+    if (_connectionState == CONNECTING)
       XmlRpcUtil::error("Error in XmlRpcClient::handleEvent: could not connect to server (%s).", 
                        XmlRpcSocket::getErrorMsg().c_str());
     else
       XmlRpcUtil::error("Error in XmlRpcClient::handleEvent (state %d): %s.", 
                         _connectionState, XmlRpcSocket::getErrorMsg().c_str());
+    closeConnection();
+    mask = failCalls();
+  }
+  else
+    mask = _shm ? handleShmEvent() : handleIo();
+
+  // Stop monitoring an idle connection; the next call adds it again. The
+  // dispatcher keeps it while a wakeup is set.
+  if (mask == 0 && _wakeAt == Clock::time_point::max())
+    _monitored = false;
+  return mask;
+}
+
+// Act on the times that have come: send the calls waiting to be sent
+// together, fail the calls past their deadlines, and hedge the calls taking
+// longer than most. Then set the wakeup for the next.
+void
+XmlRpcClient::handleTimers()
+{
+  Clock::time_point now = Clock::now();
+  _wakeAt = Clock::time_point::max();
+  if (_connectRetryAt <= now && ! connectLocal()) {
+    closeConnection();
+    (void) failCalls();
+  }
+  if ( ! _batchCallbacks.empty() && _batchDue <= now)
+    flushBatch();
+
+  std::vector<Callback> expired;
+  for (size_t i = 0; i < _calls.size(); ++i) {
+    Call& call = _calls[i];
+    if ( ! call.callback)
+      continue;
+    if (call.deadline <= now) {
+      expired.push_back(std::move(call.callback));
+      call.callback = nullptr;
+    } else if (call.hedgeAt <= now)
+      hedgeCall(call, now);
+  }
+
+  if ( ! expired.empty()) {
+    XmlRpcUtil::log(2, "XmlRpcClient::handleTimers: %d calls timed out.", int(expired.size()));
+    if ( ! dropAbandoned())
+      (void) failCalls();
+  }
+
+  Clock::time_point next = _connectRetryAt;
+  if ( ! _batchCallbacks.empty())
+    next = std::min(next, _batchDue);
+  for (size_t i = 0; i < _calls.size(); ++i)
+    if (_calls[i].callback)
+      next = std::min(next, std::min(_calls[i].deadline, _calls[i].hedgeAt));
+  wakeBy(next);
+
+  for (size_t i = 0; i < expired.size(); ++i) {
+    XmlRpcValue none;
+    expired[i](false, none, false);
+  }
+}
+
+// A call sent on both connections: the callback, until an answer is passed
+// to it, and the number of the two copies still to answer. The first result
+// is passed on; a failure only once both have failed.
+struct XmlRpcClient::Hedge {
+  Callback callback;
+  int outstanding;
+
+  void complete(bool ok, XmlRpcValue& result, bool isFault)
+  {
+    --outstanding;
+    if (callback && (ok || outstanding == 0)) {
+      Callback done = std::move(callback);
+      callback = nullptr;
+      done(ok, result, isFault);
+    }
+  }
+};
+
+// Send a copy of a call that has taken longer than most on the second
+// connection, made when first needed
+void
+XmlRpcClient::hedgeCall(Call& call, Clock::time_point now)
+{
+  call.hedgeAt = Clock::time_point::max();
+  if ( ! _hedgeClient) {
+    XmlRpcUtil::log(2, "XmlRpcClient::hedgeCall: connecting to %s for hedged calls.", _hedgeHost.c_str());
+    _hedgeClient = new XmlRpcClient(_hedgeHost.c_str(), _hedgePort, _uri.c_str());
+    _hedgeClient->setBinaryEncoding(_binaryEncoding);
+    _hedgeClient->setSocketOptions(_socketOptions);
+    _hedgeClient->setDispatch(_dispatch);
+  }
+
+  std::shared_ptr<Hedge> hedge = std::make_shared<Hedge>();
+  hedge->callback = std::move(call.callback);
+  hedge->outstanding = 2;
+  call.callback = [hedge](bool ok, XmlRpcValue& result, bool isFault) {
+    hedge->complete(ok, result, isFault);
+  };
+  call.hedge = hedge;
+
+  double timeout = -1.0;
+  if (call.deadline != Clock::time_point::max())
+    timeout = seconds(call.deadline - now);
+  bool sent = _hedgeClient->executeAsync(call.method.c_str(), call.params,
+    [this, hedge](bool ok, XmlRpcValue& result, bool isFault) {
+      if (ok && hedge->callback) {
+        ++_hedgesWon;
+        abandonCall(hedge);
+      }
+      hedge->complete(ok, result, isFault);
+    }, timeout);
+
+  if ( ! sent) {
+    // The call carries on alone
+    call.callback = std::move(hedge->callback);
+    call.hedge.reset();
+    return;
+  }
+  XmlRpcUtil::log(3, "XmlRpcClient::hedgeCall: hedged a call to %s.", call.method.c_str());
+  ++_hedgesSent;
+}
+
+// The copy of a hedged call was answered first, so the call is no longer wanted
+void
+XmlRpcClient::abandonCall(std::shared_ptr<Hedge> const& hedge)
+{
+  for (size_t i = 0; i < _calls.size(); ++i)
+    if (_calls[i].hedge == hedge) {
+      _calls[i].callback = nullptr;
+      if ( ! dropAbandoned())
+        (void) failCalls();
+      monitor();
+      return;
+    }
+}
+
+// Drop the calls no one is waiting for any more. Those not yet written are
+// just dropped. Those written are left for their responses to be read and
+// thrown away, so that the connection can still be used; but if none of the
+// calls written is still wanted, the connection is closed rather than left
+// waiting on a server that may be stuck, and the calls still wanted are sent
+// on a new one. Returns false if a new connection could not be made.
+bool
+XmlRpcClient::dropAbandoned()
+{
+  size_t written = std::min(_calls.size(), _callsWritten + (_bytesWritten > 0 ? 1 : 0));
+  bool wanted = false;
+  for (size_t i = 0; i < written; ++i)
+    if (_calls[i].callback)
+      wanted = true;
+
+  if (written > 0 && ! wanted) {
+    XmlRpcUtil::log(3, "XmlRpcClient::dropAbandoned: closing the connection, with %d responses not wanted.", int(written));
+    if (_connectionState != NO_CONNECTION)
+      closeConnection();
+    written = 0;
+  }
+
+  std::deque<Call> kept;
+  for (size_t i = 0; i < _calls.size(); ++i)
+    if (i < written || _calls[i].callback)
+      kept.push_back(std::move(_calls[i]));
+  _calls.swap(kept);
+
+  if (_connectionState == READ_HEADER && _calls.empty())
+    _connectionState = IDLE;
+  if (_connectionState == NO_CONNECTION && ! _calls.empty())
+    return setupConnection();
+  return true;
+}
+
+// Add the latency of a call answered to those the hedging delay is estimated
+// from, estimating it again every so often
+void
+XmlRpcClient::recordLatency(double seconds)
+{
+  if (_latencies.size() < LATENCY_SAMPLES)
+    _latencies.push_back(seconds);
+  else {
+    _latencies[_latencyNext] = seconds;
+    _latencyNext = (_latencyNext + 1) % LATENCY_SAMPLES;
+  }
+
+  if (++_latencyUpdate < LATENCY_UPDATE || _latencies.size() < MIN_LATENCY_SAMPLES)
+    return;
+
+  _latencyUpdate = 0;
+  std::vector<double> sorted(_latencies);
+  size_t k = std::min(sorted.size() - 1, size_t(_hedgePercentile * sorted.size()));
+  std::nth_element(sorted.begin(), sorted.begin() + k, sorted.end());
+  _hedgeDelay = sorted[k];
+}
+
+// Write what can be written of the requests not yet sent, and read the
+// responses that have arrived. Returns the events to monitor for next.
+unsigned
+XmlRpcClient::handleIo()
+{
+  if (canWrite() && ! writeRequest() && ! writeFailed()) {
+    closeConnection();
+    return failCalls();
+  }
+
+  while (_connectionState == READ_HEADER || _connectionState == READ_RESPONSE) {
+    ClientConnectionState state = _connectionState;
+    if ( ! ((state == READ_HEADER) ? readHeader() : readResponse())) {
+      closeConnection();
+      return failCalls();
+    }
+
+    // Stop when waiting for more data, or when the last call was answered
+    if (_connectionState == state)
+      break;
+  }
+
+  // If the server closed the connection after its last response, send the
+  // calls it left unanswered on a new one
+  if (_connectionState == NO_CONNECTION && ! _calls.empty() && ! setupConnection())
+    return failCalls();
+
+  // Send any calls the callbacks started without waiting for another event
+  if (canWrite() && ! writeRequest() && ! writeFailed()) {
+    closeConnection();
+    return failCalls();
+  }
+
+  return eventMask();
+}
+
+// Handle a shared memory connection: keep going while there is something to
+// do, then sleep until the server signals. The channel is always watched for
+// reading, as a signal is sent for room to write too.
+unsigned
+XmlRpcClient::handleShmEvent()
+{
+  _shm->clearWakeup();
+  for (;;) {
+    unsigned mask = handleIo();
+    if (mask == 0)
+      return 0;
+
+    if ( ! _shm->wait(true, canWrite(), _socketOptions.busyPoll))
+      return XmlRpcDispatch::ReadableEvent;
+  }
+}
+
+// The events to monitor the connection for: always readable while calls are
+// outstanding, so that responses are read while later requests are written
+unsigned
+XmlRpcClient::eventMask() const
+{
+  if (_calls.empty() || _connectRetryAt != Clock::time_point::max())
     return 0;
+  if (_shm || ! canWrite())
+    return XmlRpcDispatch::ReadableEvent;
+  return XmlRpcDispatch::ReadableEvent | XmlRpcDispatch::WritableEvent | XmlRpcDispatch::Exception;
+}
+
+// Whether a request can be written: one is waiting, the pipeline has room, the
+// connect has been made and the server has not said it is closing the connection
+bool
+XmlRpcClient::canWrite() const
+{
+  return _callsWritten < _calls.size() && ! _closing && _connectRetryAt == Clock::time_point::max() &&
+         (_pipelineDepth <= 0 || _callsWritten < size_t(_pipelineDepth));
+}
+
+// Parse the response to the first call, and pass it to the call's callback
+void
+XmlRpcClient::completeCall()
+{
+  Call call = std::move(_calls.front());
+  _calls.pop_front();
+  --_callsWritten;
+  _sendAttempts = 0;
+  _connectionState = _calls.empty() ? IDLE : READ_HEADER;
+  if (call.started != Clock::time_point())
+    recordLatency(seconds(Clock::now() - call.started));
+  if (_calls.empty() && _batchCallbacks.empty())
+    cancelWakeup();
+
+  // The server answers no more calls on this connection
+  if (_closing) {
+    XmlRpcUtil::log(3, "XmlRpcClient::completeCall: the server is closing the connection; %d calls to send again.", int(_calls.size()));
+    closeConnection();
   }
 
-  if (_connectionState == WRITE_REQUEST)
-    if ( ! writeRequest()) return 0;
+  // The fault flag of this response goes to its callback only; execute()
+  // sets isFault() from its own
+  XmlRpcValue result;
+  bool isFault = false;
+  bool ok = parseResponse(result, isFault);
+  if (call.callback)
+    call.callback(ok, result, isFault);
+}
 
-  if (_connectionState == READ_HEADER)
-    if ( ! readHeader()) return 0;
+// Fail the calls outstanding when the connection has been closed. Returns the
+// events to monitor for calls the callbacks may have started.
+unsigned
+XmlRpcClient::failCalls()
+{
+  std::deque<Call> failed;
+  failed.swap(_calls);
+  _callsWritten = 0;
+  _bytesWritten = 0;
+  _sendAttempts = 0;
+  if (_batchCallbacks.empty() && _connectRetryAt == Clock::time_point::max())
+    cancelWakeup();
+
+  for (size_t i = 0; i < failed.size(); ++i) {
+    XmlRpcValue none;
+    if (failed[i].callback)
+      failed[i].callback(false, none, false);
+  }
+  return eventMask();
+}
+
+// A write failed, most likely because the server closed the connection. The
+// responses it sent before closing may still be waiting to be read, so if any
+// calls were written, write no more and read on; the calls left unanswered
+// are sent again when the end of the connection is reached.
+bool
+XmlRpcClient::writeFailed()
+{
+  if (_callsWritten > 0) {
+    _closing = true;
+    return true;
+  }
+  return resendCalls();
+}
 
-  if (_connectionState == READ_RESPONSE)
-    if ( ! readResponse()) return 0;
+// The connection was lost with calls unanswered. If this is a keep-alive
+// connection, the server may have timed out, so connect again and send every
+// call not yet answered, once for each response received.
+bool
+XmlRpcClient::resendCalls()
+{
+  if ( ! getKeepOpen() || _sendAttempts++ > 0)
+    return false;
 
-  // This should probably always ask for Exception events too
-  return (_connectionState == WRITE_REQUEST) 
-        ? XmlRpcDispatch::WritableEvent : XmlRpcDispatch::ReadableEvent;
+  XmlRpcUtil::log(4, "XmlRpcClient: re-trying connection; %d calls to send again.", int(_calls.size()));
+  closeConnection();
+  return setupConnection();
 }
 
 
@@ -140,22 +896,23 @@ XmlRpcClient::handleEvent(unsigned eventType)
 bool 
 XmlRpcClient::setupConnection()
 {
-  // If an error occurred last time through, or if the server closed the connection, close our end
-  if ((_connectionState != NO_CONNECTION && _connectionState != IDLE) || _eof)
-    close();
+  // If the server closed the connection, close our end
+  if (_connectionState == IDLE && _eof)
+    closeConnection();
 
-  _eof = false;
-  if (_connectionState == NO_CONNECTION)
+  if (_connectionState == NO_CONNECTION) {
+    _eof = false;
     if (! doConnect()) 
       return false;
 
-  // Prepare to write the request
-  _connectionState = WRITE_REQUEST;
-  _bytesWritten = 0;
-
-  // Notify the dispatcher to listen on this source (calls handleEvent when the socket is writable)
-  _disp.removeSource(this);       // Make sure nothing is left over
-  _disp.addSource(this, XmlRpcDispatch::WritableEvent | XmlRpcDispatch::Exception);
+    // Prepare to write the outstanding requests
+    _connectionState = CONNECTING;
+    _closing = false;
+    _callsWritten = 0;
+    _bytesWritten = 0;
+    _header.clear();
+    _response.clear();
+  }
 
   return true;
 }
@@ -165,7 +922,18 @@ XmlRpcClient::setupConnection()
 bool 
 XmlRpcClient::doConnect()
 {
-  int fd = XmlRpcSocket::socket();
+  bool local = ! _unixPath.empty();
+
+  // The address is looked up once, and refreshed in the background after that,
+  // so a reconnect doesn't wait for DNS
+  if ( ! local && (_address.length == 0 || std::chrono::steady_clock::now() >= _addressExpires) &&
+       ! XmlRpcResolver::shared().resolve(_host, _port, &_address, &_addressExpires))
+  {
+    XmlRpcUtil::error("Error in XmlRpcClient::doConnect: Could not resolve host %s.", _host.c_str());
+    return false;
+  }
+
+  int fd = local ? XmlRpcSocket::unixSocket() : XmlRpcSocket::socket();
   if (fd < 0)
   {
     XmlRpcUtil::error("Error in XmlRpcClient::doConnect: Could not create socket (%s).", XmlRpcSocket::getErrorMsg().c_str());
@@ -178,14 +946,27 @@ XmlRpcClient::doConnect()
   // Don't block on connect/reads/writes
   if ( ! XmlRpcSocket::setNonBlocking(fd))
   {
-    this->close();
+    closeConnection();
     XmlRpcUtil::error("Error in XmlRpcClient::doConnect: Could not set socket to non-blocking IO mode (%s).", XmlRpcSocket::getErrorMsg().c_str());
     return false;
   }
 
-  if ( ! XmlRpcSocket::connect(fd, _host, _port))
+  if (local)
+  {
+    if ( ! connectLocal())
+    {
+      closeConnection();
+      return false;
+    }
+    return true;
+  }
+
+  // Options that can't be set are left at their defaults
+  (void) XmlRpcSocket::setConnectOptions(fd, _socketOptions);
+
+  if ( ! XmlRpcSocket::connect(fd, _address))
   {
-    this->close();
+    closeConnection();
     XmlRpcUtil::error("Error in XmlRpcClient::doConnect: Could not connect to server (%s).", XmlRpcSocket::getErrorMsg().c_str());
     return false;
   }
@@ -193,41 +974,84 @@ XmlRpcClient::doConnect()
   return true;
 }
 
+// Connect to a unix domain server, and set up the shared memory channel if it
+// is used. The connect completes at once, or fails with EAGAIN while the
+// server's backlog is full. Nothing is then in progress as it is for TCP, and
+// the socket is reported writable (and hung up) at once, so the connect is
+// made again on a timer, and the calls wait to be written until it succeeds.
+bool
+XmlRpcClient::connectLocal()
+{
+  bool wouldBlock;
+  if ( ! XmlRpcSocket::connectUnix(getfd(), _unixPath, &wouldBlock))
+  {
+    XmlRpcUtil::error("Error in XmlRpcClient::connectLocal: Could not connect to server at %s (%s).", _unixPath.c_str(), XmlRpcSocket::getErrorMsg().c_str());
+    return false;
+  }
+
+  if (wouldBlock)
+  {
+    XmlRpcUtil::log(3, "XmlRpcClient::connectLocal: the server's backlog is full; trying again.");
+    _connectRetryAt = Clock::now() + duration(CONNECT_RETRY);
+    wakeBy(_connectRetryAt);
+    return true;
+  }
+
+  _connectRetryAt = Clock::time_point::max();
+
+  if (_sharedMemory)
+  {
+    _shm = XmlRpcShmChannel::connect(getfd());
+    if ( ! _shm)
+      return false;
+    this->setfd(_shm->fd());    // The channel owns the socket
+  }
+  return true;
+}
+
 // Encode the request to call the specified method with the specified parameters into xml
 bool 
 XmlRpcClient::generateRequest(const char* methodName, XmlRpcValue const& params)
 {
-  std::string body = REQUEST_BEGIN;
-  body += methodName;
-  body += REQUEST_END_METHODNAME;
-
-  // If params is an array, each element is a separate parameter
-  if (params.valid()) {
-    body += PARAMS_TAG;
-    if (params.getType() == XmlRpcValue::TypeArray)
-    {
-      for (int i=0; i<params.size(); ++i) {
+  std::string body;
+  if (_binaryEncoding)
+    XmlRpcBinary::appendCall(body, methodName, params);
+  else {
+    body = REQUEST_BEGIN;
+    body += methodName;
+    body += REQUEST_END_METHODNAME;
+
+    // If params is an array, each element is a separate parameter
+    if (params.valid()) {
+      body += PARAMS_TAG;
+      if (params.getType() == XmlRpcValue::TypeArray)
+      {
+        for (int i=0; i<params.size(); ++i) {
+          body += PARAM_TAG;
+          params[i].appendXml(body);
+          body += PARAM_ETAG;
+        }
+      }
+      else
+      {
         body += PARAM_TAG;
-        body += params[i].toXml();
+        params.appendXml(body);
         body += PARAM_ETAG;
       }
+
+      body += PARAMS_ETAG;
     }
-    else
-    {
-      body += PARAM_TAG;
-      body += params.toXml();
-      body += PARAM_ETAG;
-    }
-      
-    body += PARAMS_ETAG;
+    body += REQUEST_END;
   }
-  body += REQUEST_END;
 
   std::string header = generateHeader(body);
   XmlRpcUtil::log(4, "XmlRpcClient::generateRequest: header is %d bytes, content-length is %d.", 
                   header.length(), body.length());
 
-  _request = header + body;
+  _request.clear();
+  _request.reserve(header.size() + body.size());
+  _request += header;
+  _request += body;
   return true;
 }
 
@@ -243,37 +1067,60 @@ XmlRpcClient::generateHeader(std::string const& body)
   header += _host;
 
   char buff[40];
-  sprintf(buff,":%d\r\n", _port);
+  if (_unixPath.empty())
+    sprintf(buff,":%d\r\n", _port);
+  else
+    strcpy(buff, "\r\n");
 
   header += buff;
-  header += "Content-Type: text/xml\r\nContent-length: ";
+  if (_binaryEncoding) {
+    header += "Content-Type: ";
+    header += XmlRpcBinary::CONTENT_TYPE;
+    header += "\r\nAccept: ";
+    header += XmlRpcBinary::CONTENT_TYPE;
+    header += ", text/xml\r\n";
+  } else
+    header += "Content-Type: text/xml\r\n";
+  header += "Content-length: ";
 
   sprintf(buff,"%lu\r\n\r\n", body.size());
 
   return header + buff;
 }
 
+// Write the requests not yet written, back to back, until the connection would block
 bool 
 XmlRpcClient::writeRequest()
 {
-  if (_bytesWritten == 0)
-    XmlRpcUtil::log(5, "XmlRpcClient::writeRequest (attempt %d):\n%s\n", _sendAttempts+1, _request.c_str());
+  bool ok = true;
+  while (canWrite()) {
+    std::string& request = _calls[_callsWritten].request;
+    if (_bytesWritten == 0)
+      XmlRpcUtil::log(5, "XmlRpcClient::writeRequest (attempt %d):\n%s\n", _sendAttempts+1, request.c_str());
+
+    // Try to write the request
+    if ( ! writeData(request)) {
+      // With calls written the server has likely closed the connection, and
+      // the responses to read say which calls to send again
+      if (_callsWritten > 0)
+        XmlRpcUtil::log(3, "XmlRpcClient::writeRequest: write error (%s).", XmlRpcSocket::getErrorMsg().c_str());
+      else
+        XmlRpcUtil::error("Error in XmlRpcClient::writeRequest: write error (%s).",XmlRpcSocket::getErrorMsg().c_str());
+      ok = false;
+      break;
+    }
 
-  // Try to write the request
-  if ( ! XmlRpcSocket::nbWrite(this->getfd(), _request, &_bytesWritten)) {
-    XmlRpcUtil::error("Error in XmlRpcClient::writeRequest: write error (%s).",XmlRpcSocket::getErrorMsg().c_str());
-    return false;
+    XmlRpcUtil::log(3, "XmlRpcClient::writeRequest: wrote %d of %d bytes.", _bytesWritten, request.length());
+    if (_bytesWritten < int(request.length()))
+      break;
+    ++_callsWritten;
+    _bytesWritten = 0;
   }
-    
-  XmlRpcUtil::log(3, "XmlRpcClient::writeRequest: wrote %d of %d bytes.", _bytesWritten, _request.length());
 
-  // Wait for the result
-  if (_bytesWritten == int(_request.length())) {
-    _header = "";
-    _response = "";
+  // Wait for the results
+  if (_connectionState == CONNECTING && _callsWritten > 0)
     _connectionState = READ_HEADER;
-  }
-  return true;
+  return ok;
 }
 
 
@@ -281,19 +1128,18 @@ XmlRpcClient::writeRequest()
 bool 
 XmlRpcClient::readHeader()
 {
-  // Read available data
-  if ( ! XmlRpcSocket::nbRead(this->getfd(), _header, &_eof) ||
-       (_eof && _header.length() == 0)) {
-
-    // If we haven't read any data yet and this is a keep-alive connection, the server may
-    // have timed out, so we try one more time.
-    if (getKeepOpen() && _header.length() == 0 && _sendAttempts++ == 0) {
-      XmlRpcUtil::log(4, "XmlRpcClient::readHeader: re-trying connection");
-      XmlRpcSource::close();
-      _connectionState = NO_CONNECTION;
-      _eof = false;
-      return setupConnection();
-    }
+  // Read available data. A read error ends the connection as EOF does, but
+  // responses read before it (as when a server closing a connection with
+  // requests unread resets it) are still used.
+  if ( ! readData(_header)) {
+    XmlRpcUtil::log(3, "XmlRpcClient::readHeader: read error (%s) on fd %d.",
+                    XmlRpcSocket::getErrorMsg().c_str(), getfd());
+    _eof = true;
+  }
+
+  if (_eof && _header.length() == 0) {
+    if (resendCalls())
+      return true;
 
     XmlRpcUtil::error("Error in XmlRpcClient::readHeader: error while reading header (%s) on fd %d.",
                       XmlRpcSocket::getErrorMsg().c_str(), getfd());
@@ -306,10 +1152,16 @@ XmlRpcClient::readHeader()
   char *ep = hp + _header.length();   // End of string
   char *bp = 0;                       // Start of body
   char *lp = 0;                       // Start of content-length value
+  char *tp = 0;                       // Start of content-type value
+  char *kp = 0;                       // Start of connection value
 
   for (char *cp = hp; (bp == 0) && (cp < ep); ++cp) {
     if ((ep - cp > 16) && (strncasecmp(cp, "Content-length: ", 16) == 0))
       lp = cp + 16;
+    else if ((ep - cp > 14) && (strncasecmp(cp, "Content-Type: ", 14) == 0))
+      tp = cp + 14;
+    else if ((ep - cp > 12) && (strncasecmp(cp, "Connection: ", 12) == 0))
+      kp = cp + 12;
     else if ((ep - cp > 4) && (strncmp(cp, "\r\n\r\n", 4) == 0))
       bp = cp + 4;
     else if ((ep - cp > 2) && (strncmp(cp, "\n\n", 2) == 0))
@@ -320,6 +1172,8 @@ XmlRpcClient::readHeader()
   if (bp == 0) {
     if (_eof)          // EOF in the middle of a response is an error
     {
+      if (resendCalls())
+        return true;
       XmlRpcUtil::error("Error in XmlRpcClient::readHeader: EOF while reading header");
       return false;   // Close the connection
     }
@@ -338,12 +1192,29 @@ XmlRpcClient::readHeader()
     XmlRpcUtil::error("Error in XmlRpcClient::readHeader: Invalid Content-length specified (%d).", _contentLength);
     return false;
   }
+
+  // Responses come in the order of the requests, each after its request
+  if (_callsWritten == 0) {
+    XmlRpcUtil::error("Error in XmlRpcClient::readHeader: Response before the request was sent");
+    return false;
+  }
   	
   XmlRpcUtil::log(4, "client read content length: %d", _contentLength);
 
-  // Otherwise copy non-header data to response buffer and set state to read response.
-  _response = bp;
-  _header = "";   // should parse out any interesting bits from the header (connection, etc)...
+  _binaryResponse = (tp != 0 && XmlRpcBinary::isContentType(tp));
+
+  // Whether the server closes the connection after this response, leaving any
+  // later calls written to it unanswered
+  if (strncmp(hp, "HTTP/1.0", 8) == 0 ? (kp == 0 || strncasecmp(kp, "keep-alive", 10) != 0)
+                                      : (kp != 0 && strncasecmp(kp, "close", 5) == 0))
+    _closing = true;
+
+  // Otherwise the data after the header is the start of the response. It is
+  // kept where it was read rather than copied; anything past the body is split
+  // off by readResponse.
+  _response.swap(_header);
+  _response.consume(size_t(bp - hp));
+  _header.clear();
   _connectionState = READ_RESPONSE;
   return true;    // Continue monitoring this source
 }
@@ -354,14 +1225,16 @@ XmlRpcClient::readResponse()
 {
   // If we dont have the entire response yet, read available data
   if (int(_response.length()) < _contentLength) {
-    if ( ! XmlRpcSocket::nbRead(this->getfd(), _response, &_eof)) {
-      XmlRpcUtil::error("Error in XmlRpcClient::readResponse: read error (%s).",XmlRpcSocket::getErrorMsg().c_str());
-      return false;
+    if ( ! readData(_response, size_t(_contentLength) - _response.length())) {
+      XmlRpcUtil::log(3, "XmlRpcClient::readResponse: read error (%s).", XmlRpcSocket::getErrorMsg().c_str());
+      _eof = true;
     }
 
     // If we haven't gotten the entire _response yet, return (keep reading)
     if (int(_response.length()) < _contentLength) {
       if (_eof) {
+        if (resendCalls())
+          return true;
         XmlRpcUtil::error("Error in XmlRpcClient::readResponse: EOF while reading response");
         return false;
       }
@@ -369,44 +1242,72 @@ XmlRpcClient::readResponse()
     }
   }
 
+  // Bytes read past the end of the body are the start of the next response
+  if (int(_response.length()) > _contentLength) {
+    _header.assign(_response.data() + _contentLength, _response.size() - size_t(_contentLength));
+    _response.truncate(size_t(_contentLength));
+  }
+
   // Otherwise, parse and return the result
   XmlRpcUtil::log(3, "XmlRpcClient::readResponse (read %d bytes)", _response.length());
   XmlRpcUtil::log(5, "response:\n%s", _response.c_str());
 
-  _connectionState = IDLE;
+  completeCall();
+  return true;
+}
+
+
+bool
+XmlRpcClient::readData(XmlRpcBuffer& s, size_t expected)
+{
+  return _shm ? _shm->read(s, &_eof, expected)
+              : XmlRpcSocket::nbRead(this->getfd(), s, &_eof, expected);
+}
 
-  return false;    // Stop monitoring this source (causes return from work)
+bool
+XmlRpcClient::writeData(std::string& s)
+{
+  return _shm ? _shm->write(s, &_bytesWritten)
+              : XmlRpcSocket::nbWrite(this->getfd(), s, &_bytesWritten);
 }
 
 
 // Convert the response xml into a result value
 bool 
-XmlRpcClient::parseResponse(XmlRpcValue& result)
+XmlRpcClient::parseResponse(XmlRpcValue& result, bool& isFault)
 {
+  if (_binaryResponse) {
+    bool ok = XmlRpcBinary::parseResponse(_response.view(), result, &isFault);
+    if ( ! ok)
+      XmlRpcUtil::error("Error in XmlRpcClient::parseResponse: Invalid binary response (%d bytes).", int(_response.size()));
+    _response.clear();
+    return ok && result.valid();
+  }
+
   // Parse response xml into result
-  int offset = 0;
-  if ( ! XmlRpcUtil::findTag(METHODRESPONSE_TAG,_response,&offset)) {
+  XmlRpcTokenizer tok(_response.view(), 0);
+  if ( ! tok.skipTo(XmlRpcTokenizer::MethodResponseTag)) {
     XmlRpcUtil::error("Error in XmlRpcClient::parseResponse: Invalid response - no methodResponse. Response:\n%s", _response.c_str());
     return false;
   }
 
   // Expect either <params><param>... or <fault>...
-  if ((XmlRpcUtil::nextTagIs(PARAMS_TAG,_response,&offset) &&
-       XmlRpcUtil::nextTagIs(PARAM_TAG,_response,&offset)) ||
-      (XmlRpcUtil::nextTagIs(FAULT_TAG,_response,&offset) && (_isFault = true)))
+  if ((tok.nextTagIs(XmlRpcTokenizer::ParamsTag) &&
+       tok.nextTagIs(XmlRpcTokenizer::ParamTag)) ||
+      (tok.nextTagIs(XmlRpcTokenizer::FaultTag) && (isFault = true)))
   {
-    if ( ! result.fromXml(_response, &offset)) {
+    if ( ! result.fromXml(tok)) {
       XmlRpcUtil::error("Error in XmlRpcClient::parseResponse: Invalid response value. Response:\n%s", _response.c_str());
-      _response = "";
+      _response.clear();
       return false;
     }
   } else {
     XmlRpcUtil::error("Error in XmlRpcClient::parseResponse: Invalid response - no param or fault tag. Response:\n%s", _response.c_str());
-    _response = "";
+    _response.clear();
     return false;
   }
       
-  _response = "";
+  _response.clear();
   return result.valid();
 }
 
@@ -0,0 +1,214 @@
+
+#include "XmlRpcClientPool.h"
+#include "XmlRpcClient.h"
+#include "XmlRpcUtil.h"
+
+#ifndef MAKEDEPEND
+# include <chrono>
+#endif
+
+using namespace XmlRpc;
+
+
+// Idle connections are looked over at most this often
+static const double SWEEP_SECONDS = 1.0;
+
+
+XmlRpcClientPool::XmlRpcClientPool(const char* host, int port, const char* uri/*=0*/, int maxConnections/*=16*/) :
+  _host(host), _port(port), _uri(uri ? uri : "/RPC2"),
+  _maxConnections(maxConnections > 0 ? maxConnections : 1), _slotsUsed(0)
+{
+  XmlRpcUtil::log(1, "XmlRpcClientPool new pool: host %s, port %d, %d connections.", host, port, _maxConnections);
+
+  // A slot is in use until it is first taken, by the thread that makes its client
+  _slots.reset(new Slot[_maxConnections]);
+  for (int i = 0; i < _maxConnections; ++i) {
+    _slots[i].inUse = true;
+    _slots[i].open = false;
+    _slots[i].idleSince = 0;
+    _slots[i].client = 0;
+  }
+
+  _minIdle = 1;
+  _idleTimeout = 30.0;
+  _checkInterval = 1.0;
+  _binaryEncoding = false;
+  _lastSweep = now();
+  _waiters = 0;
+}
+
+
+XmlRpcClientPool::~XmlRpcClientPool()
+{
+  for (int i = 0; i < _slotsUsed; ++i) {
+    XmlRpcClient* client = _slots[i].client;
+    if (client) {
+      client->close();
+      delete client;
+    }
+  }
+}
+
+
+// Give back the connection even if exceptions occur.
+struct ReleaseOnExit {
+  ReleaseOnExit(XmlRpcClientPool& pool, XmlRpcClient* client) : _pool(pool), _client(client) {}
+  ~ReleaseOnExit() { _pool.release(_client); }
+  XmlRpcClientPool& _pool;
+  XmlRpcClient* _client;
+};
+
+bool
+XmlRpcClientPool::execute(const char* method, XmlRpcValue const& params, XmlRpcValue& result, bool* isFault,
+                           double timeout)
+{
+  XmlRpcClient* client = acquire();
+  ReleaseOnExit release(*this, client);
+
+  bool ok = client->execute(method, params, result, timeout);
+  if (isFault)
+    *isFault = client->isFault();
+  return ok;
+}
+
+
+XmlRpcClient*
+XmlRpcClientPool::acquire()
+{
+  XmlRpcClient* client = tryAcquire();
+  if (client)
+    return client;
+
+  // All the connections are in use. Either the thread giving one back sees
+  // this one waiting, or this one sees the connection given back.
+  std::unique_lock<std::mutex> lock(_mutex);
+  _waiters.fetch_add(1);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  _released.wait(lock, [this, &client]() { return (client = tryAcquire()) != 0; });
+  _waiters.fetch_sub(1);
+  return client;
+}
+
+
+// Take an idle connection, or make a new one if the limit allows. Returns
+// null if all are in use.
+XmlRpcClient*
+XmlRpcClientPool::tryAcquire()
+{
+  // The first slots are preferred, so that when demand drops the connections
+  // at the end go idle and are closed
+  int used = _slotsUsed.load(std::memory_order_acquire);
+  for (int i = 0; i < used; ++i) {
+    Slot& slot = _slots[i];
+    bool inUse = false;
+    if (slot.inUse.load(std::memory_order_relaxed) ||
+        ! slot.inUse.compare_exchange_strong(inUse, true, std::memory_order_acquire))
+      continue;
+
+    XmlRpcClient* client = slot.client.load(std::memory_order_relaxed);
+    if (slot.open.load(std::memory_order_relaxed) &&
+        now() - slot.idleSince.load(std::memory_order_relaxed) > ticks(_checkInterval))
+      (void) client->checkConnection();
+    return client;
+  }
+
+  while (used < _maxConnections)
+    if (_slotsUsed.compare_exchange_weak(used, used + 1, std::memory_order_acq_rel)) {
+      XmlRpcUtil::log(2, "XmlRpcClientPool::tryAcquire: making connection %d.", used + 1);
+      XmlRpcClient* client = new XmlRpcClient(_host.c_str(), _port, _uri.c_str());
+      client->setBinaryEncoding(_binaryEncoding);
+      client->setSocketOptions(_socketOptions);
+      _slots[used].client.store(client, std::memory_order_release);
+      return client;
+    }
+
+  return 0;
+}
+
+
+void
+XmlRpcClientPool::release(XmlRpcClient* client)
+{
+  int used = _slotsUsed.load(std::memory_order_acquire);
+  for (int i = 0; i < used; ++i) {
+    Slot& slot = _slots[i];
+    if (slot.client.load(std::memory_order_relaxed) == client) {
+      Ticks t = now();
+      slot.open.store(client->getfd() >= 0, std::memory_order_relaxed);
+      slot.idleSince.store(t, std::memory_order_relaxed);
+      giveBack(slot);
+      sweep(t);
+      return;
+    }
+  }
+  XmlRpcUtil::error("Error in XmlRpcClientPool::release: the client is not from this pool.");
+}
+
+
+// Mark a slot idle, and wake a thread waiting for one
+void
+XmlRpcClientPool::giveBack(Slot& slot)
+{
+  slot.inUse.store(false, std::memory_order_release);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (_waiters.load(std::memory_order_relaxed) > 0) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _released.notify_one();
+  }
+}
+
+
+// Close connections beyond the minimum that have been idle past the timeout.
+// One thread at a time does this, at most every SWEEP_SECONDS.
+void
+XmlRpcClientPool::sweep(Ticks t)
+{
+  Ticks last = _lastSweep.load(std::memory_order_relaxed);
+  if (t - last < ticks(SWEEP_SECONDS) || ! _lastSweep.compare_exchange_strong(last, t))
+    return;
+
+  int open = connections();
+  Ticks timeout = ticks(_idleTimeout);
+  for (int i = _slotsUsed.load(std::memory_order_acquire) - 1; i >= 0 && open > _minIdle; --i) {
+    Slot& slot = _slots[i];
+    bool inUse = false;
+    if ( ! slot.open.load(std::memory_order_relaxed) ||
+         ! slot.inUse.compare_exchange_strong(inUse, true, std::memory_order_acquire))
+      continue;
+
+    // Check again, now that no other thread can take it
+    if (slot.open.load(std::memory_order_relaxed) &&
+        t - slot.idleSince.load(std::memory_order_relaxed) > timeout) {
+      XmlRpcUtil::log(2, "XmlRpcClientPool::sweep: closing idle connection %d.", i + 1);
+      slot.client.load(std::memory_order_relaxed)->close();
+      slot.open.store(false, std::memory_order_relaxed);
+      --open;
+    }
+    giveBack(slot);
+  }
+}
+
+
+int
+XmlRpcClientPool::connections() const
+{
+  int open = 0;
+  int used = _slotsUsed.load(std::memory_order_acquire);
+  for (int i = 0; i < used; ++i)
+    if (_slots[i].open.load(std::memory_order_relaxed))
+      ++open;
+  return open;
+}
+
+
+XmlRpcClientPool::Ticks
+XmlRpcClientPool::now()
+{
+  return std::chrono::steady_clock::now().time_since_epoch().count();
+}
+
+XmlRpcClientPool::Ticks
+XmlRpcClientPool::ticks(double seconds)
+{
+  return std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(seconds)).count();
+}
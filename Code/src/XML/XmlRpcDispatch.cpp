@@ -49,7 +49,13 @@ XmlRpcDispatch::removeSource(XmlRpcSource* source)
   for (SourceList::iterator it=_sources.begin(); it!=_sources.end(); ++it)
     if (it->getSource() == source)
     {
-      _sources.erase(it);
+      // A source may be removed by an event handler (its own or another's)
+      // while work() is going through the list, so then it is only marked,
+      // and work() erases it.
+      if (_inWork)
+        it->_src = 0;
+      else
+        _sources.erase(it);
       break;
     }
 }
@@ -67,6 +73,18 @@ XmlRpcDispatch::setSourceEvents(XmlRpcSource* source, unsigned eventMask)
     }
 }
 
+// Report TimeoutEvent to this source after the specified time
+void
+XmlRpcDispatch::setSourceWakeup(XmlRpcSource* source, double seconds)
+{
+  for (SourceList::iterator it=_sources.begin(); it!=_sources.end(); ++it)
+    if (it->getSource() == source)
+    {
+      it->getWakeTime() = (seconds < 0.0) ? -1.0 : (getTime() + seconds);
+      break;
+    }
+}
+
 
 
 // Watch current set of sources and process events
@@ -88,24 +106,36 @@ XmlRpcDispatch::work(double timeout)
 	  FD_ZERO(&excFd);
 
     int maxFd = -1;     // Not used on windows
+    double wakeTime = -1.0;
     SourceList::iterator it;
     for (it=_sources.begin(); it!=_sources.end(); ++it) {
+      if ( ! it->getSource()) continue;
       int fd = it->getSource()->getfd();
       if (it->getMask() & ReadableEvent) FD_SET(fd, &inFd);
       if (it->getMask() & WritableEvent) FD_SET(fd, &outFd);
       if (it->getMask() & Exception)     FD_SET(fd, &excFd);
       if (it->getMask() && fd > maxFd)   maxFd = fd;
+      if (it->getWakeTime() >= 0.0 && (wakeTime < 0.0 || it->getWakeTime() < wakeTime))
+        wakeTime = it->getWakeTime();
+    }
+
+    // Wait no longer than until the first wakeup
+    double wait = timeout;
+    if (wakeTime >= 0.0) {
+      double untilWake = wakeTime - getTime();
+      if (untilWake < 0.0) untilWake = 0.0;
+      if (wait < 0.0 || untilWake < wait) wait = untilWake;
     }
 
     // Check for events
     int nEvents;
-    if (timeout < 0.0)
+    if (wait < 0.0)
       nEvents = select(maxFd+1, &inFd, &outFd, &excFd, NULL);
     else 
     {
       struct timeval tv;
-      tv.tv_sec = (int)floor(timeout);
-      tv.tv_usec = ((int)floor(1000000.0 * (timeout-floor(timeout)))) % 1000000;
+      tv.tv_sec = (int)floor(wait);
+      tv.tv_usec = ((int)floor(1000000.0 * (wait-floor(wait)))) % 1000000;
       nEvents = select(maxFd+1, &inFd, &outFd, &excFd, &tv);
     }
 
@@ -117,28 +147,46 @@ XmlRpcDispatch::work(double timeout)
     }
 
     // Process events
+    double now = (wakeTime >= 0.0) ? getTime() : 0.0;
     for (it=_sources.begin(); it != _sources.end(); )
     {
       SourceList::iterator thisIt = it++;
       XmlRpcSource* src = thisIt->getSource();
+      if ( ! src) {
+        _sources.erase(thisIt);   // Removed since the descriptors were collected
+        continue;
+      }
       int fd = src->getfd();
       unsigned newMask = (unsigned) -1;
-      if (fd <= maxFd) {
+
+      // A wakeup is reported first, as its handler may write, and the events
+      // reported after it then say what is still to be done
+      double& wake = thisIt->getWakeTime();
+      if (wake >= 0.0 && wake <= now) {
+        wake = -1.0;
+        newMask &= src->handleEvent(TimeoutEvent);
+      }
+
+      if (fd >= 0 && fd <= maxFd && thisIt->getSource()) {
         // If you select on multiple event types this could be ambiguous
         if (FD_ISSET(fd, &inFd))
           newMask &= src->handleEvent(ReadableEvent);
-        if (FD_ISSET(fd, &outFd))
+        if (thisIt->getSource() && FD_ISSET(fd, &outFd))
           newMask &= src->handleEvent(WritableEvent);
-        if (FD_ISSET(fd, &excFd))
+        if (thisIt->getSource() && FD_ISSET(fd, &excFd))
           newMask &= src->handleEvent(Exception);
+      }
 
-        if ( ! newMask) {
-          _sources.erase(thisIt);  // Stop monitoring this one
-          if ( ! src->getKeepOpen())
-            src->close();
-        } else if (newMask != (unsigned) -1) {
-          thisIt->getMask() = newMask;
-        }
+      if ( ! thisIt->getSource()) {
+        _sources.erase(thisIt);   // Removed by a handler, which is left to close it
+      } else if ( ! newMask && wake >= 0.0) {
+        thisIt->getMask() = 0;    // Nothing to watch for until the wakeup
+      } else if ( ! newMask) {
+        _sources.erase(thisIt);  // Stop monitoring this one
+        if ( ! src->getKeepOpen())
+          src->close();
+      } else if (newMask != (unsigned) -1) {
+        thisIt->getMask() = newMask;
       }
     }
 
@@ -149,7 +197,7 @@ XmlRpcDispatch::work(double timeout)
       _sources.clear();
       for (SourceList::iterator it=closeList.begin(); it!=closeList.end(); ++it) {
 	XmlRpcSource *src = it->getSource();
-        src->close();
+        if (src) src->close();
       }
 
       _doClear = false;
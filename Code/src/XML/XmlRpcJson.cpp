@@ -0,0 +1,111 @@
+
+#include "XmlRpcJson.h"
+
+#ifndef MAKEDEPEND
+# include <string.h>
+# include <strings.h>
+#endif
+
+using namespace XmlRpc;
+
+
+const char XmlRpcJson::CONTENT_TYPE[] = "application/json";
+
+static const XmlRpcName JSONRPC("jsonrpc");
+static const XmlRpcName METHOD("method");
+static const XmlRpcName PARAMS("params");
+static const XmlRpcName ID("id");
+
+static const char RESPONSE_BEGIN[] = "{\"jsonrpc\":\"2.0\",";
+
+
+bool
+XmlRpcJson::isContentType(const char* value)
+{
+  size_t n = sizeof(CONTENT_TYPE) - 1;
+  return strncasecmp(value, CONTENT_TYPE, n) == 0 &&
+         (value[n] == 0 || strchr(";\r\n \t", value[n]) != 0);
+}
+
+
+bool
+XmlRpcJson::parse(std::string_view text, XmlRpcValue& value)
+{
+  const char* cp = text.data();
+  const char* end = cp + text.size();
+  if ( ! value.fromJson(cp, end))
+    return false;
+
+  while (cp < end && (*cp == ' ' || *cp == '\t' || *cp == '\n' || *cp == '\r'))
+    ++cp;
+  return cp == end;
+}
+
+
+bool
+XmlRpcJson::parseCall(XmlRpcValue const& request, std::string& methodName, XmlRpcValue& params,
+                      XmlRpcValue& id, bool* notification)
+{
+  id.clear();
+  *notification = false;
+  if (request.getType() != XmlRpcValue::TypeStruct)
+    return false;
+
+  // The id is echoed in the response, so it is found first
+  XmlRpcValue const* idValue = request.find(ID.view());
+  if (idValue) {
+    XmlRpcValue::Type t = idValue->getType();
+    if (t != XmlRpcValue::TypeString && t != XmlRpcValue::TypeInt &&
+        t != XmlRpcValue::TypeDouble && t != XmlRpcValue::TypeInvalid)
+      return false;
+    id = *idValue;
+  } else
+    *notification = true;
+
+  XmlRpcValue const* version = request.find(JSONRPC.view());
+  std::string const* v = version ? version->tryGet<std::string>() : 0;
+  XmlRpcValue const* method = request.find(METHOD.view());
+  std::string const* name = method ? method->tryGet<std::string>() : 0;
+  if ( ! v || *v != "2.0" || ! name)
+    return false;
+  methodName = *name;
+
+  XmlRpcValue const* p = request.find(PARAMS.view());
+  if ( ! p) {
+    params.clear();
+    params.setSize(0);
+  } else if (p->getType() == XmlRpcValue::TypeArray)
+    params = *p;
+  else if (p->getType() == XmlRpcValue::TypeStruct) {
+    params.clear();
+    params[0] = *p;
+  } else
+    return false;
+  return true;
+}
+
+
+void
+XmlRpcJson::appendResult(std::string& body, XmlRpcValue const& result, XmlRpcValue const& id)
+{
+  body += RESPONSE_BEGIN;
+  body += "\"result\":";
+  result.appendJson(body);
+  body += ",\"id\":";
+  id.appendJson(body);
+  body += '}';
+}
+
+
+void
+XmlRpcJson::appendError(std::string& body, int code, std::string const& message, XmlRpcValue const& id)
+{
+  body += RESPONSE_BEGIN;
+  body += "\"error\":{\"code\":";
+  XmlRpcValue(code).appendJson(body);
+  body += ",\"message\":";
+  XmlRpcValue(message).appendJson(body);
+  body += "},\"id\":";
+  id.appendJson(body);
+  body += '}';
+}
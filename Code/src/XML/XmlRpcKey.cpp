@@ -0,0 +1,148 @@
+
+#include "XmlRpcKey.h"
+
+#ifndef MAKEDEPEND
+# include <atomic>
+# include <mutex>
+# include <string.h>
+#endif
+
+using namespace XmlRpc;
+
+
+// Intern table limits. Names come from clients, so the table is bounded.
+static const size_t TABLE_SLOTS = 4096;        // power of 2
+static const size_t MAX_NAMES = TABLE_SLOTS / 2;
+static const size_t MAX_NAME_LENGTH = 64;
+
+
+namespace {
+  // An interned name. Entries are never freed.
+  struct Entry {
+    uint32_t hash;
+    uint32_t size;
+    char name[MAX_NAME_LENGTH + 1];
+  };
+
+  // Open-addressed table. Slots are filled once, under the mutex, and read
+  // without locking.
+  struct InternTable {
+    std::atomic<const Entry*> slots[TABLE_SLOTS];
+    std::mutex insertMutex;
+    size_t count;
+  };
+}
+
+// 32-bit FNV-1a hash, to place names in the table
+static uint32_t hashName(std::string_view name)
+{
+  uint32_t h = 2166136261u;
+  for (size_t i = 0; i < name.size(); ++i)
+    h = (h ^ (unsigned char) name[i]) * 16777619u;
+  return h;
+}
+
+static InternTable& internTable()
+{
+  static InternTable table;   // zero-initialized before first use
+  return table;
+}
+
+// Find a name in the table, or return the empty slot where it would go
+static const Entry* probe(InternTable& table, std::string_view name, uint32_t hash, size_t* emptySlot)
+{
+  for (size_t i = hash & (TABLE_SLOTS - 1); ; i = (i + 1) & (TABLE_SLOTS - 1)) {
+    const Entry* e = table.slots[i].load(std::memory_order_acquire);
+    if ( ! e) {
+      *emptySlot = i;
+      return 0;
+    }
+    if (e->hash == hash && e->size == name.size() && memcmp(e->name, name.data(), name.size()) == 0)
+      return e;
+  }
+}
+
+// Return the interned text for name, adding it if there is room, or null
+static const char* intern(std::string_view name)
+{
+  if (name.size() > MAX_NAME_LENGTH)
+    return 0;
+
+  uint32_t hash = hashName(name);
+  InternTable& table = internTable();
+  size_t slot;
+  const Entry* e = probe(table, name, hash, &slot);
+  if (e) return e->name;
+
+  std::lock_guard<std::mutex> lock(table.insertMutex);
+  e = probe(table, name, hash, &slot);    // Another thread may have added it
+  if (e) return e->name;
+  if (table.count >= MAX_NAMES)
+    return 0;
+
+  Entry* entry = new Entry;
+  entry->hash = hash;
+  entry->size = uint32_t(name.size());
+  memcpy(entry->name, name.data(), name.size());
+  entry->name[name.size()] = 0;
+  table.slots[slot].store(entry, std::memory_order_release);
+  ++table.count;
+  return entry->name;
+}
+
+static const char* copyName(const char* data, size_t size)
+{
+  char* copy = new char[size + 1];
+  memcpy(copy, data, size);
+  copy[size] = 0;
+  return copy;
+}
+
+
+XmlRpcKey::XmlRpcKey(std::string_view name) :
+  _size(uint32_t(name.size())), _owned(false)
+{
+  _data = intern(name);
+  if ( ! _data) {
+    _data = copyName(name.data(), name.size());
+    _owned = true;
+  }
+}
+
+XmlRpcKey::XmlRpcKey(XmlRpcKey const& rhs) :
+  _data(rhs._data), _size(rhs._size), _owned(rhs._owned)
+{
+  if (_owned)
+    _data = copyName(rhs._data, rhs._size);
+}
+
+XmlRpcKey&
+XmlRpcKey::operator=(XmlRpcKey const& rhs)
+{
+  if (this != &rhs) {
+    XmlRpcKey copy(rhs);
+    *this = std::move(copy);
+  }
+  return *this;
+}
+
+XmlRpcKey&
+XmlRpcKey::operator=(XmlRpcKey&& rhs) noexcept
+{
+  if (this != &rhs) {
+    if (_owned) delete [] _data;
+    _data = rhs._data;
+    _size = rhs._size;
+    _owned = rhs._owned;
+    rhs._owned = false;
+  }
+  return *this;
+}
+
+size_t
+XmlRpcKey::internedCount()
+{
+  InternTable& table = internTable();
+  std::lock_guard<std::mutex> lock(table.insertMutex);
+  return table.count;
+}
@@ -0,0 +1,386 @@
+
+#include "XmlRpcRequestParser.h"
+#include "XmlRpcSchema.h"
+#include "XmlRpcTokenizer.h"
+#include "XmlRpcUtil.h"
+
+using namespace XmlRpc;
+
+
+XmlRpcRequestParser::XmlRpcRequestParser()
+{
+  reset();
+}
+
+
+void
+XmlRpcRequestParser::reset()
+{
+  _status = NeedMore;
+  _state = MethodName;
+  _xml = std::string_view();
+  _offset = 0;
+  _scanFrom = 0;
+  _methodName.clear();
+  _params.clear();
+  _nParams = 0;
+  _target = 0;
+  _frames.clear();
+  _repeated.clear();
+  _schema = 0;
+  _expect = -1;
+  _fault.clear();
+}
+
+
+// Run steps until the data runs out. A step either consumes a complete unit of
+// the request or nothing at all, so it can simply be retried when more arrives.
+XmlRpcRequestParser::Status
+XmlRpcRequestParser::parse(std::string_view xml)
+{
+  if (_status != NeedMore)
+    return _status;
+
+  _xml = xml;
+  XmlRpcTokenizer tok(xml, _offset);
+  for (;;) {
+    const char* start = tok.position();
+    Step s = step(tok);
+    if (s == Wait) {
+      tok.setPosition(start);
+      break;
+    }
+    if (s == Fail) {
+      XmlRpcUtil::log(3, "XmlRpcRequestParser::parse: unexpected input at offset %d.", int(start - xml.data()));
+      _status = Failed;
+      break;
+    }
+    if (s == Reject) {
+      XmlRpcUtil::log(3, "XmlRpcRequestParser::parse: %s", _fault.c_str());
+      _status = Invalid;
+      break;
+    }
+    if (_state == Finished) {
+      _status = Done;
+      break;
+    }
+  }
+
+  _offset = tok.offset();
+  _xml = std::string_view();
+  return _status;
+}
+
+
+XmlRpcRequestParser::Step
+XmlRpcRequestParser::step(XmlRpcTokenizer& tok)
+{
+  int tag;
+  const char *textStart, *textEnd;
+
+  switch (_state) {
+    case MethodName:
+      if ( ! tok.skipTo(XmlRpcTokenizer::MethodNameTag) || ! tok.text(&textStart, &textEnd))
+        return Wait;
+      tag = tok.nextTag();
+      if (tag == XmlRpcTokenizer::EndOfInput) return Wait;
+      if (tag != (XmlRpcTokenizer::MethodNameTag | XmlRpcTokenizer::EndTag) || textStart == textEnd)
+        return Fail;
+      _methodName.assign(textStart, textEnd);
+      _schema = _lookup ? _lookup(_methodName) : 0;
+      _state = AfterMethodName;
+      return Advanced;
+
+    // Look for the params, or the end of a call that has none
+    case AfterMethodName:
+      tag = tok.nextTag();
+      if (tag == XmlRpcTokenizer::EndOfInput) return Wait;
+      if (tag == XmlRpcTokenizer::ParamsTag)
+        _state = NextParam;
+      else if (tag == (XmlRpcTokenizer::MethodCallTag | XmlRpcTokenizer::EndTag))
+        return finish(tok.position());
+      else if (tag == XmlRpcTokenizer::NoTag && ! tok.text(&textStart, &textEnd))
+        return Wait;
+      return Advanced;
+
+    case NextParam:
+      tag = tok.nextTag();
+      if (tag == XmlRpcTokenizer::EndOfInput) return Wait;
+      if (tag == XmlRpcTokenizer::ParamTag) {
+        _params.setSize(_nParams+1);
+        _target = &_params[_nParams++];
+        if (_schema) {
+          _expect = _schema->param(_nParams-1);
+          if (_expect < 0)
+            return reject(tok.position(), 0, _target, "unexpected param, expected " +
+                          std::to_string(_schema->params()) + " params");
+        }
+        _state = ValueStart;
+        return Advanced;
+      }
+      return finish(tok.position());    // </params>
+
+    case EndParam:
+      tag = tok.peekTag();
+      if (tag == XmlRpcTokenizer::EndOfInput) return Wait;
+      if (tag == (XmlRpcTokenizer::ParamTag | XmlRpcTokenizer::EndTag))
+        (void) tok.nextTag();
+      _state = NextParam;
+      return Advanced;
+
+    case ValueStart:
+      return valueStart(tok);
+
+    case ArrayData:
+      tag = tok.nextTag();
+      if (tag == XmlRpcTokenizer::EndOfInput) return Wait;
+      if (tag != XmlRpcTokenizer::DataTag) return Fail;
+      _state = ArrayItems;
+      return Advanced;
+
+    case ArrayItems:
+      tag = tok.peekTag();
+      if (tag == XmlRpcTokenizer::EndOfInput) return Wait;
+      if (tag == XmlRpcTokenizer::ValueTag) {
+        Frame& frame = _frames.back();
+        XmlRpcValue::ValueArray& elements = frame.value->mutableArray();
+        elements.push_back(XmlRpcValue());
+        _target = &elements.back();
+        _expect = (frame.node < 0) ? -1 : _schema->node(frame.node).element;
+        _state = ValueStart;
+      } else if (tag == (XmlRpcTokenizer::DataTag | XmlRpcTokenizer::EndTag)) {
+        (void) tok.nextTag();
+        _state = CloseValue;
+      } else
+        return Fail;
+      return Advanced;
+
+    case StructMembers:
+      tag = tok.peekTag();
+      if (tag == XmlRpcTokenizer::EndOfInput) return Wait;
+      if (tag == XmlRpcTokenizer::MemberTag) {
+        (void) tok.nextTag();
+        _state = MemberName;
+      } else
+        _state = CloseValue;
+      return Advanced;
+
+    case MemberName:
+      {
+        tag = tok.nextTag();
+        if (tag == XmlRpcTokenizer::EndOfInput) return Wait;
+        if (tag != XmlRpcTokenizer::NameTag) return Fail;
+        if ( ! tok.text(&textStart, &textEnd)) return Wait;
+        tag = tok.nextTag();
+        if (tag == XmlRpcTokenizer::EndOfInput) return Wait;
+        if (tag != (XmlRpcTokenizer::NameTag | XmlRpcTokenizer::EndTag)) return Fail;
+
+        std::string name;
+        XmlRpcUtil::xmlDecode(textStart, size_t(textEnd - textStart), name);
+        Frame& frame = _frames.back();
+        std::pair<XmlRpcValue::ValueStruct::iterator, bool> member =
+          frame.value->mutableStruct().try_emplace(XmlRpcKey(name));
+        if (member.second) {
+          _target = &member.first->second;
+        } else {
+          _repeated.emplace_back();
+          _target = &_repeated.back();
+        }
+        _expect = -1;
+        if (frame.node >= 0) {
+          XmlRpcSchema::Member const* m = _schema->member(frame.node, name);
+          if (m) {
+            _expect = m->node;
+            // Members past the first 64 have no bit and aren't counted, so a
+            // struct with one of them required is checked member by member
+            // when it closes
+            size_t index = size_t(m - &_schema->node(frame.node).members[0]);
+            uint64_t bit = (index < 64) ? (uint64_t(1) << index) : 0;
+            if ( ! m->optional && bit && ! (frame.seen & bit)) {
+              frame.seen |= bit;
+              ++frame.required;
+            }
+          }
+        }
+        _state = ValueStart;
+        return Advanced;
+      }
+
+    case EndMember:
+      tag = tok.peekTag();
+      if (tag == XmlRpcTokenizer::EndOfInput) return Wait;
+      if (tag == (XmlRpcTokenizer::MemberTag | XmlRpcTokenizer::EndTag))
+        (void) tok.nextTag();
+      _state = StructMembers;
+      return Advanced;
+
+    // Skip to the </value> that closes the innermost array or struct
+    case CloseValue:
+      tag = tok.nextTag();
+      if (tag == XmlRpcTokenizer::EndOfInput) return Wait;
+      if (tag == (XmlRpcTokenizer::ValueTag | XmlRpcTokenizer::EndTag)) {
+        Frame const& frame = _frames.back();
+        if (frame.node >= 0 && frame.required < _schema->node(frame.node).required) {
+          for (auto const& m : _schema->node(frame.node).members)
+            if ( ! m.optional && ! frame.value->find(m.name))
+              return reject(tok.position(), _frames.size() - 1, frame.value, "missing member '" + m.name + "'");
+        }
+        _frames.pop_back();
+        return valueDone();
+      }
+      if (tag == XmlRpcTokenizer::NoTag && ! tok.text(&textStart, &textEnd))
+        return Wait;
+      return Advanced;
+
+    case Finished:
+      break;
+  }
+  return Fail;
+}
+
+
+// Begin a value. Arrays and structs are opened and their elements parsed in later
+// steps; scalars are decoded in one go once their </value> has arrived.
+XmlRpcRequestParser::Step
+XmlRpcRequestParser::valueStart(XmlRpcTokenizer& tok)
+{
+  const char* start = tok.position();
+  int tag = tok.nextTag();
+  if (tag == XmlRpcTokenizer::EndOfInput) return Wait;
+  if (tag != XmlRpcTokenizer::ValueTag) return Fail;
+
+  tag = tok.nextTag();
+  if (tag == XmlRpcTokenizer::EndOfInput) return Wait;
+  if (tag == XmlRpcTokenizer::ArrayTag) {
+    if ( ! accepts(XmlRpcValue::TypeArray))
+      return reject(start, _frames.size(), _target, std::string("expected ") +
+                    XmlRpcSchema::typeName(_schema->node(_expect).type) + ", got array");
+    _target->clear();
+    _target->setSize(0);
+    _frames.push_back(Frame{ _target, tag, _expect, 0, 0 });
+    _state = ArrayData;
+    return Advanced;
+  }
+  if (tag == XmlRpcTokenizer::StructTag) {
+    if ( ! accepts(XmlRpcValue::TypeStruct))
+      return reject(start, _frames.size(), _target, std::string("expected ") +
+                    XmlRpcSchema::typeName(_schema->node(_expect).type) + ", got struct");
+    _target->clear();
+    _target->assertStruct();
+    _frames.push_back(Frame{ _target, tag, _expect, 0, 0 });
+    _state = StructMembers;
+    return Advanced;
+  }
+
+  tok.setPosition(start);
+  if ( ! scalarComplete(tok))
+    return Wait;
+  if ( ! _target->fromXml(tok))
+    return Fail;
+  if ( ! accepts(_target->getType()))
+    return reject(start, _frames.size(), _target, std::string("expected ") +
+                  XmlRpcSchema::typeName(_schema->node(_expect).type) + ", got " +
+                  XmlRpcSchema::typeName(_target->getType()));
+  return valueDone();
+}
+
+
+// After a value, carry on with the array, struct or param that contains it
+XmlRpcRequestParser::Step
+XmlRpcRequestParser::valueDone()
+{
+  if (_frames.empty())
+    _state = EndParam;
+  else if (_frames.back().tag == XmlRpcTokenizer::ArrayTag)
+    _state = ArrayItems;
+  else
+    _state = EndMember;
+  return Advanced;
+}
+
+
+// Check whether the </value> of the scalar at the tokenizer position has arrived.
+// The search resumes where the previous attempt for the same value gave up.
+bool
+XmlRpcRequestParser::scalarComplete(XmlRpcTokenizer const& tok)
+{
+  size_t start = size_t(tok.offset());
+  size_t from = (_scanFrom > start) ? _scanFrom : start;
+
+  XmlRpcTokenizer probe(_xml.data() + from, _xml.data() + _xml.size());
+  if (probe.skipTo(XmlRpcTokenizer::ValueTag | XmlRpcTokenizer::EndTag)) {
+    _scanFrom = 0;
+    return true;
+  }
+
+  // Resume at a tag that is cut off at the end of the data, or else at the end
+  _scanFrom = _xml.size();
+  for (size_t i = _xml.size(); i > from; --i) {
+    char c = _xml[i - 1];
+    if (c == '>') break;
+    if (c == '<') {
+      _scanFrom = i - 1;
+      break;
+    }
+  }
+  return false;
+}
+
+
+// The params have ended; check none are missing
+XmlRpcRequestParser::Step
+XmlRpcRequestParser::finish(const char* at)
+{
+  if (_schema && _nParams < _schema->params()) {
+    _fault = _methodName + ": invalid params at offset " + std::to_string(at - _xml.data()) +
+             ": expected " + std::to_string(_schema->params()) + " params, got " + std::to_string(_nParams);
+    return Reject;
+  }
+  _state = Finished;
+  return Advanced;
+}
+
+
+bool
+XmlRpcRequestParser::accepts(XmlRpcValue::Type type) const
+{
+  return ! _schema || _schema->accepts(_expect, type);
+}
+
+
+XmlRpcRequestParser::Step
+XmlRpcRequestParser::reject(const char* at, size_t depth, XmlRpcValue const* value, std::string const& what)
+{
+  _fault = _methodName + ": invalid params at offset " + std::to_string(at - _xml.data()) + ": " +
+           path(depth, value) + ": " + what;
+  return Reject;
+}
+
+
+// Describe where a value is, as in "param 1.names[2]". The value is nested in
+// the first depth frames; the path is only worked out when reporting an error.
+std::string
+XmlRpcRequestParser::path(size_t depth, XmlRpcValue const* value) const
+{
+  std::string p = "param " + std::to_string(_nParams);
+  for (size_t i = 0; i < depth; ++i) {
+    XmlRpcValue const* child = (i + 1 < depth) ? _frames[i + 1].value : value;
+    XmlRpcValue const* container = _frames[i].value;
+
+    if (_frames[i].tag == XmlRpcTokenizer::ArrayTag) {
+      XmlRpcValue::ValueArray const* elements = container->tryGet<XmlRpcValue::ValueArray>();
+      if (elements && ! elements->empty())
+        p += "[" + std::to_string(child - &(*elements)[0]) + "]";
+    } else {
+      XmlRpcValue::ValueStruct const* members = container->tryGet<XmlRpcValue::ValueStruct>();
+      if (members)
+        for (auto const& m : *members)
+          if (&m.second == child) {
+            p += ".";
+            p.append(m.first.data(), m.first.size());
+            break;
+          }
+    }
+  }
+  return p;
+}
@@ -0,0 +1,172 @@
+
+#include "XmlRpcResolver.h"
+#include "XmlRpcUtil.h"
+
+#ifndef MAKEDEPEND
+# include <condition_variable>
+# include <deque>
+# include <map>
+# include <mutex>
+# include <thread>
+#endif
+
+using namespace XmlRpc;
+
+
+// Time before a failed lookup of a host with a cached address is tried again
+static const double RETRY_SECONDS = 5.0;
+
+
+// A host:port and what is known of its address
+namespace {
+  struct Entry {
+    std::string host;
+    int port;
+    XmlRpcSocket::Address address;      // length 0 until resolved
+    XmlRpcResolver::Clock::time_point expires;
+    bool pending;                       // Queued or being looked up
+  };
+}
+
+struct XmlRpcResolver::State {
+  std::mutex mutex;
+  std::condition_variable queued;       // A lookup was queued, or stop was set
+  std::condition_variable done;         // A lookup finished
+  std::map<std::string, Entry> entries;
+  std::deque<std::string> queue;
+  double ttl;
+  bool stop;
+};
+
+
+static XmlRpcResolver::Clock::time_point after(double seconds)
+{
+  return XmlRpcResolver::Clock::now() +
+    std::chrono::duration_cast<XmlRpcResolver::Clock::duration>(std::chrono::duration<double>(seconds));
+}
+
+
+XmlRpcResolver::XmlRpcResolver() : _state(std::make_shared<State>())
+{
+  _state->ttl = DEFAULT_TTL;
+  _state->stop = false;
+  std::thread(work, _state).detach();
+}
+
+
+XmlRpcResolver::~XmlRpcResolver()
+{
+  {
+    std::lock_guard<std::mutex> lock(_state->mutex);
+    _state->stop = true;
+  }
+  _state->queued.notify_all();
+  _state->done.notify_all();
+}
+
+
+XmlRpcResolver&
+XmlRpcResolver::shared()
+{
+  static XmlRpcResolver resolver;
+  return resolver;
+}
+
+
+void
+XmlRpcResolver::setTtl(double seconds)
+{
+  std::lock_guard<std::mutex> lock(_state->mutex);
+  _state->ttl = seconds;
+}
+
+
+double
+XmlRpcResolver::ttl() const
+{
+  std::lock_guard<std::mutex> lock(_state->mutex);
+  return _state->ttl;
+}
+
+
+bool
+XmlRpcResolver::resolve(std::string const& host, int port, XmlRpcSocket::Address* address,
+                        Clock::time_point* expires)
+{
+  if (XmlRpcSocket::numericAddress(host, port, address)) {
+    *expires = Clock::time_point::max();
+    return true;
+  }
+
+  std::string key = host + ':' + std::to_string(port);
+  std::unique_lock<std::mutex> lock(_state->mutex);
+  std::map<std::string, Entry>::iterator it = _state->entries.find(key);
+  if (it == _state->entries.end()) {
+    Entry entry;
+    entry.host = host;
+    entry.port = port;
+    entry.pending = false;
+    it = _state->entries.insert(std::make_pair(key, entry)).first;
+  }
+  Entry& entry = it->second;    // Entries are never erased
+
+  bool resolved = entry.address.length > 0;
+  if ( ! entry.pending && ( ! resolved || Clock::now() >= entry.expires)) {
+    entry.pending = true;
+    _state->queue.push_back(key);
+    _state->queued.notify_one();
+  }
+
+  // Only a host never resolved has to wait for the lookup
+  if ( ! resolved) {
+    XmlRpcUtil::log(3, "XmlRpcResolver::resolve: waiting for the lookup of %s.", host.c_str());
+    _state->done.wait(lock, [this, &entry]() { return ! entry.pending || _state->stop; });
+    if (entry.address.length == 0)
+      return false;
+  }
+
+  *address = entry.address;
+  *expires = entry.expires;
+  return true;
+}
+
+
+void
+XmlRpcResolver::work(std::shared_ptr<State> state)
+{
+  for (;;) {
+    std::string host;
+    int port;
+    std::string key;
+    {
+      std::unique_lock<std::mutex> lock(state->mutex);
+      state->queued.wait(lock, [&state]() { return state->stop || ! state->queue.empty(); });
+      if (state->stop) return;
+      key = state->queue.front();
+      state->queue.pop_front();
+      Entry const& entry = state->entries[key];
+      host = entry.host;
+      port = entry.port;
+    }
+
+    XmlRpcSocket::Address address;
+    bool ok = XmlRpcSocket::resolve(host, port, &address);
+
+    {
+      std::lock_guard<std::mutex> lock(state->mutex);
+      if (state->stop) return;
+      Entry& entry = state->entries[key];
+      entry.pending = false;
+      if (ok) {
+        entry.address = address;
+        entry.expires = after(state->ttl);
+      } else if (entry.address.length > 0) {
+        // Keep using the old address for now
+        XmlRpcUtil::log(1, "XmlRpcResolver: could not look up %s; keeping the old address.", host.c_str());
+        entry.expires = after(RETRY_SECONDS < state->ttl ? RETRY_SECONDS : state->ttl);
+      } else
+        XmlRpcUtil::log(1, "XmlRpcResolver: could not look up %s.", host.c_str());
+    }
+    state->done.notify_all();
+  }
+}
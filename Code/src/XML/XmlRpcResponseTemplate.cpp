@@ -0,0 +1,114 @@
+
+#include "XmlRpcResponseTemplate.h"
+#include "XmlRpcServerConnection.h"
+#include "XmlRpcUtil.h"
+
+#ifndef MAKEDEPEND
+# include <stdlib.h>
+# include <string.h>
+#endif
+
+using namespace XmlRpc;
+
+
+// A slot is a string value holding its number between ESC chars, which can't
+// occur in xml text and so can't be mistaken for data.
+static const char SLOT_MARK = '\x1b';
+static const char SLOT_BEGIN[] = "<value>\x1b";
+static const char SLOT_END[] = "\x1b</value>";
+
+
+XmlRpcResponseTemplate::Arg::Arg(const char* s) : _type(XmlRpcValue::TypeString)
+{
+  _u.asString.data = s;
+  _u.asString.size = strlen(s);
+}
+
+
+// Scalars are written by a temporary value, so they come out exactly as the
+// value itself would write them; strings are encoded here to avoid a copy.
+void
+XmlRpcResponseTemplate::Arg::appendXml(std::string& xml) const
+{
+  switch (_type) {
+    case XmlRpcValue::TypeInt:     XmlRpcValue(_u.asInt).appendXml(xml); break;
+    case XmlRpcValue::TypeBoolean: XmlRpcValue(_u.asBool).appendXml(xml); break;
+    case XmlRpcValue::TypeDouble:  XmlRpcValue(_u.asDouble).appendXml(xml); break;
+    case XmlRpcValue::TypeString:
+      xml += "<value>";
+      XmlRpcUtil::xmlEncode(_u.asString.data, _u.asString.size, xml);
+      xml += "</value>";
+      break;
+    default:
+      _u.asValue->appendXml(xml);
+      break;
+  }
+}
+
+
+XmlRpcValue
+XmlRpcResponseTemplate::slot(int n)
+{
+  std::string mark(1, SLOT_MARK);
+  mark += std::to_string(n);
+  mark += SLOT_MARK;
+  return XmlRpcValue(mark);
+}
+
+
+XmlRpcResponseTemplate::XmlRpcResponseTemplate(XmlRpcValue const& shape, Kind kind) : _slots(0)
+{
+  if (kind == Result)
+    _xml = XmlRpcServerConnection::RESPONSE_PREFIX;
+  else if (kind == Fault)
+    _xml = XmlRpcServerConnection::FAULT_PREFIX;
+  shape.appendXml(_xml);
+  if (kind == Result)
+    _xml += XmlRpcServerConnection::RESPONSE_SUFFIX;
+  else if (kind == Fault)
+    _xml += XmlRpcServerConnection::FAULT_SUFFIX;
+
+  // Cut the xml at each slot, dropping the slot's own xml
+  std::string constant;
+  size_t from = 0;
+  for (;;) {
+    size_t begin = _xml.find(SLOT_BEGIN, from);
+    size_t end = (begin == std::string::npos) ? begin : _xml.find(SLOT_END, begin);
+    if (end == std::string::npos) {
+      _parts.push_back(Part{ constant.size(), _xml.size() - from, -1 });
+      constant.append(_xml, from, std::string::npos);
+      break;
+    }
+
+    size_t digits = begin + sizeof(SLOT_BEGIN) - 1;
+    int n = atoi(_xml.c_str() + digits);
+    _parts.push_back(Part{ constant.size(), begin - from, n });
+    constant.append(_xml, from, begin - from);
+    if (n >= _slots) _slots = n + 1;
+    from = end + sizeof(SLOT_END) - 1;
+  }
+
+  _xml.swap(constant);
+}
+
+
+void
+XmlRpcResponseTemplate::render(std::string& xml, std::initializer_list<Arg> args) const
+{
+  size_t need = xml.size() + _xml.size() + 32 * _parts.size();
+  if (xml.capacity() < need)
+    xml.reserve((need < 2 * xml.capacity()) ? 2 * xml.capacity() : need);
+
+  const Arg* arg = args.begin();
+  int nArgs = int(args.size());
+  for (size_t i = 0; i < _parts.size(); ++i) {
+    Part const& part = _parts[i];
+    xml.append(_xml, part.offset, part.length);
+    if (part.slot < 0)
+      break;
+    if (part.slot < nArgs)
+      arg[part.slot].appendXml(xml);
+    else
+      xml += "<value></value>";
+  }
+}
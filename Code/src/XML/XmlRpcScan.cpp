@@ -0,0 +1,189 @@
+
+#include "XmlRpcScan.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__)
+# define XMLRPC_SCAN_X86
+#endif
+
+#ifndef MAKEDEPEND
+# include <string.h>
+# ifdef XMLRPC_SCAN_X86
+#  include <immintrin.h>
+# endif
+#endif
+
+using namespace XmlRpc;
+
+
+// Chars that are replaced by entities when encoding
+static inline bool isEntityChar(unsigned char c)
+{
+  static const bool table[256] = {
+    0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0,
+    0,0,1,0,0,0,1,1, 0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0, 0,0,0,0,1,0,1,0,
+  };
+  return table[c];
+}
+
+
+// Portable versions
+
+static const char* findCharScalar(const char* cp, const char* end, char c)
+{
+  const char* found = (const char*) memchr(cp, c, end - cp);
+  return found ? found : end;
+}
+
+static const char* findEntityScalar(const char* cp, const char* end)
+{
+  while (cp < end && ! isEntityChar((unsigned char) *cp))
+    ++cp;
+  return cp;
+}
+
+
+#ifdef XMLRPC_SCAN_X86
+
+// SSE2 versions: 16 bytes per step, tail handled by the scalar code
+
+static const char* findCharSse2(const char* cp, const char* end, char c)
+{
+  const __m128i needle = _mm_set1_epi8(c);
+  for ( ; end - cp >= 16; cp += 16) {
+    __m128i block = _mm_loadu_si128((const __m128i*) cp);
+    int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(block, needle));
+    if (mask)
+      return cp + __builtin_ctz(mask);
+  }
+  return findCharScalar(cp, end, c);
+}
+
+static const char* findEntitySse2(const char* cp, const char* end)
+{
+  const __m128i lt = _mm_set1_epi8('<');
+  const __m128i gt = _mm_set1_epi8('>');
+  const __m128i amp = _mm_set1_epi8('&');
+  const __m128i apos = _mm_set1_epi8('\'');
+  const __m128i quot = _mm_set1_epi8('"');
+  for ( ; end - cp >= 16; cp += 16) {
+    __m128i block = _mm_loadu_si128((const __m128i*) cp);
+    __m128i hits = _mm_or_si128(
+        _mm_or_si128(_mm_cmpeq_epi8(block, lt), _mm_cmpeq_epi8(block, gt)),
+        _mm_or_si128(_mm_cmpeq_epi8(block, amp),
+                     _mm_or_si128(_mm_cmpeq_epi8(block, apos), _mm_cmpeq_epi8(block, quot))));
+    int mask = _mm_movemask_epi8(hits);
+    if (mask)
+      return cp + __builtin_ctz(mask);
+  }
+  return findEntityScalar(cp, end);
+}
+
+
+// AVX2 versions: 32 bytes per step, tail handled by the SSE2 code
+
+__attribute__((target("avx2")))
+static const char* findCharAvx2(const char* cp, const char* end, char c)
+{
+  const __m256i needle = _mm256_set1_epi8(c);
+  for ( ; end - cp >= 32; cp += 32) {
+    __m256i block = _mm256_loadu_si256((const __m256i*) cp);
+    unsigned mask = (unsigned) _mm256_movemask_epi8(_mm256_cmpeq_epi8(block, needle));
+    if (mask)
+      return cp + __builtin_ctz(mask);
+  }
+  return findCharSse2(cp, end, c);
+}
+
+__attribute__((target("avx2")))
+static const char* findEntityAvx2(const char* cp, const char* end)
+{
+  const __m256i lt = _mm256_set1_epi8('<');
+  const __m256i gt = _mm256_set1_epi8('>');
+  const __m256i amp = _mm256_set1_epi8('&');
+  const __m256i apos = _mm256_set1_epi8('\'');
+  const __m256i quot = _mm256_set1_epi8('"');
+  for ( ; end - cp >= 32; cp += 32) {
+    __m256i block = _mm256_loadu_si256((const __m256i*) cp);
+    __m256i hits = _mm256_or_si256(
+        _mm256_or_si256(_mm256_cmpeq_epi8(block, lt), _mm256_cmpeq_epi8(block, gt)),
+        _mm256_or_si256(_mm256_cmpeq_epi8(block, amp),
+                        _mm256_or_si256(_mm256_cmpeq_epi8(block, apos), _mm256_cmpeq_epi8(block, quot))));
+    unsigned mask = (unsigned) _mm256_movemask_epi8(hits);
+    if (mask)
+      return cp + __builtin_ctz(mask);
+  }
+  return findEntitySse2(cp, end);
+}
+
+#endif // XMLRPC_SCAN_X86
+
+
+// Runtime dispatch. The implementation is selected once, on first use, so
+// calls made during static initialization are safe too.
+
+typedef const char* (*FindCharFn)(const char*, const char*, char);
+typedef const char* (*FindEntityFn)(const char*, const char*);
+
+static bool cpuHasAvx2()
+{
+#ifdef XMLRPC_SCAN_X86
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx2");
+#else
+  return false;
+#endif
+}
+
+
+bool
+XmlRpcScan::hasAvx2()
+{
+  static const bool avx2 = cpuHasAvx2();
+  return avx2;
+}
+
+
+const char*
+XmlRpcScan::implementation()
+{
+#ifdef XMLRPC_SCAN_X86
+  return hasAvx2() ? "avx2" : "sse2";
+#else
+  return "scalar";
+#endif
+}
+
+
+static FindCharFn selectFindChar()
+{
+#ifdef XMLRPC_SCAN_X86
+  return XmlRpcScan::hasAvx2() ? findCharAvx2 : findCharSse2;
+#else
+  return findCharScalar;
+#endif
+}
+
+static FindEntityFn selectFindEntity()
+{
+#ifdef XMLRPC_SCAN_X86
+  return XmlRpcScan::hasAvx2() ? findEntityAvx2 : findEntitySse2;
+#else
+  return findEntityScalar;
+#endif
+}
+
+
+const char*
+XmlRpcScan::findChar(const char* begin, const char* end, char c)
+{
+  static const FindCharFn fn = selectFindChar();
+  return fn(begin, end, c);
+}
+
+
+const char*
+XmlRpcScan::findEntity(const char* begin, const char* end)
+{
+  static const FindEntityFn fn = selectFindEntity();
+  return fn(begin, end);
+}
@@ -0,0 +1,228 @@
+
+#include "XmlRpcSchema.h"
+
+#ifndef MAKEDEPEND
+# include <string.h>
+#endif
+
+using namespace XmlRpc;
+
+
+static inline bool isSpace(char c)
+{
+  return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+}
+
+static void skipSpace(const char*& cp, const char* end)
+{
+  while (cp < end && isSpace(*cp))
+    ++cp;
+}
+
+// Type names and member names end at punctuation or space
+static std::string_view word(const char*& cp, const char* end)
+{
+  skipSpace(cp, end);
+  const char* start = cp;
+  while (cp < end && ! isSpace(*cp) && ! strchr(":?,<>{}", *cp))
+    ++cp;
+  return std::string_view(start, size_t(cp - start));
+}
+
+static bool next(const char*& cp, const char* end, char c)
+{
+  skipSpace(cp, end);
+  if (cp < end && *cp == c) {
+    ++cp;
+    return true;
+  }
+  return false;
+}
+
+static XmlRpcValue::Type typeFromName(std::string_view name, bool* ok)
+{
+  *ok = true;
+  if (name == "string")             return XmlRpcValue::TypeString;
+  if (name == "int" || name == "i4") return XmlRpcValue::TypeInt;
+  if (name == "boolean")            return XmlRpcValue::TypeBoolean;
+  if (name == "double")             return XmlRpcValue::TypeDouble;
+  if (name == "dateTime.iso8601")   return XmlRpcValue::TypeDateTime;
+  if (name == "base64")             return XmlRpcValue::TypeBase64;
+  if (name == "array")              return XmlRpcValue::TypeArray;
+  if (name == "struct")             return XmlRpcValue::TypeStruct;
+  *ok = (name == "any");
+  return XmlRpcValue::TypeInvalid;
+}
+
+
+const char*
+XmlRpcSchema::typeName(XmlRpcValue::Type t)
+{
+  switch (t) {
+    case XmlRpcValue::TypeBoolean:  return "boolean";
+    case XmlRpcValue::TypeInt:      return "int";
+    case XmlRpcValue::TypeDouble:   return "double";
+    case XmlRpcValue::TypeString:   return "string";
+    case XmlRpcValue::TypeDateTime: return "dateTime.iso8601";
+    case XmlRpcValue::TypeBase64:   return "base64";
+    case XmlRpcValue::TypeArray:    return "array";
+    case XmlRpcValue::TypeStruct:   return "struct";
+    default: break;
+  }
+  return "any";
+}
+
+
+bool
+XmlRpcSchema::compile(std::string const& description)
+{
+  _nodes.clear();
+  _params.clear();
+  _signature.clear();
+  _error.clear();
+
+  const char* cp = description.data();
+  const char* end = cp + description.size();
+  skipSpace(cp, end);
+  while (cp < end || ! _params.empty()) {   // a ',' must be followed by a type
+    int node = parseType(cp, end);
+    if (node < 0) break;
+    _params.push_back(node);
+    _signature.push_back(typeName(_nodes[node].type));
+
+    if ( ! next(cp, end, ',')) {
+      skipSpace(cp, end);
+      if (cp < end)
+        _error = "expected ',' at offset " + std::to_string(cp - description.data());
+      break;
+    }
+  }
+
+  if ( ! _error.empty()) {
+    _nodes.clear();
+    _params.clear();
+    _signature.clear();
+    return false;
+  }
+  return true;
+}
+
+
+// Parse one type, returning its node or -1
+int
+XmlRpcSchema::parseType(const char*& cp, const char* end)
+{
+  std::string_view name = word(cp, end);
+  bool ok;
+  XmlRpcValue::Type type = typeFromName(name, &ok);
+  if ( ! ok) {
+    _error = "unknown type '" + std::string(name) + "'";
+    return -1;
+  }
+
+  int node = int(_nodes.size());
+  _nodes.push_back(Node{ type, -1, std::vector<Member>(), 0 });
+
+  if (type == XmlRpcValue::TypeArray && next(cp, end, '<')) {
+    int element = parseType(cp, end);
+    if (element < 0) return -1;
+    if ( ! next(cp, end, '>')) {
+      _error = "expected '>' after array element type";
+      return -1;
+    }
+    _nodes[node].element = element;
+  }
+  else if (type == XmlRpcValue::TypeStruct && next(cp, end, '{')) {
+    std::vector<Member> members;
+    int required = 0;
+    do {
+      std::string_view memberName = word(cp, end);
+      if (memberName.empty()) {
+        _error = "expected a member name in struct";
+        return -1;
+      }
+      bool optional = next(cp, end, '?');
+      if ( ! next(cp, end, ':')) {
+        _error = "expected ':' after member '" + std::string(memberName) + "'";
+        return -1;
+      }
+      int memberNode = parseType(cp, end);
+      if (memberNode < 0) return -1;
+      members.push_back(Member{ std::string(memberName), memberNode, optional });
+      if ( ! optional) ++required;
+    } while (next(cp, end, ','));
+    if ( ! next(cp, end, '}')) {
+      _error = "expected '}' at the end of struct";
+      return -1;
+    }
+    _nodes[node].members.swap(members);
+    _nodes[node].required = required;
+  }
+
+  return node;
+}
+
+
+XmlRpcSchema::Member const*
+XmlRpcSchema::member(int node, std::string_view name) const
+{
+  if (node < 0) return 0;
+  std::vector<Member> const& members = _nodes[node].members;
+  for (size_t i = 0; i < members.size(); ++i)
+    if (members[i].name == name)
+      return &members[i];
+  return 0;
+}
+
+
+bool
+XmlRpcSchema::validate(XmlRpcValue const& params, std::string& message) const
+{
+  XmlRpcValue::ValueArray const* values = params.tryGet<XmlRpcValue::ValueArray>();
+  int n = values ? int(values->size()) : 0;
+  if (n != int(_params.size())) {
+    message = "expected " + std::to_string(_params.size()) + " params, got " + std::to_string(n);
+    return false;
+  }
+
+  for (int i = 0; i < n; ++i)
+    if ( ! validateValue(_params[i], (*values)[i], "param " + std::to_string(i + 1), message))
+      return false;
+  return true;
+}
+
+
+bool
+XmlRpcSchema::validateValue(int node, XmlRpcValue const& value, std::string const& where, std::string& message) const
+{
+  Node const& expected = _nodes[node];
+  if ( ! accepts(node, value.getType())) {
+    message = where + ": expected " + typeName(expected.type) + ", got " + typeName(value.getType());
+    return false;
+  }
+
+  if (expected.type == XmlRpcValue::TypeArray && expected.element >= 0) {
+    XmlRpcValue::ValueArray const* elements = value.tryGet<XmlRpcValue::ValueArray>();
+    if ( ! elements) {
+      message = where + ": malformed array";
+      return false;
+    }
+    for (size_t i = 0; i < elements->size(); ++i)
+      if ( ! validateValue(expected.element, (*elements)[i], where + "[" + std::to_string(i) + "]", message))
+        return false;
+  }
+  else if (expected.type == XmlRpcValue::TypeStruct) {
+    for (size_t i = 0; i < expected.members.size(); ++i) {
+      Member const& m = expected.members[i];
+      XmlRpcValue const* v = value.find(m.name);
+      if ( ! v) {
+        if (m.optional) continue;
+        message = where + ": missing member '" + m.name + "'";
+        return false;
+      }
+      if ( ! validateValue(m.node, *v, where + "." + m.name, message))
+        return false;
+    }
+  }
+  return true;
+}
@@ -5,7 +5,13 @@
 #include "XmlRpcSocket.h"
 #include "XmlRpcUtil.h"
 #include "XmlRpcException.h"
+#include "XmlRpcSchema.h"
+#include "XmlRpcShmChannel.h"
+#include "XmlRpcShmConnection.h"
 
+#ifndef MAKEDEPEND
+# include <stdlib.h>
+#endif
 
 using namespace XmlRpc;
 
@@ -13,8 +19,12 @@ using namespace XmlRpc;
 XmlRpcServer::XmlRpcServer()
 {
   _introspectionEnabled = false;
+  _lazyParams = false;
+  _parallelElements = 16384;
+  _sharedMemory = false;
   _listMethods = 0;
   _methodHelp = 0;
+  _methodSignature = 0;
 }
 
 
@@ -24,6 +34,7 @@ XmlRpcServer::~XmlRpcServer()
   _methods.clear();
   delete _listMethods;
   delete _methodHelp;
+  delete _methodSignature;
 }
 
 
@@ -94,6 +105,10 @@ XmlRpcServer::bindAndListen(int port, int backlog /*= 5*/)
     return false;
   }
 
+  // Options that can't be set are left at their defaults
+  if ( ! XmlRpcSocket::setListenOptions(fd, _socketOptions))
+    XmlRpcUtil::log(1, "XmlRpcServer::bindAndListen: some socket options could not be set.");
+
   // Bind to the specified port on the default interface
   if ( ! XmlRpcSocket::bind(fd, port))
   {
@@ -119,6 +134,60 @@ XmlRpcServer::bindAndListen(int port, int backlog /*= 5*/)
 }
 
 
+// Create a socket for the endpoint, bind it and set it in listen mode
+bool
+XmlRpcServer::bindAndListen(std::string const& endpoint, int backlog /*= 5*/)
+{
+  std::string path;
+  bool sharedMemory = XmlRpcShmChannel::isEndpoint(endpoint, &path);
+  if ( ! sharedMemory && ! XmlRpcSocket::isUnixEndpoint(endpoint, &path))
+    return bindAndListen(atoi(endpoint.c_str()), backlog);
+
+  int fd = XmlRpcSocket::unixSocket();
+  if (fd < 0)
+  {
+    XmlRpcUtil::error("XmlRpcServer::bindAndListen: Could not create socket (%s).", XmlRpcSocket::getErrorMsg().c_str());
+    return false;
+  }
+
+  this->setfd(fd);
+
+  // Don't block on reads/writes
+  if ( ! XmlRpcSocket::setNonBlocking(fd))
+  {
+    this->close();
+    XmlRpcUtil::error("XmlRpcServer::bindAndListen: Could not set socket to non-blocking input mode (%s).", XmlRpcSocket::getErrorMsg().c_str());
+    return false;
+  }
+
+  if ( ! XmlRpcSocket::bindUnix(fd, path))
+  {
+    this->close();
+    XmlRpcUtil::error("XmlRpcServer::bindAndListen: Could not bind to %s (%s).", path.c_str(), XmlRpcSocket::getErrorMsg().c_str());
+    return false;
+  }
+  _unixPath = path;
+  _sharedMemory = sharedMemory;
+
+  // Set in listening mode
+  if ( ! XmlRpcSocket::listen(fd, backlog))
+  {
+    this->close();
+    XmlRpcSocket::removeUnix(_unixPath);
+    _unixPath.clear();
+    XmlRpcUtil::error("XmlRpcServer::bindAndListen: Could not set socket in listening mode (%s).", XmlRpcSocket::getErrorMsg().c_str());
+    return false;
+  }
+
+  XmlRpcUtil::log(2, "XmlRpcServer::bindAndListen: server listening on %s fd %d", path.c_str(), fd);
+
+  // Notify the dispatcher to listen on this source when we are in work()
+  _disp.addSource(this, XmlRpcDispatch::ReadableEvent);
+
+  return true;
+}
+
+
 // Process client requests for the specified time
 void 
 XmlRpcServer::work(double msTime)
@@ -158,6 +227,8 @@ XmlRpcServer::acceptConnection()
   }
   else  // Notify the dispatcher to listen for input on this source when we are in work()
   {
+    if (listensOnTcp())
+      (void) XmlRpcSocket::setOptions(s, _socketOptions);
     XmlRpcUtil::log(2, "XmlRpcServer::acceptConnection: creating a connection");
     _disp.addSource(this->createConnection(s), XmlRpcDispatch::ReadableEvent);
   }
@@ -169,6 +240,8 @@ XmlRpcServerConnection*
 XmlRpcServer::createConnection(int s)
 {
   // Specify that the connection object be deleted when it is closed
+  if (_sharedMemory)
+    return new XmlRpcShmConnection(s, this, true);
   return new XmlRpcServerConnection(s, this, true);
 }
 
@@ -194,12 +267,20 @@ XmlRpcServer::shutdown()
 {
   // This closes and destroys all connections as well as closing this socket
   _disp.clear();
+
+  if ( ! _unixPath.empty())
+  {
+    XmlRpcSocket::removeUnix(_unixPath);
+    _unixPath.clear();
+    _sharedMemory = false;
+  }
 }
 
 
 // Introspection support
 static const std::string LIST_METHODS("system.listMethods");
 static const std::string METHOD_HELP("system.methodHelp");
+static const std::string METHOD_SIGNATURE("system.methodSignature");
 static const std::string MULTICALL("system.multicall");
 
 
@@ -224,21 +305,68 @@ class MethodHelp : public XmlRpcServerMethod
 public:
   MethodHelp(XmlRpcServer* s) : XmlRpcServerMethod(METHOD_HELP, s) {}
 
-  void execute(XmlRpcValue& params, XmlRpcValue& result)
+  bool tryExecute(XmlRpcValue& params, XmlRpcValue& result, XmlRpcException& fault)
   {
-    if (params[0].getType() != XmlRpcValue::TypeString)
-      throw XmlRpcException(METHOD_HELP + ": Invalid argument type");
+    XmlRpcValue::ValueArray const* args = params.tryGet<XmlRpcValue::ValueArray>();
+    std::string const* name = (args && ! args->empty()) ? (*args)[0].tryGet<std::string>() : 0;
+    if ( ! name) {
+      fault = XmlRpcException(METHOD_HELP + ": Invalid argument type");
+      return false;
+    }
 
-    XmlRpcServerMethod* m = _server->findMethod(params[0]);
-    if ( ! m)
-      throw XmlRpcException(METHOD_HELP + ": Unknown method name");
+    XmlRpcServerMethod* m = _server->findMethod(*name);
+    if ( ! m) {
+      fault = XmlRpcException(METHOD_HELP + ": Unknown method name");
+      return false;
+    }
 
     result = m->help();
+    return true;
   }
 
   std::string help() { return std::string("Retrieve the help string for a named method"); }
 };
 
+
+// Retrieve the signatures of a named method, from the types given to setSignature()
+class MethodSignature : public XmlRpcServerMethod
+{
+public:
+  MethodSignature(XmlRpcServer* s) : XmlRpcServerMethod(METHOD_SIGNATURE, s) {}
+
+  bool tryExecute(XmlRpcValue& params, XmlRpcValue& result, XmlRpcException& fault)
+  {
+    XmlRpcValue::ValueArray const* args = params.tryGet<XmlRpcValue::ValueArray>();
+    std::string const* name = (args && ! args->empty()) ? (*args)[0].tryGet<std::string>() : 0;
+    if ( ! name) {
+      fault = XmlRpcException(METHOD_SIGNATURE + ": Invalid argument type");
+      return false;
+    }
+
+    XmlRpcServerMethod* m = _server->findMethod(*name);
+    if ( ! m) {
+      fault = XmlRpcException(METHOD_SIGNATURE + ": Unknown method name");
+      return false;
+    }
+
+    // Without a declared signature the result is not an array
+    if ( ! m->schema()) {
+      result = "undef";
+      return true;
+    }
+
+    std::vector<std::string> const& types = m->schema()->signature();
+    XmlRpcValue& signature = result[0];
+    signature.setSize(int(types.size()) + 1);
+    signature[0] = m->resultType();
+    for (size_t i = 0; i < types.size(); ++i)
+      signature[int(i) + 1] = types[i];
+    return true;
+  }
+
+  std::string help() { return std::string("Retrieve the signatures of a named method as an array of arrays of type names"); }
+};
+
     
 // Specify whether introspection is enabled or not. Default is enabled.
 void 
@@ -255,15 +383,18 @@ XmlRpcServer::enableIntrospection(bool enabled)
     {
       _listMethods = new ListMethods(this);
       _methodHelp = new MethodHelp(this);
+      _methodSignature = new MethodSignature(this);
     } else {
       addMethod(_listMethods);
       addMethod(_methodHelp);
+      addMethod(_methodSignature);
     }
   }
   else
   {
     removeMethod(LIST_METHODS);
     removeMethod(METHOD_HELP);
+    removeMethod(METHOD_SIGNATURE);
   }
 }
 
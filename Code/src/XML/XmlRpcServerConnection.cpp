@@ -2,11 +2,17 @@
 #include "XmlRpcServerConnection.h"
 
 #include "XmlRpcSocket.h"
+#include "XmlRpcTokenizer.h"
+#include "XmlRpcResponseTemplate.h"
+#include "XmlRpcSchema.h"
+#include "XmlRpcBinary.h"
+#include "XmlRpcJson.h"
 #include "XmlRpc.h"
 
 #ifndef MAKEDEPEND
 # include <stdio.h>
 # include <stdlib.h>
+# include <string_view>
 #include <strings.h>
 #include <string.h>
 using namespace std;
@@ -21,6 +27,17 @@ const char XmlRpcServerConnection::PARAMS_ETAG[] = "</params>";
 const char XmlRpcServerConnection::PARAM_TAG[] = "<param>";
 const char XmlRpcServerConnection::PARAM_ETAG[] = "</param>";
 
+const char XmlRpcServerConnection::RESPONSE_PREFIX[] =
+  "<?xml version=\"1.0\"?>\r\n"
+  "<methodResponse><params><param>\r\n\t";
+const char XmlRpcServerConnection::RESPONSE_SUFFIX[] =
+  "\r\n</param></params></methodResponse>\r\n";
+const char XmlRpcServerConnection::FAULT_PREFIX[] =
+  "<?xml version=\"1.0\"?>\r\n"
+  "<methodResponse><fault>\r\n\t";
+const char XmlRpcServerConnection::FAULT_SUFFIX[] =
+  "\r\n</fault></methodResponse>\r\n";
+
 const std::string XmlRpcServerConnection::SYSTEM_MULTICALL = "system.multicall";
 const std::string XmlRpcServerConnection::METHODNAME = "methodName";
 const std::string XmlRpcServerConnection::PARAMS = "params";
@@ -38,6 +55,14 @@ XmlRpcServerConnection::XmlRpcServerConnection(int fd, XmlRpcServer* server, boo
   _server = server;
   _connectionState = READ_HEADER;
   _keepAlive = true;
+  _pipelined = false;
+  _encoding = XML_ENCODING;
+
+  // Params are checked against the method's schema as they are parsed
+  _parser.setSchemaLookup([server](std::string const& name) -> XmlRpcSchema const* {
+    XmlRpcServerMethod* method = server->findMethod(name);
+    return method ? method->schema() : 0;
+  });
 }
 
 
@@ -54,15 +79,36 @@ XmlRpcServerConnection::~XmlRpcServerConnection()
 unsigned
 XmlRpcServerConnection::handleEvent(unsigned /*eventType*/)
 {
-  if (_connectionState == READ_HEADER)
-    if ( ! readHeader()) return 0;
+  for (;;) {
+    if (_connectionState == READ_HEADER)
+      if ( ! readHeader()) return 0;
 
-  if (_connectionState == READ_REQUEST)
-    if ( ! readRequest()) return 0;
+    if (_connectionState == READ_REQUEST)
+      if ( ! readRequest()) return 0;
 
-  if (_connectionState == WRITE_RESPONSE)
+    if (_connectionState != WRITE_RESPONSE)
+      break;
     if ( ! writeResponse()) return 0;
 
+    // A client may pipeline requests, so the next one may already have been
+    // read along with this one, with nothing more coming to wake us up
+    if (_connectionState != READ_HEADER || _header.empty())
+      break;
+
+    // The responses to pipelined requests are written one after another, and
+    // Nagle's algorithm would hold each back until the client acknowledged
+    // the one before, which it delays as it has nothing to send. Unix domain
+    // and shared memory connections have no such delay, nor the option
+    if ( ! _pipelined) {
+      _pipelined = true;
+      if (_server->listensOnTcp()) {
+        XmlRpcSocket::Options options;
+        options.noDelay = true;
+        (void) XmlRpcSocket::setOptions(getfd(), options);
+      }
+    }
+  }
+
   return (_connectionState == WRITE_RESPONSE) 
         ? XmlRpcDispatch::WritableEvent : XmlRpcDispatch::ReadableEvent;
 }
@@ -73,7 +119,7 @@ XmlRpcServerConnection::readHeader()
 {
   // Read available data
   bool eof;
-  if ( ! XmlRpcSocket::nbRead(this->getfd(), _header, &eof)) {
+  if ( ! readData(_header, &eof)) {
     // Its only an error if we already have read some data
     if (_header.length() > 0)
       XmlRpcUtil::error("XmlRpcServerConnection::readHeader: error while reading header (%s).",XmlRpcSocket::getErrorMsg().c_str());
@@ -86,12 +132,15 @@ XmlRpcServerConnection::readHeader()
   char *bp = 0;                       // Start of body
   char *lp = 0;                       // Start of content-length value
   char *kp = 0;                       // Start of connection value
+  char *tp = 0;                       // Start of content-type value
 
   for (char *cp = hp; (bp == 0) && (cp < ep); ++cp) {
 	if ((ep - cp > 16) && (strncasecmp(cp, "Content-length: ", 16) == 0))
 	  lp = cp + 16;
 	else if ((ep - cp > 12) && (strncasecmp(cp, "Connection: ", 12) == 0))
 	  kp = cp + 12;
+	else if ((ep - cp > 14) && (strncasecmp(cp, "Content-Type: ", 14) == 0))
+	  tp = cp + 14;
 	else if ((ep - cp > 4) && (strncmp(cp, "\r\n\r\n", 4) == 0))
 	  bp = cp + 4;
 	else if ((ep - cp > 2) && (strncmp(cp, "\n\n", 2) == 0))
@@ -125,12 +174,15 @@ XmlRpcServerConnection::readHeader()
   	
   XmlRpcUtil::log(3, "XmlRpcServerConnection::readHeader: specified content length is %d.", _contentLength);
 
-  // Otherwise copy non-header data to request buffer and set state to read request.
-  _request = bp;
+  _encoding = XML_ENCODING;
+  if (tp != 0 && XmlRpcBinary::isContentType(tp))
+    _encoding = BINARY_ENCODING;
+  else if (tp != 0 && XmlRpcJson::isContentType(tp))
+    _encoding = JSON_ENCODING;
 
   // Parse out any interesting bits from the header (HTTP version, connection)
   _keepAlive = true;
-  if (_header.find("HTTP/1.0") != std::string::npos) {
+  if (std::string_view(hp, size_t(bp - hp)).find("HTTP/1.0") != std::string_view::npos) {
     if (kp == 0 || strncasecmp(kp, "keep-alive", 10) != 0)
       _keepAlive = false;           // Default for HTTP 1.0 is to close the connection
   } else {
@@ -139,8 +191,13 @@ XmlRpcServerConnection::readHeader()
   }
   XmlRpcUtil::log(3, "KeepAlive: %d", _keepAlive);
 
-
-  _header = ""; 
+  // The body read so far stays where it is: the header buffer becomes the
+  // request buffer, less the header. Anything read after the body is the start
+  // of the next request, if the client pipelines them.
+  _request.swap(_header);
+  _request.consume(size_t(bp - hp));
+  _header.clear();
+  keepPipelined();
   _connectionState = READ_REQUEST;
   return true;    // Continue monitoring this source
 }
@@ -151,10 +208,17 @@ XmlRpcServerConnection::readRequest()
   // If we dont have the entire request yet, read available data
   if (int(_request.length()) < _contentLength) {
     bool eof;
-    if ( ! XmlRpcSocket::nbRead(this->getfd(), _request, &eof)) {
+    if ( ! readData(_request, &eof, size_t(_contentLength) - _request.length())) {
       XmlRpcUtil::error("XmlRpcServerConnection::readRequest: read error (%s).",XmlRpcSocket::getErrorMsg().c_str());
       return false;
     }
+    keepPipelined();
+
+    // Parse what has arrived so far while the rest is in transit. Lazy params
+    // need the whole body, so they are left to executeRequest, as are binary
+    // and JSON requests.
+    if ( ! _server->lazyParams() && _encoding == XML_ENCODING)
+      (void) _parser.parse(_request.view());
 
     // If we haven't gotten the entire request yet, return (keep reading)
     if (int(_request.length()) < _contentLength) {
@@ -175,53 +239,131 @@ XmlRpcServerConnection::readRequest()
   return true;    // Continue monitoring this source
 }
 
+// Bytes read past the end of the request body are the start of the next
+// request; keep them as its header
+void
+XmlRpcServerConnection::keepPipelined()
+{
+  if (int(_request.length()) > _contentLength) {
+    _header.assign(_request.data() + _contentLength, _request.size() - size_t(_contentLength));
+    _request.truncate(size_t(_contentLength));
+  }
+}
+
 
 bool
 XmlRpcServerConnection::writeResponse()
 {
-  if (_response.length() == 0) {
+  if (_response.length() == 0 && _responseBuffers.empty()) {
     executeRequest();
     _bytesWritten = 0;
-    if (_response.length() == 0) {
+    if (_response.length() == 0 && _responseBuffers.empty()) {
       XmlRpcUtil::error("XmlRpcServerConnection::writeResponse: empty response.");
       return false;
     }
   }
 
   // Try to write the response
-  if ( ! XmlRpcSocket::nbWrite(this->getfd(), _response, &_bytesWritten)) {
+  if ( ! writeData(&_bytesWritten)) {
     XmlRpcUtil::error("XmlRpcServerConnection::writeResponse: write error (%s).",XmlRpcSocket::getErrorMsg().c_str());
     return false;
   }
-  XmlRpcUtil::log(3, "XmlRpcServerConnection::writeResponse: wrote %d of %d bytes.", _bytesWritten, _response.length());
+
+  size_t length = _response.length();
+  for (size_t i = 0; i < _responseBuffers.size(); ++i)
+    length += _responseBuffers[i].size();
+  XmlRpcUtil::log(3, "XmlRpcServerConnection::writeResponse: wrote %d of %d bytes.", _bytesWritten, int(length));
 
   // Prepare to read the next request
-  if (_bytesWritten == int(_response.length())) {
-    _header = "";
-    _request = "";
+  if (_bytesWritten == int(length)) {
+    _request.clear();
     _response = "";
+    _responseBuffers.clear();
     _connectionState = READ_HEADER;
   }
 
-  return _keepAlive;    // Continue monitoring this source if true
+  // Continue monitoring this source until the response is written, and after
+  // if keeping the connection open
+  return _keepAlive || _connectionState == WRITE_RESPONSE;
+}
+
+bool
+XmlRpcServerConnection::readData(XmlRpcBuffer& s, bool* eof, size_t expected)
+{
+  return XmlRpcSocket::nbRead(this->getfd(), s, eof, expected);
 }
 
+bool
+XmlRpcServerConnection::writeData(int* bytesSoFar)
+{
+  return _responseBuffers.empty()
+       ? XmlRpcSocket::nbWrite(this->getfd(), _response, bytesSoFar)
+       : XmlRpcSocket::nbWriteV(this->getfd(), _responseBuffers, bytesSoFar);
+}
+
+
 // Run the method, generate _response string
 void
 XmlRpcServerConnection::executeRequest()
 {
+  if (_encoding == JSON_ENCODING) {
+    executeJsonRequest();
+    return;
+  }
+
   XmlRpcValue params, resultValue;
-  std::string methodName = parseRequest(params);
+  std::string methodName;
+  bool validated = false;
+
+  // Normally an xml request has been parsed (and its params checked) while it
+  // was read; otherwise parse it now
+  XmlRpcRequestParser::Status status = (_server->lazyParams() || _encoding != XML_ENCODING)
+                                      ? XmlRpcRequestParser::Failed : _parser.parse(_request.view());
+  if (status == XmlRpcRequestParser::Invalid) {
+    XmlRpcUtil::log(2, "XmlRpcServerConnection::executeRequest: %s.", _parser.fault().c_str());
+    generateFaultResponse(_parser.fault(), XmlRpcSchema::INVALID_PARAMS);
+    _parser.reset();
+    return;
+  }
+  if (status == XmlRpcRequestParser::Done) {
+    methodName = _parser.methodName();
+    params = _parser.params();
+    validated = _parser.validated();
+  } else if (_encoding == BINARY_ENCODING) {
+    if ( ! XmlRpcBinary::parseCall(_request.view(), methodName, params)) {
+      XmlRpcUtil::log(2, "XmlRpcServerConnection::executeRequest: malformed binary request.");
+      generateFaultResponse("parse error: malformed binary request");
+      return;
+    }
+  } else
+    methodName = parseRequest(params);
+  _parser.reset();
+
   XmlRpcUtil::log(2, "XmlRpcServerConnection::executeRequest: server calling method '%s'", 
                     methodName.c_str());
 
+  // Method failures are returned rather than thrown; the handler only catches
+  // exceptions from methods and values that still throw.
   try {
 
-    if ( ! executeMethod(methodName, params, resultValue) &&
-         ! executeMulticall(methodName, params, resultValue))
-      generateFaultResponse(methodName + ": unknown method name");
-    else
-      generateResponse(resultValue.toXml());
+    // A method may write its response xml itself, when xml is wanted
+    XmlRpcServerMethod* method = _server->findMethod(methodName);
+    std::string body;
+    XmlRpcException fault("");
+    if (method && ! validated && ! checkParams(method, params, fault)) {
+      XmlRpcUtil::log(2, "XmlRpcServerConnection::executeRequest: %s.", fault.getMessage().c_str());
+      generateFaultResponse(fault.getMessage(), fault.getCode());
+    }
+    else if (method && _encoding == XML_ENCODING && method->executeXml(params, body))
+      setResponse(body);
+    else if (method ? executeMethod(method, params, resultValue, fault)
+                    : executeMethod(methodName, params, resultValue, fault))
+      generateResponse(resultValue);
+    else {
+      XmlRpcUtil::log(2, "XmlRpcServerConnection::executeRequest: fault %s.",
+                      fault.getMessage().c_str()); 
+      generateFaultResponse(fault.getMessage(), fault.getCode());
+    }
 
   } catch (const XmlRpcException& fault) {
     XmlRpcUtil::log(2, "XmlRpcServerConnection::executeRequest: fault %s.",
@@ -230,23 +372,36 @@ XmlRpcServerConnection::executeRequest()
   }
 }
 
-// Parse the method name and the argument values from the request.
+// Parse the method name and the argument values from the request. With lazy
+// params the request text is handed over to the params, which decode their
+// arrays and structs from it on demand.
 std::string
 XmlRpcServerConnection::parseRequest(XmlRpcValue& params)
 {
-  int offset = 0;   // Number of chars parsed from the request
-
-  std::string methodName = XmlRpcUtil::parseTag(METHODNAME_TAG, _request, &offset);
-
-  if (methodName.size() > 0 && XmlRpcUtil::findTag(PARAMS_TAG, _request, &offset))
+  XmlRpcValue::SharedXml lazyXml;
+  if (_server->lazyParams())
+    lazyXml = std::make_shared<const std::string>(_request.view());
+  XmlRpcTokenizer tok(lazyXml ? std::string_view(*lazyXml) : _request.view(), 0);
+
+  std::string methodName;
+  const char *nameStart, *nameEnd;
+  if (tok.skipTo(XmlRpcTokenizer::MethodNameTag) && tok.text(&nameStart, &nameEnd) &&
+      tok.nextTagIs(XmlRpcTokenizer::MethodNameTag | XmlRpcTokenizer::EndTag))
+    methodName.assign(nameStart, nameEnd);
+
+  if (methodName.size() > 0 && tok.skipTo(XmlRpcTokenizer::ParamsTag))
   {
     int nArgs = 0;
-    while (XmlRpcUtil::nextTagIs(PARAM_TAG, _request, &offset)) {
-      params[nArgs++] = XmlRpcValue(_request, &offset);
-      (void) XmlRpcUtil::nextTagIs(PARAM_ETAG, _request, &offset);
+    while (tok.nextTagIs(XmlRpcTokenizer::ParamTag)) {
+      params.setSize(nArgs+1);
+      if (lazyXml)
+        params[nArgs++].fromXmlLazy(tok, lazyXml);
+      else
+        params[nArgs++].fromXml(tok);
+      (void) tok.nextTagIs(XmlRpcTokenizer::ParamTag | XmlRpcTokenizer::EndTag);
     }
 
-    (void) XmlRpcUtil::nextTagIs(PARAMS_ETAG, _request, &offset);
+    (void) tok.nextTagIs(XmlRpcTokenizer::ParamsTag | XmlRpcTokenizer::EndTag);
   }
 
   return methodName;
@@ -255,13 +410,41 @@ XmlRpcServerConnection::parseRequest(XmlRpcValue& params)
 // Execute a named method with the specified params.
 bool
 XmlRpcServerConnection::executeMethod(const std::string& methodName, 
-                                      XmlRpcValue& params, XmlRpcValue& result)
+                                      XmlRpcValue& params, XmlRpcValue& result,
+                                      XmlRpcException& fault)
 {
   XmlRpcServerMethod* method = _server->findMethod(methodName);
 
-  if ( ! method) return false;
+  if ( ! method) {
+    if (methodName == SYSTEM_MULTICALL)
+      return executeMulticall(params, result, fault);
+    fault = XmlRpcException(methodName + ": unknown method name");
+    return false;
+  }
+
+  return checkParams(method, params, fault) && executeMethod(method, params, result, fault);
+}
+
+// Check params that were not checked during parsing against the method's schema
+bool
+XmlRpcServerConnection::checkParams(XmlRpcServerMethod* method, XmlRpcValue const& params,
+                                    XmlRpcException& fault)
+{
+  XmlRpcSchema const* schema = method->schema();
+  std::string message;
+  if ( ! schema || schema->validate(params, message))
+    return true;
 
-  method->execute(params, result);
+  fault = XmlRpcException(method->name() + ": invalid params: " + message, XmlRpcSchema::INVALID_PARAMS);
+  return false;
+}
+
+bool
+XmlRpcServerConnection::executeMethod(XmlRpcServerMethod* method, XmlRpcValue& params,
+                                      XmlRpcValue& result, XmlRpcException& fault)
+{
+  if ( ! method->tryExecute(params, result, fault))
+    return false;
 
   // Ensure a valid result value
   if ( ! result.valid())
@@ -272,46 +455,42 @@ XmlRpcServerConnection::executeMethod(const std::string& methodName,
 
 // Execute multiple calls and return the results in an array.
 bool
-XmlRpcServerConnection::executeMulticall(const std::string& methodName, 
-                                         XmlRpcValue& params, XmlRpcValue& result)
+XmlRpcServerConnection::executeMulticall(XmlRpcValue& params, XmlRpcValue& result,
+                                         XmlRpcException& fault)
 {
-  if (methodName != SYSTEM_MULTICALL) return false;
-
   // There ought to be 1 parameter, an array of structs
-  if (params.size() != 1 || params[0].getType() != XmlRpcValue::TypeArray)
-    throw XmlRpcException(SYSTEM_MULTICALL + ": Invalid argument (expected an array)");
+  XmlRpcValue::ValueArray* args = params.tryGet<XmlRpcValue::ValueArray>();
+  XmlRpcValue::ValueArray* calls = (args && args->size() == 1) ?
+                                   (*args)[0].tryGet<XmlRpcValue::ValueArray>() : 0;
+  if ( ! calls) {
+    fault = XmlRpcException(SYSTEM_MULTICALL + ": Invalid argument (expected an array)");
+    return false;
+  }
 
-  int nc = params[0].size();
+  int nc = int(calls->size());
   result.setSize(nc);
 
   for (int i=0; i<nc; ++i) {
 
-    if ( ! params[0][i].hasMember(METHODNAME) ||
-         ! params[0][i].hasMember(PARAMS)) {
+    XmlRpcValue& call = (*calls)[i];
+    XmlRpcValue* name = call.find(METHODNAME);
+    XmlRpcValue* methodParams = call.find(PARAMS);
+    std::string const* methodName = name ? name->tryGet<std::string>() : 0;
+    if ( ! methodName || ! methodParams) {
       result[i][FAULTCODE] = -1;
       result[i][FAULTSTRING] = SYSTEM_MULTICALL +
               ": Invalid argument (expected a struct with members methodName and params)";
       continue;
     }
 
-    const std::string& methodName = params[0][i][METHODNAME];
-    XmlRpcValue& methodParams = params[0][i][PARAMS];
-
     XmlRpcValue resultValue;
     resultValue.setSize(1);
-    try {
-      if ( ! executeMethod(methodName, methodParams, resultValue[0]) &&
-           ! executeMulticall(methodName, params, resultValue[0]))
-      {
-        result[i][FAULTCODE] = -1;
-        result[i][FAULTSTRING] = methodName + ": unknown method name";
-      }
-      else
-        result[i] = resultValue;
-
-    } catch (const XmlRpcException& fault) {
-        result[i][FAULTCODE] = fault.getCode();
-        result[i][FAULTSTRING] = fault.getMessage();
+    XmlRpcException callFault("");
+    if (executeMethod(*methodName, *methodParams, resultValue[0], callFault))
+      result[i] = resultValue;
+    else {
+      result[i][FAULTCODE] = callFault.getCode();
+      result[i][FAULTSTRING] = callFault.getMessage();
     }
   }
 
@@ -319,37 +498,180 @@ XmlRpcServerConnection::executeMulticall(const std::string& methodName,
 }
 
 
-// Create a response from results xml
+// Run a JSON-RPC request. A single call is run like a call in a multicall; a
+// batch is run as a multicall of its valid calls, with the responses in the
+// order of the requests. Notifications are run but get no response, and a
+// request of nothing but notifications gets an empty body.
+void
+XmlRpcServerConnection::executeJsonRequest()
+{
+  std::string body;
+  XmlRpcValue request;
+  try {
+
+    if ( ! XmlRpcJson::parse(_request.view(), request))
+      XmlRpcJson::appendError(body, XmlRpcJson::PARSE_ERROR, "parse error", XmlRpcValue());
+    else if (request.getType() != XmlRpcValue::TypeArray)
+      executeJsonCall(request, body);
+    else if (request.size() == 0)
+      XmlRpcJson::appendError(body, XmlRpcJson::INVALID_REQUEST, "invalid request: empty batch", XmlRpcValue());
+    else {
+      // A response for each request that is not a notification. Requests that
+      // can't be run are answered directly; the rest are run as a multicall.
+      struct Entry {
+        XmlRpcValue id;
+        bool notification;
+        int call;           // index in the multicall, or -1
+        int code;
+        std::string message;
+      };
+      XmlRpcValue::ValueArray const& requests = *request.tryGet<XmlRpcValue::ValueArray>();
+      std::vector<Entry> entries(requests.size());
+      XmlRpcValue calls;
+      calls.setSize(0);
+      for (size_t i = 0; i < requests.size(); ++i) {
+        Entry& entry = entries[i];
+        std::string methodName;
+        XmlRpcValue params;
+        entry.call = -1;
+        if ( ! XmlRpcJson::parseCall(requests[i], methodName, params, entry.id, &entry.notification)) {
+          entry.notification = false;     // Invalid requests are always answered
+          entry.code = XmlRpcJson::INVALID_REQUEST;
+          entry.message = "invalid request";
+        } else if ( ! _server->findMethod(methodName) && methodName != SYSTEM_MULTICALL) {
+          entry.code = XmlRpcJson::METHOD_NOT_FOUND;
+          entry.message = methodName + ": unknown method name";
+        } else {
+          entry.call = calls.size();
+          XmlRpcValue& call = calls[entry.call];
+          call[METHODNAME] = methodName;
+          call[PARAMS] = params;
+        }
+      }
+
+      XmlRpcValue args, results;
+      XmlRpcException fault("");
+      args[0] = calls;
+      if (calls.size() > 0 && ! executeMulticall(args, results, fault))
+        throw fault;
+
+      body += '[';
+      for (size_t i = 0; i < entries.size(); ++i) {
+        Entry const& entry = entries[i];
+        if (entry.notification) continue;
+        if (body.size() > 1) body += ',';
+        if (entry.call < 0) {
+          XmlRpcJson::appendError(body, entry.code, entry.message, entry.id);
+          continue;
+        }
+        // A multicall result is an array holding the result, or a fault struct
+        XmlRpcValue& result = results[entry.call];
+        if (result.getType() == XmlRpcValue::TypeStruct)
+          XmlRpcJson::appendError(body, int(result[FAULTCODE]), std::string(result[FAULTSTRING]), entry.id);
+        else
+          XmlRpcJson::appendResult(body, result[0], entry.id);
+      }
+      body += ']';
+      if (body.size() == 2)
+        body.clear();
+    }
+
+  } catch (const XmlRpcException& fault) {
+    XmlRpcUtil::log(2, "XmlRpcServerConnection::executeJsonRequest: fault %s.",
+                    fault.getMessage().c_str());
+    body.clear();
+    XmlRpcJson::appendError(body, fault.getCode(), fault.getMessage(), XmlRpcValue());
+  }
+
+  setResponse(body);
+  XmlRpcUtil::log(5, "XmlRpcServerConnection::executeJsonRequest:\n%s\n", _response.c_str());
+}
+
+// Run a single JSON-RPC call, appending its response unless it is a notification
 void
-XmlRpcServerConnection::generateResponse(std::string const& resultXml)
+XmlRpcServerConnection::executeJsonCall(XmlRpcValue const& request, std::string& body)
 {
-  const char RESPONSE_1[] = 
-    "<?xml version=\"1.0\"?>\r\n"
-    "<methodResponse><params><param>\r\n\t";
-  const char RESPONSE_2[] =
-    "\r\n</param></params></methodResponse>\r\n";
+  std::string methodName;
+  XmlRpcValue params, id, result;
+  bool notification;
+  if ( ! XmlRpcJson::parseCall(request, methodName, params, id, &notification)) {
+    XmlRpcJson::appendError(body, XmlRpcJson::INVALID_REQUEST, "invalid request", id);
+    return;
+  }
+
+  XmlRpcUtil::log(2, "XmlRpcServerConnection::executeJsonCall: server calling method '%s'",
+                  methodName.c_str());
 
-  std::string body = RESPONSE_1 + resultXml + RESPONSE_2;
-  std::string header = generateHeader(body);
+  XmlRpcException fault("");
+  if ( ! _server->findMethod(methodName) && methodName != SYSTEM_MULTICALL)
+    fault = XmlRpcException(methodName + ": unknown method name", XmlRpcJson::METHOD_NOT_FOUND);
+  else if (executeMethod(methodName, params, result, fault)) {
+    if ( ! notification)
+      XmlRpcJson::appendResult(body, result, id);
+    return;
+  }
+
+  XmlRpcUtil::log(2, "XmlRpcServerConnection::executeJsonCall: fault %s.", fault.getMessage().c_str());
+  if ( ! notification)
+    XmlRpcJson::appendError(body, fault.getCode(), fault.getMessage(), id);
+}
 
-  _response = header + body;
+
+// Create a response from the result value. The result is serialized
+// once, directly into the response body. A result holding a large array
+// comes back in pieces encoded in parallel, which are sent as they are.
+void
+XmlRpcServerConnection::generateResponse(XmlRpcValue const& result)
+{
+  if (_encoding == BINARY_ENCODING) {
+    std::string body;
+    XmlRpcBinary::appendResponse(body, result);
+    setResponse(body);
+    return;
+  }
+
+  int parallelElements = _server->parallelEncoding();
+  if (parallelElements > 0 && (result.getType() == XmlRpcValue::TypeArray ||
+                               result.getType() == XmlRpcValue::TypeStruct)) {
+    std::vector<std::string> body(1, RESPONSE_PREFIX);
+    result.appendXml(body, parallelElements);
+    body.back() += RESPONSE_SUFFIX;
+    if (body.size() > 1) {
+      setResponse(body);
+      XmlRpcUtil::log(5, "XmlRpcServerConnection::generateResponse: %d buffers.", int(body.size()));
+      return;
+    }
+    setResponse(body[0]);
+  } else {
+    std::string body = RESPONSE_PREFIX;
+    result.appendXml(body);
+    body += RESPONSE_SUFFIX;
+    setResponse(body);
+  }
   XmlRpcUtil::log(5, "XmlRpcServerConnection::generateResponse:\n%s\n", _response.c_str()); 
 }
 
 // Prepend http headers
 std::string
-XmlRpcServerConnection::generateHeader(std::string const& body)
+XmlRpcServerConnection::generateHeader(size_t bodyLength)
 {
   std::string header = 
     "HTTP/1.1 200 OK\r\n"
     "Server: ";
   header += XMLRPC_VERSION;
   header += "\r\n"
-    "Content-Type: text/xml\r\n"
-    "Content-length: ";
+    "Content-Type: ";
+  header += (_encoding == BINARY_ENCODING) ? XmlRpcBinary::CONTENT_TYPE :
+            (_encoding == JSON_ENCODING) ? XmlRpcJson::CONTENT_TYPE : "text/xml";
+  header += "\r\n";
+
+  // Tell the client, which may have pipelined more requests, that they won't be answered
+  if ( ! _keepAlive)
+    header += "Connection: close\r\n";
+  header += "Content-length: ";
 
   char buffLen[40];
-  sprintf(buffLen,"%lu\r\n\r\n", body.size());
+  sprintf(buffLen,"%lu\r\n\r\n", (unsigned long) bodyLength);
 
   return header + buffLen;
 }
@@ -358,18 +680,53 @@ XmlRpcServerConnection::generateHeader(std::string const& body)
 void
 XmlRpcServerConnection::generateFaultResponse(std::string const& errorMsg, int errorCode)
 {
-  const char RESPONSE_1[] = 
-    "<?xml version=\"1.0\"?>\r\n"
-    "<methodResponse><fault>\r\n\t";
-  const char RESPONSE_2[] =
-    "\r\n</fault></methodResponse>\r\n";
-
-  XmlRpcValue faultStruct;
-  faultStruct[FAULTCODE] = errorCode;
-  faultStruct[FAULTSTRING] = errorMsg;
-  std::string body = RESPONSE_1 + faultStruct.toXml() + RESPONSE_2;
-  std::string header = generateHeader(body);
-
-  _response = header + body;
+  // Faults all have the same shape, so the xml is only rendered once
+  static const XmlRpcResponseTemplate faultTemplate = []() {
+    XmlRpcValue faultStruct;
+    faultStruct[FAULTCODE] = XmlRpcResponseTemplate::slot(0);
+    faultStruct[FAULTSTRING] = XmlRpcResponseTemplate::slot(1);
+    return XmlRpcResponseTemplate(faultStruct, XmlRpcResponseTemplate::Fault);
+  }();
+
+  std::string body;
+  if (_encoding == BINARY_ENCODING) {
+    XmlRpcValue faultStruct;
+    faultStruct[FAULTCODE] = errorCode;
+    faultStruct[FAULTSTRING] = errorMsg;
+    XmlRpcBinary::appendResponse(body, faultStruct, true);
+  } else
+    faultTemplate.render(body, { errorCode, errorMsg });
+
+  setResponse(body);
+}
+
+
+// Assemble the http header and the body into the outgoing response
+void
+XmlRpcServerConnection::setResponse(std::string const& body)
+{
+  std::string header = generateHeader(body.size());
+
+  _responseBuffers.clear();
+  _response.clear();
+  _response.reserve(header.size() + body.size());
+  _response += header;
+  _response += body;
+}
+
+// Keep the body in pieces after the header. The pieces are moved, not copied.
+void
+XmlRpcServerConnection::setResponse(std::vector<std::string>& body)
+{
+  size_t bodyLength = 0;
+  for (size_t i = 0; i < body.size(); ++i)
+    bodyLength += body[i].size();
+
+  _response.clear();
+  _responseBuffers.clear();
+  _responseBuffers.reserve(body.size() + 1);
+  _responseBuffers.push_back(generateHeader(bodyLength));
+  for (size_t i = 0; i < body.size(); ++i)
+    _responseBuffers.push_back(std::move(body[i]));
 }
 
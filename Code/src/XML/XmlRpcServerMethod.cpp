@@ -1,6 +1,9 @@
 
 #include "XmlRpcServerMethod.h"
 #include "XmlRpcServer.h"
+#include "XmlRpcException.h"
+#include "XmlRpcSchema.h"
+#include "XmlRpcUtil.h"
 
 namespace XmlRpc {
 
@@ -17,5 +20,43 @@ namespace XmlRpc {
     if (_server) _server->removeMethod(this);
   }
 
+  bool XmlRpcServerMethod::setSignature(std::string const& params, std::string const& result)
+  {
+    std::unique_ptr<XmlRpcSchema> schema(new XmlRpcSchema);
+    XmlRpcSchema resultSchema;
+    if ( ! schema->compile(params) || ! resultSchema.compile(result) || resultSchema.params() > 1) {
+      XmlRpcUtil::error("XmlRpcServerMethod::setSignature: %s: bad signature (%s).", _name.c_str(),
+                        schema->error().empty() ? resultSchema.error().c_str() : schema->error().c_str());
+      return false;
+    }
+
+    _schema = std::move(schema);
+    _resultType = resultSchema.params() ? resultSchema.signature()[0] : "any";
+    return true;
+  }
+
+  // Not called back into tryExecute(), so that a method defining neither
+  // faults rather than recursing
+  void XmlRpcServerMethod::execute(XmlRpcValue&, XmlRpcValue&)
+  {
+    throw XmlRpcException(_name + ": method not implemented");
+  }
+
+  bool XmlRpcServerMethod::executeXml(XmlRpcValue&, std::string&)
+  {
+    return false;
+  }
+
+  bool XmlRpcServerMethod::tryExecute(XmlRpcValue& params, XmlRpcValue& result, XmlRpcException& fault)
+  {
+    try {
+      execute(params, result);
+    } catch (const XmlRpcException& e) {
+      fault = e;
+      return false;
+    }
+    return true;
+  }
+
 
 } // namespace XmlRpc
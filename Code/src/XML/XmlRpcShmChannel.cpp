@@ -0,0 +1,491 @@
+
+#include "XmlRpcShmChannel.h"
+#include "XmlRpcBuffer.h"
+#include "XmlRpcUtil.h"
+
+#ifndef MAKEDEPEND
+# include <atomic>
+# include <chrono>
+# include <new>
+# include <thread>
+# include <stdint.h>
+# include <string.h>
+# if defined(__linux__)
+extern "C" {
+#  include <errno.h>
+#  include <fcntl.h>
+#  include <unistd.h>
+#  include <sys/epoll.h>
+#  include <sys/eventfd.h>
+#  include <sys/mman.h>
+#  include <sys/socket.h>
+#  include <sys/stat.h>
+}
+# endif
+#endif
+
+using namespace XmlRpc;
+
+
+static const char SHM_PREFIX[] = "shm:";
+
+bool
+XmlRpcShmChannel::isEndpoint(std::string const& endpoint, std::string* path)
+{
+  if (endpoint.compare(0, sizeof(SHM_PREFIX) - 1, SHM_PREFIX) != 0)
+    return false;
+  if (path)
+    path->assign(endpoint, sizeof(SHM_PREFIX) - 1, std::string::npos);
+  return true;
+}
+
+
+#if defined(__linux__)
+
+// The start of the shared memory; the two rings follow it. Ring r is written
+// by side r (0 the client, 1 the server) and read by the other side. Each
+// field written by one side is on its own cache line.
+struct XmlRpcShmChannel::Segment {
+  uint32_t magic;
+  uint32_t ringSize;
+
+  struct alignas(64) Side {
+    std::atomic<uint32_t> waiting;    // Sleeping until signalled
+    std::atomic<uint32_t> closed;
+  } sides[2];
+
+  struct alignas(64) Position {
+    std::atomic<uint64_t> value;
+  } head[2], tail[2];                 // Bytes written to and read from each ring
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "shared memory positions must be lock free");
+
+static const uint32_t SEGMENT_MAGIC = 0x58525348;
+static const size_t MIN_RING_SIZE = 4096;
+static const size_t MAX_RING_SIZE = size_t(1) << 30;
+static const int CHANNEL_FDS = 3;               // Segment, server wakeup, client wakeup
+
+
+static inline void cpuRelax()
+{
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#elif defined(__aarch64__)
+  __asm__ __volatile__("yield");
+#endif
+}
+
+static void closeFd(int fd)
+{
+  if (fd >= 0) ::close(fd);
+}
+
+
+XmlRpcShmChannel::XmlRpcShmChannel(Segment* segment, size_t mappedSize, size_t ringSize, int side,
+                                   int socket, int wakeFd, int peerWakeFd, int epollFd) :
+  _segment(segment), _mappedSize(mappedSize), _ringSize(ringSize), _side(side),
+  _readPosition(0), _writePosition(0),
+  _socket(socket), _wakeFd(wakeFd), _peerWakeFd(peerWakeFd), _epollFd(epollFd), _peerGone(false)
+{
+  char* rings = reinterpret_cast<char*>(segment + 1);
+  _out = rings + side * ringSize;
+  _in = rings + (1 - side) * ringSize;
+}
+
+
+XmlRpcShmChannel*
+XmlRpcShmChannel::create(Segment* segment, size_t mappedSize, size_t ringSize, int side,
+                         int socket, int wakeFd, int peerWakeFd)
+{
+  int epollFd = epoll_create1(EPOLL_CLOEXEC);
+  if (epollFd < 0)
+    return 0;
+
+  struct epoll_event event;
+  memset(&event, 0, sizeof(event));
+  event.events = EPOLLIN;
+  event.data.fd = wakeFd;
+  bool ok = epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd, &event) == 0;
+  event.events = EPOLLIN | EPOLLRDHUP;
+  event.data.fd = socket;
+  ok = ok && epoll_ctl(epollFd, EPOLL_CTL_ADD, socket, &event) == 0;
+  if ( ! ok) {
+    ::close(epollFd);
+    return 0;
+  }
+
+  return new XmlRpcShmChannel(segment, mappedSize, ringSize, side, socket, wakeFd, peerWakeFd, epollFd);
+}
+
+
+XmlRpcShmChannel*
+XmlRpcShmChannel::connect(int socket)
+{
+  size_t size = sizeof(Segment) + 2 * RING_SIZE;
+  int memFd = memfd_create("xmlrpc-shm", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+  if (memFd < 0) {
+    XmlRpcUtil::error("XmlRpcShmChannel::connect: could not create shared memory (%d).", errno);
+    return 0;
+  }
+
+  // The server maps the memory too, so it must not be able to shrink under it
+  void* p = MAP_FAILED;
+  if (ftruncate(memFd, off_t(size)) == 0 &&
+      fcntl(memFd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) == 0)
+    p = mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED, memFd, 0);
+  int clientWake = (p != MAP_FAILED) ? eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC) : -1;
+  int serverWake = (p != MAP_FAILED) ? eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC) : -1;
+
+  XmlRpcShmChannel* channel = 0;
+  if (clientWake >= 0 && serverWake >= 0) {
+    Segment* segment = new (p) Segment();
+    segment->magic = SEGMENT_MAGIC;
+    segment->ringSize = uint32_t(RING_SIZE);
+
+    // Send the memory and the wakeup descriptors with a single byte of data
+    int fds[CHANNEL_FDS] = { memFd, serverWake, clientWake };
+    char byte = 'S';
+    struct iovec iov;
+    iov.iov_base = &byte;
+    iov.iov_len = 1;
+    union {
+      char buf[CMSG_SPACE(sizeof(fds))];
+      struct cmsghdr align;
+    } control;
+    memset(&control, 0, sizeof(control));
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+    if (sendmsg(socket, &msg, MSG_NOSIGNAL) == 1)
+      channel = create(segment, size, RING_SIZE, 0, socket, clientWake, serverWake);
+  }
+  int error = errno;
+
+  ::close(memFd);     // The mapping keeps the memory
+  if ( ! channel) {
+    if (p != MAP_FAILED) munmap(p, size);
+    closeFd(clientWake);
+    closeFd(serverWake);
+    XmlRpcUtil::error("XmlRpcShmChannel::connect: could not set up the channel (%d).", error);
+  }
+  return channel;
+}
+
+
+XmlRpcShmChannel*
+XmlRpcShmChannel::accept(int socket, bool* wouldBlock)
+{
+  *wouldBlock = false;
+
+  int fds[CHANNEL_FDS];
+  char byte = 0;
+  struct iovec iov;
+  iov.iov_base = &byte;
+  iov.iov_len = 1;
+  union {
+    char buf[CMSG_SPACE(sizeof(fds))];
+    struct cmsghdr align;
+  } control;
+  struct msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.buf;
+  msg.msg_controllen = sizeof(control.buf);
+
+  ssize_t n = recvmsg(socket, &msg, MSG_CMSG_CLOEXEC);
+  if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+    *wouldBlock = true;
+    return 0;
+  }
+
+  // Take whatever descriptors came, so that none are leaked
+  int nFds = 0;
+  struct cmsghdr* cmsg = (n > 0) ? CMSG_FIRSTHDR(&msg) : 0;
+  if (cmsg && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+    nFds = int((cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+    if (nFds > CHANNEL_FDS) nFds = CHANNEL_FDS;
+    memcpy(fds, CMSG_DATA(cmsg), nFds * sizeof(int));
+  }
+  if (n != 1 || byte != 'S' || nFds != CHANNEL_FDS || (msg.msg_flags & MSG_CTRUNC)) {
+    for (int i = 0; i < nFds; ++i)
+      ::close(fds[i]);
+    XmlRpcUtil::error("XmlRpcShmChannel::accept: the client did not send a channel.");
+    return 0;
+  }
+  int memFd = fds[0], serverWake = fds[1], clientWake = fds[2];
+
+  // Check the memory can't shrink and is as large as the header says, before
+  // trusting it
+  struct stat st;
+  void* p = MAP_FAILED;
+  size_t size = 0, ringSize = 0;
+  int seals = fcntl(memFd, F_GET_SEALS);
+  if (seals >= 0 && (seals & F_SEAL_SHRINK) && fstat(memFd, &st) == 0 &&
+      size_t(st.st_size) >= sizeof(Segment) && size_t(st.st_size) <= sizeof(Segment) + 2 * MAX_RING_SIZE) {
+    size = size_t(st.st_size);
+    p = mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED, memFd, 0);
+  }
+  ::close(memFd);
+
+  XmlRpcShmChannel* channel = 0;
+  if (p != MAP_FAILED) {
+    Segment* segment = static_cast<Segment*>(p);
+    ringSize = segment->ringSize;
+    bool valid = segment->magic == SEGMENT_MAGIC &&
+                 ringSize >= MIN_RING_SIZE && ringSize <= MAX_RING_SIZE &&
+                 (ringSize & (ringSize - 1)) == 0 &&
+                 sizeof(Segment) + 2 * ringSize <= size;
+    // Never block on the client's descriptors
+    valid = valid && fcntl(serverWake, F_SETFL, O_NONBLOCK) == 0 && fcntl(clientWake, F_SETFL, O_NONBLOCK) == 0;
+    if (valid)
+      channel = create(segment, size, ringSize, 1, socket, serverWake, clientWake);
+    if ( ! channel)
+      munmap(p, size);
+  }
+
+  if ( ! channel) {
+    ::close(serverWake);
+    ::close(clientWake);
+    XmlRpcUtil::error("XmlRpcShmChannel::accept: invalid channel from the client.");
+  }
+  return channel;
+}
+
+
+XmlRpcShmChannel::~XmlRpcShmChannel()
+{
+  // Wake the other side whether or not it is waiting, so it sees the close
+  _segment->sides[_side].closed.store(1, std::memory_order_seq_cst);
+  uint64_t one = 1;
+  (void) ::write(_peerWakeFd, &one, sizeof(one));
+
+  munmap(_segment, _mappedSize);
+  ::close(_epollFd);
+  ::close(_wakeFd);
+  ::close(_peerWakeFd);
+  ::close(_socket);
+}
+
+
+void
+XmlRpcShmChannel::clearWakeup()
+{
+  _segment->sides[_side].waiting.store(0, std::memory_order_relaxed);
+
+  uint64_t count;
+  if (::read(_wakeFd, &count, sizeof(count)) < 0) {
+    // Not signalled, so it is the socket: the other side has gone (nothing
+    // else is ever sent on it)
+    char c;
+    ssize_t n = recv(_socket, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+    if (n >= 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+      _peerGone = true;
+  }
+}
+
+
+void
+XmlRpcShmChannel::wake()
+{
+  uint64_t one = 1;
+  (void) ::write(_wakeFd, &one, sizeof(one));
+}
+
+
+bool
+XmlRpcShmChannel::ready(bool reading, bool writing) const
+{
+  Segment::Side const& peer = _segment->sides[1 - _side];
+  if (_peerGone || peer.closed.load(std::memory_order_acquire))
+    return true;
+  if (writing && _writePosition - _segment->tail[_side].value.load(std::memory_order_acquire) < _ringSize)
+    return true;
+  return reading && _segment->head[1 - _side].value.load(std::memory_order_acquire) != _readPosition;
+}
+
+
+// Signal the other side if it is waiting for data or room
+void
+XmlRpcShmChannel::signalPeer()
+{
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  std::atomic<uint32_t>& waiting = _segment->sides[1 - _side].waiting;
+  if (waiting.load(std::memory_order_relaxed) && waiting.exchange(0)) {
+    uint64_t one = 1;
+    (void) ::write(_peerWakeFd, &one, sizeof(one));
+  }
+}
+
+
+bool
+XmlRpcShmChannel::read(XmlRpcBuffer& s, bool* eof, size_t /*expected*/)
+{
+  // Check for a close before looking for data, so no data sent before it is missed
+  *eof = false;
+  bool closed = _peerGone || _segment->sides[1 - _side].closed.load(std::memory_order_acquire);
+  uint64_t head = _segment->head[1 - _side].value.load(std::memory_order_acquire);
+  uint64_t available = head - _readPosition;
+  if (available > _ringSize) {
+    XmlRpcUtil::error("XmlRpcShmChannel::read: the ring is corrupt.");
+    return false;
+  }
+  if (available == 0) {
+    *eof = closed;
+    return true;
+  }
+
+  // The buffer grows by what is in the ring, not by what the peer claims
+  size_t offset = size_t(_readPosition & (_ringSize - 1));
+  size_t first = (size_t(available) < _ringSize - offset) ? size_t(available) : _ringSize - offset;
+  s.append(_in + offset, first);
+  s.append(_in, size_t(available) - first);
+
+  _readPosition = head;
+  _segment->tail[1 - _side].value.store(_readPosition, std::memory_order_release);
+  signalPeer();
+  return true;
+}
+
+
+// Copy as much as fits into the outgoing ring. Returns the bytes copied, or -1
+// if the ring is corrupt.
+int
+XmlRpcShmChannel::append(const char* data, size_t length)
+{
+  uint64_t used = _writePosition - _segment->tail[_side].value.load(std::memory_order_acquire);
+  if (used > _ringSize)
+    return -1;
+
+  size_t n = _ringSize - size_t(used);
+  if (length < n) n = length;
+  size_t offset = size_t(_writePosition & (_ringSize - 1));
+  size_t first = (n < _ringSize - offset) ? n : _ringSize - offset;
+  memcpy(_out + offset, data, first);
+  memcpy(_out, data + first, n - first);
+
+  _writePosition += n;
+  _segment->head[_side].value.store(_writePosition, std::memory_order_release);
+  return int(n);
+}
+
+
+bool
+XmlRpcShmChannel::write(std::string const& s, int* bytesSoFar)
+{
+  if (_peerGone || _segment->sides[1 - _side].closed.load(std::memory_order_acquire))
+    return false;
+
+  int n = append(s.data() + *bytesSoFar, s.size() - size_t(*bytesSoFar));
+  if (n < 0) {
+    XmlRpcUtil::error("XmlRpcShmChannel::write: the ring is corrupt.");
+    return false;
+  }
+  if (n > 0) {
+    *bytesSoFar += n;
+    signalPeer();
+  }
+  return true;
+}
+
+
+bool
+XmlRpcShmChannel::writeV(std::vector<std::string> const& buffers, int* bytesSoFar)
+{
+  if (_peerGone || _segment->sides[1 - _side].closed.load(std::memory_order_acquire))
+    return false;
+
+  // Skip the buffers already written, then copy until the ring is full
+  size_t i = 0;
+  size_t offset = size_t(*bytesSoFar);
+  while (i < buffers.size() && offset >= buffers[i].size())
+    offset -= buffers[i++].size();
+
+  int total = 0;
+  for (; i < buffers.size(); ++i, offset = 0) {
+    size_t length = buffers[i].size() - offset;
+    int n = append(buffers[i].data() + offset, length);
+    if (n < 0) {
+      XmlRpcUtil::error("XmlRpcShmChannel::writeV: the ring is corrupt.");
+      return false;
+    }
+    total += n;
+    if (size_t(n) < length)
+      break;
+  }
+
+  if (total > 0) {
+    *bytesSoFar += total;
+    signalPeer();
+  }
+  return true;
+}
+
+
+bool
+XmlRpcShmChannel::wait(bool reading, bool writing, int spinMicroseconds)
+{
+  if (ready(reading, writing))
+    return true;
+
+  // With a single cpu, spinning only keeps the other side from running
+  static const bool multipleCpus = std::thread::hardware_concurrency() > 1;
+  if (spinMicroseconds > 0 && multipleCpus) {
+    std::chrono::steady_clock::time_point end =
+      std::chrono::steady_clock::now() + std::chrono::microseconds(spinMicroseconds);
+    do {
+      for (int i = 0; i < 64; ++i) {
+        if (ready(reading, writing))
+          return true;
+        cpuRelax();
+      }
+    } while (std::chrono::steady_clock::now() < end);
+  }
+
+  // Ask to be signalled, then check again in case the other side got in first
+  std::atomic<uint32_t>& waiting = _segment->sides[_side].waiting;
+  waiting.store(1, std::memory_order_seq_cst);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (ready(reading, writing)) {
+    waiting.store(0, std::memory_order_relaxed);
+    return true;
+  }
+  return false;
+}
+
+#else   // Not Linux
+
+XmlRpcShmChannel*
+XmlRpcShmChannel::connect(int)
+{
+  XmlRpcUtil::error("XmlRpcShmChannel::connect: shared memory connections are not supported on this system.");
+  return 0;
+}
+
+XmlRpcShmChannel*
+XmlRpcShmChannel::accept(int, bool* wouldBlock)
+{
+  *wouldBlock = false;
+  XmlRpcUtil::error("XmlRpcShmChannel::accept: shared memory connections are not supported on this system.");
+  return 0;
+}
+
+XmlRpcShmChannel::~XmlRpcShmChannel() {}
+void XmlRpcShmChannel::clearWakeup() {}
+void XmlRpcShmChannel::wake() {}
+bool XmlRpcShmChannel::read(XmlRpcBuffer&, bool*, size_t) { return false; }
+bool XmlRpcShmChannel::write(std::string const&, int*) { return false; }
+bool XmlRpcShmChannel::writeV(std::vector<std::string> const&, int*) { return false; }
+bool XmlRpcShmChannel::wait(bool, bool, int) { return true; }
+
+#endif  // __linux__
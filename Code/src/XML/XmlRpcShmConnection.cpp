@@ -0,0 +1,77 @@
+
+#include "XmlRpcShmConnection.h"
+#include "XmlRpcShmChannel.h"
+#include "XmlRpcDispatch.h"
+#include "XmlRpcServer.h"
+#include "XmlRpcUtil.h"
+
+using namespace XmlRpc;
+
+
+XmlRpcShmConnection::XmlRpcShmConnection(int fd, XmlRpcServer* server, bool deleteOnClose /*= false*/) :
+  XmlRpcServerConnection(fd, server, deleteOnClose), _channel(0)
+{
+}
+
+
+XmlRpcShmConnection::~XmlRpcShmConnection()
+{
+  delete _channel;
+}
+
+
+unsigned
+XmlRpcShmConnection::handleEvent(unsigned eventType)
+{
+  if ( ! _channel) {
+    bool wouldBlock;
+    _channel = XmlRpcShmChannel::accept(getfd(), &wouldBlock);
+    if ( ! _channel)
+      return wouldBlock ? XmlRpcDispatch::ReadableEvent : 0;
+
+    // The channel owns the socket now; watch for its signals instead
+    XmlRpcUtil::log(2, "XmlRpcShmConnection: channel received on socket %d.", getfd());
+    setfd(_channel->fd());
+  }
+  else
+    _channel->clearWakeup();
+
+  // Keep going while there is something to do, then sleep until the client
+  // signals. The channel is always watched for reading, as a signal is sent
+  // for room to write too.
+  int spin = _server->socketOptions().busyPoll;
+  for (;;) {
+    if ( ! XmlRpcServerConnection::handleEvent(eventType))
+      return 0;
+    if ( ! _channel->wait(_connectionState != WRITE_RESPONSE, _connectionState == WRITE_RESPONSE, spin))
+      return XmlRpcDispatch::ReadableEvent;
+  }
+}
+
+
+void
+XmlRpcShmConnection::close()
+{
+  if (_channel) {
+    setfd(-1);
+    delete _channel;
+    _channel = 0;
+  }
+  XmlRpcServerConnection::close();
+}
+
+
+bool
+XmlRpcShmConnection::readData(XmlRpcBuffer& s, bool* eof, size_t expected)
+{
+  return _channel->read(s, eof, expected);
+}
+
+
+bool
+XmlRpcShmConnection::writeData(int* bytesSoFar)
+{
+  return _responseBuffers.empty()
+       ? _channel->write(_response, bytesSoFar)
+       : _channel->writeV(_responseBuffers, bytesSoFar);
+}
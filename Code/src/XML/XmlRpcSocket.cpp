@@ -1,8 +1,10 @@
 
 #include "XmlRpcSocket.h"
+#include "XmlRpcBuffer.h"
 #include "XmlRpcUtil.h"
 
 #ifndef MAKEDEPEND
+#include <atomic>
 #include <strings.h>
 #include <string.h>
 using namespace std;
@@ -11,6 +13,7 @@ using namespace std;
 # include <stdio.h>
 
 # include <winsock2.h>
+# include <ws2tcpip.h>
 //# pragma lib(WS2_32.lib)
 
 # define EINPROGRESS	WSAEINPROGRESS
@@ -23,9 +26,14 @@ extern "C" {
 # include <sys/types.h>
 # include <sys/socket.h>
 # include <netinet/in.h>
+# include <netinet/tcp.h>
 # include <netdb.h>
 # include <errno.h>
 # include <fcntl.h>
+# include <limits.h>
+# include <sys/uio.h>
+# include <sys/un.h>
+# include <sys/stat.h>
 }
 #endif  // _WINDOWS
 
@@ -110,6 +118,85 @@ XmlRpcSocket::setNonBlocking(int fd)
 }
 
 
+XmlRpcSocket::Options
+XmlRpcSocket::Options::lowLatency()
+{
+  Options options;
+  options.noDelay = true;
+  options.deferAccept = 1;
+  options.fastOpen = 16;
+  options.busyPoll = 50;
+  return options;
+}
+
+XmlRpcSocket::Options
+XmlRpcSocket::Options::bulk()
+{
+  Options options;
+  options.deferAccept = 1;
+  options.receiveBuffer = 4 << 20;
+  options.sendBuffer = 4 << 20;
+  return options;
+}
+
+
+static bool setIntOption(int fd, int level, int name, int value, const char* what)
+{
+  if (setsockopt(fd, level, name, (const char *)&value, sizeof(value)) == 0)
+    return true;
+  XmlRpcUtil::log(2, "XmlRpcSocket: could not set %s on fd %d (%s).", what, fd,
+                  XmlRpcSocket::getErrorMsg().c_str());
+  return false;
+}
+
+bool
+XmlRpcSocket::setOptions(int fd, Options const& options)
+{
+  bool ok = true;
+  if (options.noDelay)
+    ok &= setIntOption(fd, IPPROTO_TCP, TCP_NODELAY, 1, "TCP_NODELAY");
+#if defined(TCP_QUICKACK)
+  if (options.quickAck)
+    ok &= setIntOption(fd, IPPROTO_TCP, TCP_QUICKACK, 1, "TCP_QUICKACK");
+#endif
+  if (options.receiveBuffer > 0)
+    ok &= setIntOption(fd, SOL_SOCKET, SO_RCVBUF, options.receiveBuffer, "SO_RCVBUF");
+  if (options.sendBuffer > 0)
+    ok &= setIntOption(fd, SOL_SOCKET, SO_SNDBUF, options.sendBuffer, "SO_SNDBUF");
+#if defined(SO_BUSY_POLL)
+  if (options.busyPoll > 0)
+    ok &= setIntOption(fd, SOL_SOCKET, SO_BUSY_POLL, options.busyPoll, "SO_BUSY_POLL");
+#endif
+  return ok;
+}
+
+bool
+XmlRpcSocket::setConnectOptions(int fd, Options const& options)
+{
+  bool ok = setOptions(fd, options);
+#if defined(TCP_FASTOPEN_CONNECT)
+  if (options.fastOpen > 0)
+    ok &= setIntOption(fd, IPPROTO_TCP, TCP_FASTOPEN_CONNECT, 1, "TCP_FASTOPEN_CONNECT");
+#endif
+  return ok;
+}
+
+bool
+XmlRpcSocket::setListenOptions(int fd, Options const& options)
+{
+  bool ok = setOptions(fd, options);
+#if defined(TCP_DEFER_ACCEPT)
+  if (options.deferAccept > 0)
+    ok &= setIntOption(fd, IPPROTO_TCP, TCP_DEFER_ACCEPT, options.deferAccept, "TCP_DEFER_ACCEPT");
+#endif
+#if defined(TCP_FASTOPEN)
+  if (options.fastOpen > 0)
+    ok &= setIntOption(fd, IPPROTO_TCP, TCP_FASTOPEN, options.fastOpen, "TCP_FASTOPEN");
+#endif
+  return ok;
+}
+
+
 bool
 XmlRpcSocket::setReuseAddr(int fd)
 {
@@ -160,53 +247,250 @@ XmlRpcSocket::accept(int fd)
 bool
 XmlRpcSocket::connect(int fd, std::string& host, int port)
 {
-  struct sockaddr_in saddr;
-  memset(&saddr, 0, sizeof(saddr));
-  saddr.sin_family = AF_INET;
+  Address address;
+  return resolve(host, port, &address) && connect(fd, address);
+}
 
-  struct hostent *hp = gethostbyname(host.c_str());
-  if (hp == 0) return false;
 
-  saddr.sin_family = hp->h_addrtype;
-  memcpy(&saddr.sin_addr, hp->h_addr, hp->h_length);
-  saddr.sin_port = htons((u_short) port);
+// Look up an IPv4 address, as the sockets are AF_INET
+static bool lookup(std::string const& host, int port, int flags, XmlRpcSocket::Address* address)
+{
+  initWinSock();
+  struct addrinfo hints;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_flags = flags;
+
+  struct addrinfo* result = 0;
+  if (getaddrinfo(host.c_str(), 0, &hints, &result) != 0 || result == 0)
+    return false;
+
+  bool ok = result->ai_addrlen <= sizeof(address->data);
+  if (ok) {
+    memcpy(address->data, result->ai_addr, result->ai_addrlen);
+    address->length = int(result->ai_addrlen);
+    struct sockaddr_in* saddr = (struct sockaddr_in*) address->data;
+    saddr->sin_port = htons((u_short) port);
+  }
+  freeaddrinfo(result);
+  return ok;
+}
 
+bool
+XmlRpcSocket::numericAddress(std::string const& host, int port, Address* address)
+{
+  return lookup(host, port, AI_NUMERICHOST, address);
+}
+
+bool
+XmlRpcSocket::resolve(std::string const& host, int port, Address* address)
+{
+  return lookup(host, port, 0, address);
+}
+
+bool
+XmlRpcSocket::connect(int fd, Address const& address)
+{
   // For asynch operation, this will return EWOULDBLOCK (windows) or
   // EINPROGRESS (linux) and we just need to wait for the socket to be writable...
-  int result = ::connect(fd, (struct sockaddr *)&saddr, sizeof(saddr));
+  int result = ::connect(fd, (const struct sockaddr *) address.data, address.length);
   return result == 0 || nonFatalError();
 }
 
+bool
+XmlRpcSocket::isStale(int fd)
+{
+  char c;
+  int n = recv(fd, &c, 1, MSG_PEEK);
+  return n >= 0 || ! nonFatalError();
+}
+
+
+static const char UNIX_PREFIX[] = "unix:";
+
+bool
+XmlRpcSocket::isUnixEndpoint(std::string const& endpoint, std::string* path)
+{
+  if (endpoint.compare(0, sizeof(UNIX_PREFIX) - 1, UNIX_PREFIX) != 0)
+    return false;
+  if (path)
+    path->assign(endpoint, sizeof(UNIX_PREFIX) - 1, std::string::npos);
+  return true;
+}
+
+
+#if defined(_WINDOWS)
+
+int XmlRpcSocket::unixSocket() { WSASetLastError(WSAEAFNOSUPPORT); return -1; }
+bool XmlRpcSocket::bindUnix(int, std::string const&) { WSASetLastError(WSAEAFNOSUPPORT); return false; }
+bool XmlRpcSocket::connectUnix(int, std::string const&, bool*) { WSASetLastError(WSAEAFNOSUPPORT); return false; }
+void XmlRpcSocket::removeUnix(std::string const&) {}
+
+#else
+
+// Fill in the address of a socket path. Returns false if the path is too long.
+static bool unixAddress(std::string const& path, struct sockaddr_un* addr)
+{
+  memset(addr, 0, sizeof(*addr));
+  addr->sun_family = AF_UNIX;
+  if (path.empty() || path.size() >= sizeof(addr->sun_path)) {
+    errno = ENAMETOOLONG;
+    return false;
+  }
+  memcpy(addr->sun_path, path.data(), path.size());
+  return true;
+}
+
+int
+XmlRpcSocket::unixSocket()
+{
+  return (int) ::socket(AF_UNIX, SOCK_STREAM, 0);
+}
+
+bool
+XmlRpcSocket::bindUnix(int fd, std::string const& path)
+{
+  struct sockaddr_un addr;
+  if ( ! unixAddress(path, &addr))
+    return false;
+  if (::bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0)
+    return true;
+
+  // A socket file nobody is listening on is left over from an earlier server
+  struct stat st;
+  if (errno != EADDRINUSE || stat(path.c_str(), &st) != 0 || ! S_ISSOCK(st.st_mode))
+    return false;
+  int probe = unixSocket();
+  if (probe < 0)
+    return false;
+  bool live = ::connect(probe, (struct sockaddr *)&addr, sizeof(addr)) == 0 || errno != ECONNREFUSED;
+  ::close(probe);
+  if (live) {
+    errno = EADDRINUSE;
+    return false;
+  }
+
+  XmlRpcUtil::log(2, "XmlRpcSocket::bindUnix: replacing stale socket %s.", path.c_str());
+  ::unlink(path.c_str());
+  return (::bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0);
+}
+
+bool
+XmlRpcSocket::connectUnix(int fd, std::string const& path, bool* wouldBlock)
+{
+  if (wouldBlock)
+    *wouldBlock = false;
+  struct sockaddr_un addr;
+  if ( ! unixAddress(path, &addr))
+    return false;
+  if (::connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0)
+    return true;
+  if ( ! wouldBlock || ! nonFatalError())
+    return false;
+  *wouldBlock = true;
+  return true;
+}
+
+void
+XmlRpcSocket::removeUnix(std::string const& path)
+{
+  ::unlink(path.c_str());
+}
+
+#endif // _WINDOWS
+
+
+
+// System call counts for ioCounters(). They are shared by every thread doing
+// socket io, so are only kept when built with XMLRPC_IO_COUNTERS.
+static std::atomic<unsigned long long> readCalls(0), readBytes(0), writeCalls(0), writeBytes(0);
+
+static void countIo(std::atomic<unsigned long long>& calls, std::atomic<unsigned long long>& bytes, int n)
+{
+#if defined(XMLRPC_IO_COUNTERS)
+  calls.fetch_add(1, std::memory_order_relaxed);
+  if (n > 0)
+    bytes.fetch_add((unsigned long long) n, std::memory_order_relaxed);
+#else
+  (void) calls; (void) bytes; (void) n;
+#endif
+}
+
+XmlRpcSocket::IoCounters
+XmlRpcSocket::ioCounters()
+{
+  IoCounters counters;
+  counters.reads = readCalls.load(std::memory_order_relaxed);
+  counters.bytesRead = readBytes.load(std::memory_order_relaxed);
+  counters.writes = writeCalls.load(std::memory_order_relaxed);
+  counters.bytesWritten = writeBytes.load(std::memory_order_relaxed);
+  return counters;
+}
+
+
+// Read sizes. Data is read into room made at the end of the buffer, of the
+// expected size if that is known, but never more than twice the size of the
+// last read: the buffer grows in steps as data arrives, not by what the peer
+// claims it will send. Anything beyond the room lands in an overflow buffer on
+// the stack (in the same call, with readv) and is appended from there.
+static const size_t MIN_READ = 4096;
+static const size_t MAX_READ = 1 << 20;
+static const size_t OVERFLOW_SIZE = 65536;
 
+// Read into room, then overflow. Returns the bytes read, 0 at eof or -1.
+static int readInto(int fd, char* room, size_t roomSize, char* overflow)
+{
+#if defined(_WINDOWS)
+  (void) overflow;
+  return recv(fd, room, int(roomSize), 0);
+#else
+  struct iovec iov[2];
+  iov[0].iov_base = room;
+  iov[0].iov_len = roomSize;
+  iov[1].iov_base = overflow;
+  iov[1].iov_len = OVERFLOW_SIZE;
+  return int(readv(fd, iov, 2));
+#endif
+}
 
 // Read available text from the specified socket. Returns false on error.
 bool 
-XmlRpcSocket::nbRead(int fd, std::string& s, bool *eof)
+XmlRpcSocket::nbRead(int fd, XmlRpcBuffer& s, bool *eof, size_t expected)
 {
-  const int READ_SIZE = 4096;   // Number of bytes to attempt to read at a time
-  char readBuf[READ_SIZE];
-
+  char overflow[OVERFLOW_SIZE];
+  size_t lastRead = MIN_READ;
   bool wouldBlock = false;
   *eof = false;
 
   while ( ! wouldBlock && ! *eof) {
-#if defined(_WINDOWS)
-    int n = recv(fd, readBuf, READ_SIZE-1, 0);
-#else
-    int n = read(fd, readBuf, READ_SIZE-1);
-#endif
+    size_t room = (expected > 0) ? expected : 2 * lastRead;
+    if (room > 2 * lastRead) room = 2 * lastRead;   // Don't make room the socket won't fill
+    if (room < MIN_READ) room = MIN_READ;
+    if (room > MAX_READ) room = MAX_READ;
+    if (room < s.spare()) room = s.spare();   // Free space already there costs nothing
+
+    int n = readInto(fd, s.room(room), room, overflow);
+    countIo(readCalls, readBytes, n);
     XmlRpcUtil::log(5, "XmlRpcSocket::nbRead: read/recv returned %d.", n);
 
-
     if (n > 0) {
-      readBuf[n] = 0;
-      s.append(readBuf, n);
-    } else if (n == 0) {
-      *eof = true;
-    } else if (nonFatalError()) {
-      wouldBlock = true;
+      if (size_t(n) <= room) {
+        s.commit(size_t(n));
+      } else {
+        s.commit(room);
+        s.append(overflow, size_t(n) - room);
+      }
+      lastRead = size_t(n);
+      expected = (expected > size_t(n)) ? expected - size_t(n) : 0;
     } else {
-      return false;   // Error
+      if (n == 0) {
+        *eof = true;
+      } else if (nonFatalError()) {
+        wouldBlock = true;
+      } else {
+        return false;   // Error
+      }
     }
   }
   return true;
@@ -224,9 +508,12 @@ XmlRpcSocket::nbWrite(int fd, std::string& s, int *bytesSoFar)
   while ( nToWrite > 0 && ! wouldBlock ) {
 #if defined(_WINDOWS)
     int n = send(fd, sp, nToWrite, 0);
+#elif defined(MSG_NOSIGNAL)
+    int n = int(send(fd, sp, nToWrite, MSG_NOSIGNAL));
 #else
     int n = write(fd, sp, nToWrite);
 #endif
+    countIo(writeCalls, writeBytes, n);
     XmlRpcUtil::log(5, "XmlRpcSocket::nbWrite: send/write returned %d.", n);
 
     if (n > 0) {
@@ -243,6 +530,63 @@ XmlRpcSocket::nbWrite(int fd, std::string& s, int *bytesSoFar)
 }
 
 
+// Write buffers to the specified socket, gathering as many as the system allows
+// into each write. Returns false on error.
+bool 
+XmlRpcSocket::nbWriteV(int fd, std::vector<std::string> const& buffers, int *bytesSoFar)
+{
+  // Skip the buffers (and empty buffers) already written
+  size_t first = 0;
+  size_t offset = size_t(*bytesSoFar);
+  while (first < buffers.size() && offset >= buffers[first].size())
+    offset -= buffers[first++].size();
+
+  bool wouldBlock = false;
+  while (first < buffers.size() && ! wouldBlock) {
+#if defined(_WINDOWS)
+    int n = send(fd, buffers[first].data() + offset, int(buffers[first].size() - offset), 0);
+#else
+# if defined(IOV_MAX) && IOV_MAX < 64
+    const int maxIov = IOV_MAX;
+# else
+    const int maxIov = 64;
+# endif
+    struct iovec iov[64];
+    int nIov = 0;
+    for (size_t i = first; i < buffers.size() && nIov < maxIov; ++i) {
+      size_t skip = (i == first) ? offset : 0;
+      iov[nIov].iov_base = const_cast<char*>(buffers[i].data()) + skip;
+      iov[nIov].iov_len = buffers[i].size() - skip;
+      ++nIov;
+    }
+# if defined(MSG_NOSIGNAL)
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = nIov;
+    int n = int(sendmsg(fd, &msg, MSG_NOSIGNAL));
+# else
+    int n = int(writev(fd, iov, nIov));
+# endif
+#endif
+    countIo(writeCalls, writeBytes, n);
+    XmlRpcUtil::log(5, "XmlRpcSocket::nbWriteV: send/writev returned %d.", n);
+
+    if (n > 0) {
+      *bytesSoFar += n;
+      offset += size_t(n);
+      while (first < buffers.size() && offset >= buffers[first].size())
+        offset -= buffers[first++].size();
+    } else if (nonFatalError()) {
+      wouldBlock = true;
+    } else {
+      return false;   // Error
+    }
+  }
+  return true;
+}
+
+
 // Returns last errno
 int 
 XmlRpcSocket::getError()
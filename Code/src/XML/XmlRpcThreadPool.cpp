@@ -0,0 +1,120 @@
+
+#include "XmlRpcThreadPool.h"
+
+#ifndef MAKEDEPEND
+# include <atomic>
+# include <exception>
+#endif
+
+using namespace XmlRpc;
+
+
+// The tasks of one run() call. Workers and the caller claim task numbers
+// until none are left; the last to finish wakes the caller.
+struct XmlRpcThreadPool::Batch {
+  std::function<void(int)> const* task;
+  int tasks;
+  std::atomic<int> next;
+  int finished;
+  std::exception_ptr error;
+  std::mutex mutex;
+  std::condition_variable done;
+};
+
+
+XmlRpcThreadPool::XmlRpcThreadPool(int threads) : _stop(false)
+{
+  for (int i = 0; i < threads; ++i)
+    _threads.emplace_back(&XmlRpcThreadPool::work, this);
+}
+
+
+XmlRpcThreadPool::~XmlRpcThreadPool()
+{
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _stop = true;
+  }
+  _ready.notify_all();
+  for (size_t i = 0; i < _threads.size(); ++i)
+    _threads[i].join();
+}
+
+
+XmlRpcThreadPool&
+XmlRpcThreadPool::shared()
+{
+  static XmlRpcThreadPool pool(std::thread::hardware_concurrency() > 1
+                                 ? int(std::thread::hardware_concurrency()) - 1 : 1);
+  return pool;
+}
+
+
+void
+XmlRpcThreadPool::run(int tasks, std::function<void(int)> const& task)
+{
+  if (tasks <= 0) return;
+
+  std::shared_ptr<Batch> batch = std::make_shared<Batch>();
+  batch->task = &task;
+  batch->tasks = tasks;
+  batch->next = 0;
+  batch->finished = 0;
+
+  if (tasks > 1 && ! _threads.empty()) {
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _batches.push_back(batch);
+    }
+    _ready.notify_all();
+  }
+
+  runTasks(*batch);
+
+  std::unique_lock<std::mutex> lock(batch->mutex);
+  batch->done.wait(lock, [&]() { return batch->finished == batch->tasks; });
+  if (batch->error)
+    std::rethrow_exception(batch->error);
+}
+
+
+// Run tasks from a batch until all have been claimed
+void
+XmlRpcThreadPool::runTasks(Batch& batch)
+{
+  for (int i = batch.next++; i < batch.tasks; i = batch.next++) {
+    std::exception_ptr error;
+    try {
+      (*batch.task)(i);
+    } catch (...) {
+      error = std::current_exception();
+    }
+
+    std::lock_guard<std::mutex> lock(batch.mutex);
+    if (error && ! batch.error)
+      batch.error = error;
+    if (++batch.finished == batch.tasks)
+      batch.done.notify_all();
+  }
+}
+
+
+void
+XmlRpcThreadPool::work()
+{
+  for (;;) {
+    std::shared_ptr<Batch> batch;
+    {
+      std::unique_lock<std::mutex> lock(_mutex);
+      _ready.wait(lock, [this]() { return _stop || ! _batches.empty(); });
+      if (_stop) return;
+      batch = _batches.front();
+      // Once every task is claimed the batch needs no more workers
+      if (batch->next.load() >= batch->tasks) {
+        _batches.pop_front();
+        continue;
+      }
+    }
+    runTasks(*batch);
+  }
+}
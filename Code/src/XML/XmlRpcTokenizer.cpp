@@ -0,0 +1,264 @@
+
+#include "XmlRpcTokenizer.h"
+#include "XmlRpcScan.h"
+
+#ifndef MAKEDEPEND
+# include <string.h>
+#endif
+
+using namespace XmlRpc;
+
+
+static inline bool isSpace(char c)
+{
+  return c == ' ' || c == '\n' || c == '\r' || c == '\t' || c == '\f' || c == '\v';
+}
+
+// Compare the tail of a candidate name once its length and first byte have matched
+static inline bool same(const char* name, const char* lit, size_t len)
+{
+  return memcmp(name + 1, lit + 1, len - 1) == 0;
+}
+
+
+// Classify a tag name. The switch on length and first byte narrows each name
+// down to a single candidate, which is then confirmed.
+int
+XmlRpcTokenizer::classify(const char* n, size_t len)
+{
+  switch (len) {
+    case 2:
+      if (n[0] == 'i' && n[1] == '4') return I4Tag;
+      break;
+    case 3:
+      if (n[0] == 'i' && same(n, "int", 3)) return IntTag;
+      break;
+    case 4:
+      switch (n[0]) {
+        case 'd': if (same(n, "data", 4)) return DataTag; break;
+        case 'n': if (same(n, "name", 4)) return NameTag; break;
+      }
+      break;
+    case 5:
+      switch (n[0]) {
+        case 'v': if (same(n, "value", 5)) return ValueTag; break;
+        case 'p': if (same(n, "param", 5)) return ParamTag; break;
+        case 'a': if (same(n, "array", 5)) return ArrayTag; break;
+        case 'f': if (same(n, "fault", 5)) return FaultTag; break;
+      }
+      break;
+    case 6:
+      switch (n[0]) {
+        case 'd': if (same(n, "double", 6)) return DoubleTag; break;
+        case 's':
+          if (n[3] == 'i') { if (same(n, "string", 6)) return StringTag; }
+          else if (same(n, "struct", 6)) return StructTag;
+          break;
+        case 'm': if (same(n, "member", 6)) return MemberTag; break;
+        case 'b': if (same(n, "base64", 6)) return Base64Tag; break;
+        case 'p': if (same(n, "params", 6)) return ParamsTag; break;
+      }
+      break;
+    case 7:
+      if (n[0] == 'b' && same(n, "boolean", 7)) return BooleanTag;
+      break;
+    case 10:
+      if (n[0] == 'm' && memcmp(n, "method", 6) == 0) {
+        if (n[6] == 'N') { if (same(n, "methodName", 10)) return MethodNameTag; }
+        else if (same(n, "methodCall", 10)) return MethodCallTag;
+      }
+      break;
+    case 14:
+      if (n[0] == 'm' && same(n, "methodResponse", 14)) return MethodResponseTag;
+      break;
+    case 16:
+      if (n[0] == 'd' && same(n, "dateTime.iso8601", 16)) return DateTimeTag;
+      break;
+  }
+  return UnknownTag;
+}
+
+
+const char*
+XmlRpcTokenizer::skipSpace(const char* cp) const
+{
+  while (cp < _end && isSpace(*cp))
+    ++cp;
+  return cp;
+}
+
+
+// Scan the tag whose '<' is at cp
+int
+XmlRpcTokenizer::scanTag(const char* cp, const char** next) const
+{
+  const char* np = cp + 1;
+  if (np >= _end) return EndOfInput;
+
+  // Processing instructions, comments and declarations are not xml-rpc tags
+  if (*np == '?' || *np == '!') {
+    if (_end - np >= 3 && np[1] == '-' && np[2] == '-') {
+      for (const char* gt = np + 3; gt < _end; ++gt) {
+        gt = (const char*) memchr(gt, '>', _end - gt);
+        if ( ! gt) break;
+        if (gt[-1] == '-' && gt[-2] == '-' && gt - 2 >= np + 3) {
+          *next = gt + 1;
+          return UnknownTag;
+        }
+      }
+      return EndOfInput;
+    }
+    const char* gt = (const char*) memchr(np, '>', _end - np);
+    if ( ! gt) return EndOfInput;
+    *next = gt + 1;
+    return UnknownTag;
+  }
+
+  int endFlag = 0;
+  if (*np == '/') {
+    endFlag = EndTag;
+    ++np;
+  }
+
+  const char* gt = (const char*) memchr(np, '>', _end - np);
+  if ( ! gt) return EndOfInput;
+
+  const char* ne = np;
+  while (ne < gt && ! isSpace(*ne) && *ne != '/')
+    ++ne;
+
+  *next = gt + 1;
+  int id = classify(np, size_t(ne - np));
+  return (id == UnknownTag) ? id : (id | endFlag);
+}
+
+
+int
+XmlRpcTokenizer::nextTag()
+{
+  const char* cp = skipSpace(_cp);
+  if (cp >= _end) return EndOfInput;
+  if (*cp != '<') return NoTag;
+
+  const char* next;
+  int id = scanTag(cp, &next);
+  if (id != EndOfInput)
+    _cp = next;
+  return id;
+}
+
+
+int
+XmlRpcTokenizer::peekTag() const
+{
+  const char* cp = skipSpace(_cp);
+  if (cp >= _end) return EndOfInput;
+  if (*cp != '<') return NoTag;
+
+  const char* next;
+  return scanTag(cp, &next);
+}
+
+
+bool
+XmlRpcTokenizer::nextTagIs(int tag)
+{
+  const char* cp = skipSpace(_cp);
+  if (cp >= _end || *cp != '<') return false;
+
+  const char* next;
+  if (scanTag(cp, &next) != tag) return false;
+  _cp = next;
+  return true;
+}
+
+
+bool
+XmlRpcTokenizer::skipTo(int tag)
+{
+  const char* cp = _cp;
+  while (cp < _end) {
+    cp = XmlRpcScan::findChar(cp, _end, '<');
+    if (cp == _end) return false;
+
+    const char* next;
+    int id = scanTag(cp, &next);
+    if (id == EndOfInput) return false;
+    if (id == tag) {
+      _cp = next;
+      return true;
+    }
+    cp = next;
+  }
+  return false;
+}
+
+
+// First char of the name of a tag id, used to pass over unrelated tags quickly
+static char leadChar(int tag)
+{
+  switch (tag) {
+    case XmlRpcTokenizer::ValueTag:  return 'v';
+    case XmlRpcTokenizer::ArrayTag:  return 'a';
+    case XmlRpcTokenizer::DataTag:   return 'd';
+    case XmlRpcTokenizer::StructTag: return 's';
+    case XmlRpcTokenizer::MemberTag: return 'm';
+    case XmlRpcTokenizer::ParamsTag:
+    case XmlRpcTokenizer::ParamTag:  return 'p';
+    default: return 0;
+  }
+}
+
+
+bool
+XmlRpcTokenizer::skipElement(int tag)
+{
+  const char lead = leadChar(tag);
+  int depth = 1;
+  const char* cp = _cp;
+  while (cp < _end) {
+    cp = XmlRpcScan::findChar(cp, _end, '<');
+    if (cp == _end) return false;
+
+    // Tags whose name starts with a different char can't affect the depth
+    if (lead && _end - cp > 2) {
+      char c = (cp[1] == '/') ? cp[2] : cp[1];
+      if (c != lead && c != '!' && c != '?') {
+        ++cp;
+        continue;
+      }
+    }
+
+    const char* next;
+    int id = scanTag(cp, &next);
+    if (id == EndOfInput) return false;
+    if (id == tag)
+      ++depth;
+    else if (id == (tag | EndTag) && --depth == 0) {
+      _cp = next;
+      return true;
+    }
+    cp = next;
+  }
+  return false;
+}
+
+
+bool
+XmlRpcTokenizer::text(const char** begin, const char** end)
+{
+  const char* lt = XmlRpcScan::findChar(_cp, _end, '<');
+  if (lt == _end) return false;
+
+  *begin = _cp;
+  *end = lt;
+  _cp = lt;
+  return true;
+}
+
+
+bool
+XmlRpcTokenizer::atEnd() const
+{
+  return skipSpace(_cp) >= _end;
+}
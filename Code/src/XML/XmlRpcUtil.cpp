@@ -10,6 +10,7 @@
 #endif
 
 #include "XmlRpc.h"
+#include "XmlRpcScan.h"
 
 using namespace XmlRpc;
 
@@ -176,9 +177,6 @@ XmlRpcUtil::getNextTag(std::string const& xml, int* offset)
 
 // xml encodings (xml-encoded entities are preceded with '&')
 static const char  AMP = '&';
-static const char  rawEntity[] = { '<',   '>',   '&',    '\'',    '\"',    0 };
-static const char* xmlEntity[] = { "lt;", "gt;", "amp;", "apos;", "quot;", 0 };
-static const int   xmlEntLen[] = { 3,     3,     4,      5,       5 };
 
 
 // Replace xml-encoded entities with the raw text equivalents.
@@ -186,35 +184,57 @@ static const int   xmlEntLen[] = { 3,     3,     4,      5,       5 };
 std::string 
 XmlRpcUtil::xmlDecode(const std::string& encoded)
 {
-  std::string::size_type iAmp = encoded.find(AMP);
-  if (iAmp == std::string::npos)
+  const char* ens = encoded.data();
+  if (XmlRpcScan::findChar(ens, ens + encoded.size(), AMP) == ens + encoded.size())
     return encoded;
 
-  std::string decoded(encoded, 0, iAmp);
-  std::string::size_type iSize = encoded.size();
-  decoded.reserve(iSize);
-
-  const char* ens = encoded.c_str();
-  while (iAmp != iSize) {
-    if (encoded[iAmp] == AMP && iAmp+1 < iSize) {
-      int iEntity;
-      for (iEntity=0; xmlEntity[iEntity] != 0; ++iEntity)
-	//if (encoded.compare(iAmp+1, xmlEntLen[iEntity], xmlEntity[iEntity]) == 0)
-	if (strncmp(ens+iAmp+1, xmlEntity[iEntity], xmlEntLen[iEntity]) == 0)
-        {
-          decoded += rawEntity[iEntity];
-          iAmp += xmlEntLen[iEntity]+1;
-          break;
-        }
-      if (xmlEntity[iEntity] == 0)    // unrecognized sequence
-        decoded += encoded[iAmp++];
-
-    } else {
-      decoded += encoded[iAmp++];
+  std::string decoded;
+  decoded.reserve(encoded.size());
+  xmlDecode(ens, encoded.size(), decoded);
+  return decoded;
+}
+
+
+// Returns the raw char for the entity following an '&' at cp (exclusive) and
+// sets *len to the number of entity chars, or returns 0 if not recognized.
+static inline char decodeEntity(const char* cp, const char* end, int* len)
+{
+  size_t avail = size_t(end - cp);
+  switch (*cp) {
+    case 'l': if (avail >= 3 && cp[1] == 't' && cp[2] == ';') { *len = 3; return '<'; } break;
+    case 'g': if (avail >= 3 && cp[1] == 't' && cp[2] == ';') { *len = 3; return '>'; } break;
+    case 'a':
+      if (avail >= 4 && memcmp(cp, "amp;", 4) == 0) { *len = 4; return '&'; }
+      if (avail >= 5 && memcmp(cp, "apos;", 5) == 0) { *len = 5; return '\''; }
+      break;
+    case 'q': if (avail >= 5 && memcmp(cp, "quot;", 5) == 0) { *len = 5; return '"'; } break;
+  }
+  return 0;
+}
+
+void
+XmlRpcUtil::xmlDecode(const char* encoded, size_t len, std::string& decoded)
+{
+  const char* cp = encoded;
+  const char* end = encoded + len;
+
+  while (cp < end) {
+    // Copy the run up to the next '&' in one go
+    const char* amp = XmlRpcScan::findChar(cp, end, AMP);
+    decoded.append(cp, amp - cp);
+    if (amp == end)
+      break;
+
+    int entLen;
+    char raw = (amp + 1 < end) ? decodeEntity(amp + 1, end, &entLen) : 0;
+    if (raw) {
+      decoded += raw;
+      cp = amp + 1 + entLen;
+    } else {                          // unrecognized sequence
+      decoded += AMP;
+      cp = amp + 1;
     }
   }
-    
-  return decoded;
 }
 
 
@@ -223,28 +243,37 @@ XmlRpcUtil::xmlDecode(const std::string& encoded)
 std::string 
 XmlRpcUtil::xmlEncode(const std::string& raw)
 {
-  std::string::size_type iRep = raw.find_first_of(rawEntity);
-  if (iRep == std::string::npos)
+  const char* rs = raw.data();
+  if (XmlRpcScan::findEntity(rs, rs + raw.size()) == rs + raw.size())
     return raw;
 
-  std::string encoded(raw, 0, iRep);
-  std::string::size_type iSize = raw.size();
-
-  while (iRep != iSize) {
-    int iEntity;
-    for (iEntity=0; rawEntity[iEntity] != 0; ++iEntity)
-      if (raw[iRep] == rawEntity[iEntity])
-      {
-        encoded += AMP;
-        encoded += xmlEntity[iEntity];
-        break;
-      }
-    if (rawEntity[iEntity] == 0)
-      encoded += raw[iRep];
-    ++iRep;
-  }
+  std::string encoded;
+  encoded.reserve(raw.size() + raw.size() / 8 + 16);
+  xmlEncode(rs, raw.size(), encoded);
   return encoded;
 }
 
 
-
+void
+XmlRpcUtil::xmlEncode(const char* raw, size_t len, std::string& encoded)
+{
+  const char* cp = raw;
+  const char* end = raw + len;
+
+  while (cp < end) {
+    // Copy the run up to the next char needing an entity in one go
+    const char* rep = XmlRpcScan::findEntity(cp, end);
+    encoded.append(cp, rep - cp);
+    if (rep == end)
+      break;
+
+    switch (*rep) {
+      case '<':  encoded.append("&lt;", 4); break;
+      case '>':  encoded.append("&gt;", 4); break;
+      case '&':  encoded.append("&amp;", 5); break;
+      case '\'': encoded.append("&apos;", 6); break;
+      case '"':  encoded.append("&quot;", 6); break;
+    }
+    cp = rep + 1;
+  }
+}
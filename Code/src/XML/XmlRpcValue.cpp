@@ -1,13 +1,21 @@
 #include "XmlRpcValue.h"
 #include "XmlRpcException.h"
+#include "XmlRpcTokenizer.h"
 #include "XmlRpcUtil.h"
-#include "base64.h"
+#include "XmlRpcBase64.h"
+#include "XmlRpcThreadPool.h"
 
 #ifndef MAKEDEPEND
+# include <algorithm>
+# include <charconv>
+# include <cmath>
 # include <iostream>
+# include <limits>
+# include <mutex>
 # include <ostream>
 # include <stdlib.h>
 # include <stdio.h>
+# include <string.h>
 #endif
 
 namespace XmlRpc {
@@ -20,7 +28,6 @@ namespace XmlRpc {
   static const char BOOLEAN_ETAG[]  = "</boolean>";
   static const char DOUBLE_TAG[]    = "<double>";
   static const char DOUBLE_ETAG[]   = "</double>";
-  static const char INT_TAG[]       = "<int>";
   static const char I4_TAG[]        = "<i4>";
   static const char I4_ETAG[]       = "</i4>";
   static const char STRING_TAG[]    = "<string>";
@@ -43,10 +50,38 @@ namespace XmlRpc {
 
 
       
-  // Format strings
-  std::string XmlRpcValue::_doubleFormat("%f");
+  // Format strings. Empty selects the shortest round-trip representation.
+  std::string XmlRpcValue::_doubleFormat;
 
 
+  // Numbers are parsed with from_chars, which is locale-independent but does not
+  // skip leading whitespace or accept a leading '+' the way strtol/strtod do.
+  static const char* numberStart(const char* cp, const char* end)
+  {
+    while (cp < end && (*cp == ' ' || *cp == '\t' || *cp == '\r' || *cp == '\n'))
+      ++cp;
+    if (cp < end && *cp == '+' && cp + 1 < end && *(cp + 1) != '-')
+      ++cp;
+    return cp;
+  }
+
+
+
+  // The xml of a lazily decoded array or struct: the text following the <array>
+  // or <struct> tag, up to and including the matching end tag.
+  struct XmlRpcValue::LazyXml {
+    SharedXml xml;
+    const char* begin;
+    const char* end;
+    std::once_flag once;
+    bool malformed;
+  };
+
+  void XmlRpcValue::releaseLazy(LazyXml* lazy)
+  {
+    delete lazy;
+  }
+
 
   // Clean up
   void XmlRpcValue::invalidate()
@@ -55,8 +90,8 @@ namespace XmlRpc {
       case TypeString:    delete _value.asString; break;
       case TypeDateTime:  delete _value.asTime;   break;
       case TypeBase64:    delete _value.asBinary; break;
-      case TypeArray:     delete _value.asArray;  break;
-      case TypeStruct:    delete _value.asStruct; break;
+      case TypeArray:     _value.asArray->unref();  break;
+      case TypeStruct:    _value.asStruct->unref(); break;
       default: break;
     }
     _type = TypeInvalid;
@@ -74,8 +109,8 @@ namespace XmlRpc {
         case TypeString:   _value.asString = new std::string(); break;
         case TypeDateTime: _value.asTime = new struct tm();     break;
         case TypeBase64:   _value.asBinary = new BinaryData();  break;
-        case TypeArray:    _value.asArray = new ValueArray();   break;
-        case TypeStruct:   _value.asStruct = new ValueStruct(); break;
+        case TypeArray:    _value.asArray = new SharedArray();   break;
+        case TypeStruct:   _value.asStruct = new SharedStruct(); break;
         default:           _value.asBinary = 0; break;
       }
     }
@@ -87,7 +122,7 @@ namespace XmlRpc {
   {
     if (_type != TypeArray)
       throw XmlRpcException("type error: expected an array");
-    else if (int(_value.asArray->size()) < size)
+    else if (int(arrayData().size()) < size)
       throw XmlRpcException("range error: array index too large");
   }
 
@@ -96,10 +131,10 @@ namespace XmlRpc {
   {
     if (_type == TypeInvalid) {
       _type = TypeArray;
-      _value.asArray = new ValueArray(size);
+      _value.asArray = new SharedArray(ValueArray(size));
     } else if (_type == TypeArray) {
-      if (int(_value.asArray->size()) < size)
-        _value.asArray->resize(size);
+      if (int(arrayData().size()) < size)
+        mutableArray().resize(size);
     } else
       throw XmlRpcException("type error: expected an array");
   }
@@ -108,13 +143,13 @@ namespace XmlRpc {
   {
     if (_type == TypeInvalid) {
       _type = TypeStruct;
-      _value.asStruct = new ValueStruct();
+      _value.asStruct = new SharedStruct();
     } else if (_type != TypeStruct)
       throw XmlRpcException("type error: expected a struct");
   }
 
 
-  // Operators
+  // Operators. Arrays and structs share the payload of rhs rather than copying it.
   XmlRpcValue& XmlRpcValue::operator=(XmlRpcValue const& rhs)
   {
     if (this != &rhs)
@@ -128,8 +163,8 @@ namespace XmlRpc {
         case TypeDateTime: _value.asTime = new struct tm(*rhs._value.asTime); break;
         case TypeString:   _value.asString = new std::string(*rhs._value.asString); break;
         case TypeBase64:   _value.asBinary = new BinaryData(*rhs._value.asBinary); break;
-        case TypeArray:    _value.asArray = new ValueArray(*rhs._value.asArray); break;
-        case TypeStruct:   _value.asStruct = new ValueStruct(*rhs._value.asStruct); break;
+        case TypeArray:    _value.asArray = rhs._value.asArray->ref(); break;
+        case TypeStruct:   _value.asStruct = rhs._value.asStruct->ref(); break;
         default:           _value.asBinary = 0; break;
       }
     }
@@ -157,17 +192,20 @@ namespace XmlRpc {
       case TypeDateTime: return tmEq(*_value.asTime, *other._value.asTime);
       case TypeString:   return *_value.asString == *other._value.asString;
       case TypeBase64:   return *_value.asBinary == *other._value.asBinary;
-      case TypeArray:    return *_value.asArray == *other._value.asArray;
+      case TypeArray:    return _value.asArray == other._value.asArray ||
+                                arrayData() == other.arrayData();
 
       // The map<>::operator== requires the definition of value< for kcc
       case TypeStruct:   //return *_value.asStruct == *other._value.asStruct;
         {
-          if (_value.asStruct->size() != other._value.asStruct->size())
+          if (_value.asStruct == other._value.asStruct)
+            return true;
+          if (structData().size() != other.structData().size())
             return false;
           
-          ValueStruct::const_iterator it1=_value.asStruct->begin();
-          ValueStruct::const_iterator it2=other._value.asStruct->begin();
-          while (it1 != _value.asStruct->end()) {
+          ValueStruct::const_iterator it1=structData().begin();
+          ValueStruct::const_iterator it2=other.structData().begin();
+          while (it1 != structData().end()) {
             const XmlRpcValue& v1 = it1->second;
             const XmlRpcValue& v2 = it2->second;
             if ( ! (v1 == v2))
@@ -194,8 +232,8 @@ namespace XmlRpc {
     switch (_type) {
       case TypeString: return int(_value.asString->size());
       case TypeBase64: return int(_value.asBinary->size());
-      case TypeArray:  return int(_value.asArray->size());
-      case TypeStruct: return int(_value.asStruct->size());
+      case TypeArray:  return int(arrayData().size());
+      case TypeStruct: return int(structData().size());
       default: break;
     }
 
@@ -203,186 +241,269 @@ namespace XmlRpc {
   }
 
   // Checks for existence of struct member
-  bool XmlRpcValue::hasMember(const std::string& name) const
+  bool XmlRpcValue::hasMember(std::string_view name) const
   {
-    return _type == TypeStruct && _value.asStruct->find(name) != _value.asStruct->end();
+    return find(name) != 0;
+  }
+
+  // Struct member lookup without exceptions
+  XmlRpcValue const* XmlRpcValue::find(std::string_view name) const
+  {
+    ValueStruct const* members = tryGet<ValueStruct>();
+    if ( ! members) return 0;
+    ValueStruct::const_iterator it = members->find(name);
+    return (it == members->end()) ? 0 : &it->second;
+  }
+
+  // The struct is only detached from other values sharing it if the member exists
+  XmlRpcValue* XmlRpcValue::find(std::string_view name)
+  {
+    XmlRpcValue const* member = static_cast<XmlRpcValue const*>(this)->find(name);
+    if ( ! member || ! _value.asStruct->shared())
+      return const_cast<XmlRpcValue*>(member);
+    return &mutableStruct().find(name)->second;
   }
 
   // Set the value from xml. The chars at *offset into valueXml 
   // should be the start of a <value> tag. Destroys any existing value.
   bool XmlRpcValue::fromXml(std::string const& valueXml, int* offset)
   {
-    int savedOffset = *offset;
+    XmlRpcTokenizer tok(valueXml, *offset);
+    if ( ! fromXml(tok))
+      return false;
+
+    *offset = tok.offset();
+    return true;
+  }
+
+  // Set the value from the tokenizer, which should be positioned at a <value> tag.
+  bool XmlRpcValue::fromXml(XmlRpcTokenizer& tok)
+  {
+    return valueFromXml(tok, 0);
+  }
+
+  // Set the value from the tokenizer, leaving arrays and structs to be decoded when
+  // they are first accessed.
+  bool XmlRpcValue::fromXmlLazy(XmlRpcTokenizer& tok, SharedXml const& xml)
+  {
+    return valueFromXml(tok, &xml);
+  }
+
+  bool XmlRpcValue::valueFromXml(XmlRpcTokenizer& tok, SharedXml const* xml)
+  {
+    const char* saved = tok.position();
 
     invalidate();
-    if ( ! XmlRpcUtil::nextTagIs(VALUE_TAG, valueXml, offset))
-      return false;       // Not a value, offset not updated
+    if ( ! tok.nextTagIs(XmlRpcTokenizer::ValueTag))
+      return false;       // Not a value, position not updated
 
-	int afterValueOffset = *offset;
-    std::string typeTag = XmlRpcUtil::getNextTag(valueXml, offset);
+    const char* afterValue = tok.position();
     bool result = false;
-    if (typeTag == BOOLEAN_TAG)
-      result = boolFromXml(valueXml, offset);
-    else if (typeTag == I4_TAG || typeTag == INT_TAG)
-      result = intFromXml(valueXml, offset);
-    else if (typeTag == DOUBLE_TAG)
-      result = doubleFromXml(valueXml, offset);
-    else if (typeTag.empty() || typeTag == STRING_TAG)
-      result = stringFromXml(valueXml, offset);
-    else if (typeTag == DATETIME_TAG)
-      result = timeFromXml(valueXml, offset);
-    else if (typeTag == BASE64_TAG)
-      result = binaryFromXml(valueXml, offset);
-    else if (typeTag == ARRAY_TAG)
-      result = arrayFromXml(valueXml, offset);
-    else if (typeTag == STRUCT_TAG)
-      result = structFromXml(valueXml, offset);
-    // Watch for empty/blank strings with no <string>tag
-    else if (typeTag == VALUE_ETAG)
-    {
-      *offset = afterValueOffset;   // back up & try again
-      result = stringFromXml(valueXml, offset);
+    switch (tok.nextTag()) {
+      case XmlRpcTokenizer::BooleanTag:  result = boolFromXml(tok); break;
+      case XmlRpcTokenizer::I4Tag:
+      case XmlRpcTokenizer::IntTag:      result = intFromXml(tok); break;
+      case XmlRpcTokenizer::DoubleTag:   result = doubleFromXml(tok); break;
+      case XmlRpcTokenizer::StringTag:   result = stringFromXml(tok); break;
+      case XmlRpcTokenizer::DateTimeTag: result = timeFromXml(tok); break;
+      case XmlRpcTokenizer::Base64Tag:   result = binaryFromXml(tok); break;
+      case XmlRpcTokenizer::ArrayTag:
+        result = xml ? lazyFromXml(tok, XmlRpcTokenizer::ArrayTag, *xml) : arrayFromXml(tok, 0);
+        break;
+      case XmlRpcTokenizer::StructTag:
+        result = xml ? lazyFromXml(tok, XmlRpcTokenizer::StructTag, *xml) : structFromXml(tok, 0);
+        break;
+
+      // Untyped strings, including empty/blank strings with no <string> tag
+      case XmlRpcTokenizer::NoTag:
+      case XmlRpcTokenizer::ValueTag | XmlRpcTokenizer::EndTag:
+        tok.setPosition(afterValue);   // back up & try again
+        result = stringFromXml(tok);
+        break;
+
+      default: break;
     }
 
     if (result)  // Skip over the </value> tag
-      XmlRpcUtil::findTag(VALUE_ETAG, valueXml, offset);
+      (void) tok.skipTo(XmlRpcTokenizer::ValueTag | XmlRpcTokenizer::EndTag);
     else        // Unrecognized tag after <value>
-      *offset = savedOffset;
+    {
+      invalidate();
+      tok.setPosition(saved);
+    }
 
     return result;
   }
 
   // Encode the Value in xml
   std::string XmlRpcValue::toXml() const
+  {
+    std::string xml;
+    appendXml(xml);
+    return xml;
+  }
+
+  // Append the xml encoding of the Value. Nested values are written straight
+  // into the same buffer, so each value is encoded exactly once.
+  void XmlRpcValue::appendXml(std::string& xml) const
   {
     switch (_type) {
-      case TypeBoolean:  return boolToXml();
-      case TypeInt:      return intToXml();
-      case TypeDouble:   return doubleToXml();
-      case TypeString:   return stringToXml();
-      case TypeDateTime: return timeToXml();
-      case TypeBase64:   return binaryToXml();
-      case TypeArray:    return arrayToXml();
-      case TypeStruct:   return structToXml();
-      default: break;
+      case TypeBoolean:  boolToXml(xml); break;
+      case TypeInt:      intToXml(xml); break;
+      case TypeDouble:   doubleToXml(xml); break;
+      case TypeString:   stringToXml(xml); break;
+      case TypeDateTime: timeToXml(xml); break;
+      case TypeBase64:   binaryToXml(xml); break;
+      case TypeArray:    arrayToXml(xml); break;
+      case TypeStruct:   structToXml(xml); break;
+      default: break;     // Invalid value
     }
-    return std::string();   // Invalid value
+  }
+
+  void XmlRpcValue::appendXml(std::vector<std::string>& buffers, int parallelElements) const
+  {
+    if (buffers.empty())
+      buffers.emplace_back();
+
+    if (_type == TypeArray)
+      arrayToXml(buffers, parallelElements);
+    else if (_type == TypeStruct)
+      structToXml(buffers, parallelElements);
+    else
+      appendXml(buffers.back());
   }
 
 
   // Boolean
-  bool XmlRpcValue::boolFromXml(std::string const& valueXml, int* offset)
+  bool XmlRpcValue::boolFromXml(XmlRpcTokenizer& tok)
   {
-    const char* valueStart = valueXml.c_str() + *offset;
-    char* valueEnd;
-    long ivalue = strtol(valueStart, &valueEnd, 10);
-    if (valueEnd == valueStart || (ivalue != 0 && ivalue != 1))
+    const char *valueStart, *textEnd;
+    if ( ! tok.text(&valueStart, &textEnd))
+      return false;     // No end tag;
+
+    int ivalue;
+    std::from_chars_result r = std::from_chars(numberStart(valueStart, textEnd), textEnd, ivalue);
+    if (r.ec != std::errc() || (ivalue != 0 && ivalue != 1))
       return false;
 
     _type = TypeBoolean;
     _value.asBool = (ivalue == 1);
-    *offset += int(valueEnd - valueStart);
     return true;
   }
 
-  std::string XmlRpcValue::boolToXml() const
+  void XmlRpcValue::boolToXml(std::string& xml) const
   {
-    std::string xml = VALUE_TAG;
+    xml += VALUE_TAG;
     xml += BOOLEAN_TAG;
-    xml += (_value.asBool ? "1" : "0");
+    xml += (_value.asBool ? '1' : '0');
     xml += BOOLEAN_ETAG;
     xml += VALUE_ETAG;
-    return xml;
   }
 
   // Int
-  bool XmlRpcValue::intFromXml(std::string const& valueXml, int* offset)
+  bool XmlRpcValue::intFromXml(XmlRpcTokenizer& tok)
   {
-    const char* valueStart = valueXml.c_str() + *offset;
-    char* valueEnd;
-    long ivalue = strtol(valueStart, &valueEnd, 10);
-    if (valueEnd == valueStart)
+    const char *valueStart, *textEnd;
+    if ( ! tok.text(&valueStart, &textEnd))
+      return false;     // No end tag;
+
+    int ivalue;
+    std::from_chars_result r = std::from_chars(numberStart(valueStart, textEnd), textEnd, ivalue);
+    if (r.ec != std::errc())
       return false;
 
     _type = TypeInt;
-    _value.asInt = int(ivalue);
-    *offset += int(valueEnd - valueStart);
+    _value.asInt = ivalue;
     return true;
   }
 
-  std::string XmlRpcValue::intToXml() const
+  void XmlRpcValue::intToXml(std::string& xml) const
   {
-    char buf[256];
-    snprintf(buf, sizeof(buf)-1, "%d", _value.asInt);
-    buf[sizeof(buf)-1] = 0;
-    std::string xml = VALUE_TAG;
+    char buf[16];
+    std::to_chars_result r = std::to_chars(buf, buf + sizeof(buf), _value.asInt);
+    xml += VALUE_TAG;
     xml += I4_TAG;
-    xml += buf;
+    xml.append(buf, r.ptr);
     xml += I4_ETAG;
     xml += VALUE_ETAG;
-    return xml;
   }
 
   // Double
-  bool XmlRpcValue::doubleFromXml(std::string const& valueXml, int* offset)
+  bool XmlRpcValue::doubleFromXml(XmlRpcTokenizer& tok)
   {
-    const char* valueStart = valueXml.c_str() + *offset;
-    char* valueEnd;
-    double dvalue = strtod(valueStart, &valueEnd);
-    if (valueEnd == valueStart)
+    const char *valueStart, *textEnd;
+    if ( ! tok.text(&valueStart, &textEnd))
+      return false;     // No end tag;
+
+    double dvalue;
+    std::from_chars_result r = std::from_chars(numberStart(valueStart, textEnd), textEnd, dvalue);
+    if (r.ec != std::errc())
       return false;
 
     _type = TypeDouble;
     _value.asDouble = dvalue;
-    *offset += int(valueEnd - valueStart);
     return true;
   }
 
-  std::string XmlRpcValue::doubleToXml() const
+  // Unless a format has been specified, doubles are written as the shortest
+  // string without an exponent that reads back to exactly the same value, as
+  // the xml-rpc <double> allows only digits, a sign and a decimal point. It
+  // has no NaN or infinity either, so those are written as 0 and the largest
+  // finite values.
+  void XmlRpcValue::doubleToXml(std::string& xml) const
   {
-    char buf[256];
-    snprintf(buf, sizeof(buf)-1, getDoubleFormat().c_str(), _value.asDouble);
-    buf[sizeof(buf)-1] = 0;
+    double value = _value.asDouble;
+    if ( ! std::isfinite(value)) {
+      XmlRpcUtil::error("Error in XmlRpcValue::doubleToXml: %f cannot be written as an xml-rpc double.", value);
+      value = std::isnan(value) ? 0.0 : std::copysign(std::numeric_limits<double>::max(), value);
+    }
+
+    char buf[512];      // Room for the longest fixed form, about 330 characters
+    char* bufEnd;
+    if (_doubleFormat.empty())
+      bufEnd = std::to_chars(buf, buf + sizeof(buf), value, std::chars_format::fixed).ptr;
+    else {
+      int n = snprintf(buf, sizeof(buf), _doubleFormat.c_str(), value);
+      bufEnd = buf + ((n < 0) ? 0 : (n < int(sizeof(buf)) ? n : int(sizeof(buf)) - 1));
+    }
 
-    std::string xml = VALUE_TAG;
+    xml += VALUE_TAG;
     xml += DOUBLE_TAG;
-    xml += buf;
+    xml.append(buf, bufEnd);
     xml += DOUBLE_ETAG;
     xml += VALUE_ETAG;
-    return xml;
   }
 
   // String
-  bool XmlRpcValue::stringFromXml(std::string const& valueXml, int* offset)
+  bool XmlRpcValue::stringFromXml(XmlRpcTokenizer& tok)
   {
-    size_t valueEnd = valueXml.find('<', *offset);
-    if (valueEnd == std::string::npos)
+    const char *valueStart, *valueEnd;
+    if ( ! tok.text(&valueStart, &valueEnd))
       return false;     // No end tag;
 
     _type = TypeString;
-    _value.asString = new std::string(XmlRpcUtil::xmlDecode(valueXml.substr(*offset, valueEnd-*offset)));
-    *offset += int(_value.asString->length());
+    _value.asString = new std::string();
+    XmlRpcUtil::xmlDecode(valueStart, size_t(valueEnd - valueStart), *_value.asString);
     return true;
   }
 
-  std::string XmlRpcValue::stringToXml() const
+  void XmlRpcValue::stringToXml(std::string& xml) const
   {
-    std::string xml = VALUE_TAG;
+    xml += VALUE_TAG;
     //xml += STRING_TAG; optional
-    xml += XmlRpcUtil::xmlEncode(*_value.asString);
+    XmlRpcUtil::xmlEncode(_value.asString->data(), _value.asString->size(), xml);
     //xml += STRING_ETAG;
     xml += VALUE_ETAG;
-    return xml;
   }
 
   // DateTime (stored as a struct tm)
-  bool XmlRpcValue::timeFromXml(std::string const& valueXml, int* offset)
+  bool XmlRpcValue::timeFromXml(XmlRpcTokenizer& tok)
   {
-    size_t valueEnd = valueXml.find('<', *offset);
-    if (valueEnd == std::string::npos)
+    const char *valueStart, *valueEnd;
+    if ( ! tok.text(&valueStart, &valueEnd))
       return false;     // No end tag;
 
-    std::string stime = valueXml.substr(*offset, valueEnd-*offset);
+    std::string stime(valueStart, valueEnd);
 
     struct tm t;
     if (sscanf(stime.c_str(),"%4d%2d%2dT%2d:%2d:%2d",&t.tm_year,&t.tm_mon,&t.tm_mday,&t.tm_hour,&t.tm_min,&t.tm_sec) != 6)
@@ -391,11 +512,10 @@ namespace XmlRpc {
     t.tm_isdst = -1;
     _type = TypeDateTime;
     _value.asTime = new struct tm(t);
-    *offset += int(stime.length());
     return true;
   }
 
-  std::string XmlRpcValue::timeToXml() const
+  void XmlRpcValue::timeToXml(std::string& xml) const
   {
     struct tm* t = _value.asTime;
     char buf[20];
@@ -403,140 +523,874 @@ namespace XmlRpc {
       t->tm_year,t->tm_mon,t->tm_mday,t->tm_hour,t->tm_min,t->tm_sec);
     buf[sizeof(buf)-1] = 0;
 
-    std::string xml = VALUE_TAG;
+    xml += VALUE_TAG;
     xml += DATETIME_TAG;
     xml += buf;
     xml += DATETIME_ETAG;
     xml += VALUE_ETAG;
-    return xml;
   }
 
 
   // Base64
-  bool XmlRpcValue::binaryFromXml(std::string const& valueXml, int* offset)
+  bool XmlRpcValue::binaryFromXml(XmlRpcTokenizer& tok)
   {
-    size_t valueEnd = valueXml.find('<', *offset);
-    if (valueEnd == std::string::npos)
+    const char *valueStart, *valueEnd;
+    if ( ! tok.text(&valueStart, &valueEnd))
       return false;     // No end tag;
 
     _type = TypeBase64;
-    std::string asString = valueXml.substr(*offset, valueEnd-*offset);
     _value.asBinary = new BinaryData();
     // check whether base64 encodings can contain chars xml encodes...
 
     // convert from base64 to binary
-    int iostatus = 0;
-	  base64<char> decoder;
-    std::back_insert_iterator<BinaryData> ins = std::back_inserter(*(_value.asBinary));
-		decoder.get(asString.begin(), asString.end(), ins, iostatus);
-
-    *offset += int(asString.length());
+    XmlRpcBase64::decode(valueStart, size_t(valueEnd - valueStart), *_value.asBinary);
     return true;
   }
 
 
-  std::string XmlRpcValue::binaryToXml() const
+  void XmlRpcValue::binaryToXml(std::string& xml) const
   {
-    // convert to base64
-    std::vector<char> base64data;
-    int iostatus = 0;
-	  base64<char> encoder;
-    std::back_insert_iterator<std::vector<char> > ins = std::back_inserter(base64data);
-		encoder.put(_value.asBinary->begin(), _value.asBinary->end(), ins, iostatus, base64<>::crlf());
-
-    // Wrap with xml
-    std::string xml = VALUE_TAG;
+    xml += VALUE_TAG;
     xml += BASE64_TAG;
-    xml.append(base64data.begin(), base64data.end());
+
+    // convert to base64, straight into the xml
+    XmlRpcBase64::encode(_value.asBinary->data(), _value.asBinary->size(), xml);
+
     xml += BASE64_ETAG;
     xml += VALUE_ETAG;
-    return xml;
   }
 
 
   // Array
-  bool XmlRpcValue::arrayFromXml(std::string const& valueXml, int* offset)
+  bool XmlRpcValue::arrayFromXml(XmlRpcTokenizer& tok, SharedXml const* xml)
   {
-    if ( ! XmlRpcUtil::nextTagIs(DATA_TAG, valueXml, offset))
+    SharedArray* array = new SharedArray;
+    if ( ! elementsFromXml(tok, array->data, xml)) {
+      array->unref();
       return false;
+    }
 
     _type = TypeArray;
-    _value.asArray = new ValueArray;
-    XmlRpcValue v;
-    while (v.fromXml(valueXml, offset))
-      _value.asArray->push_back(v);       // copy...
+    _value.asArray = array;
+    return true;
+  }
+
+  // Decode the <data> element of an array, each element in place
+  bool XmlRpcValue::elementsFromXml(XmlRpcTokenizer& tok, ValueArray& elements, SharedXml const* xml)
+  {
+    if ( ! tok.nextTagIs(XmlRpcTokenizer::DataTag))
+      return false;
+
+    while (tok.peekTag() == XmlRpcTokenizer::ValueTag) {
+      elements.push_back(XmlRpcValue());
+      if ( ! elements.back().valueFromXml(tok, xml)) {
+        elements.pop_back();
+        break;
+      }
+    }
 
     // Skip the trailing </data>
-    (void) XmlRpcUtil::nextTagIs(DATA_ETAG, valueXml, offset);
+    (void) tok.nextTagIs(XmlRpcTokenizer::DataTag | XmlRpcTokenizer::EndTag);
     return true;
   }
 
 
-  // In general, its preferable to generate the xml of each element of the
-  // array as it is needed rather than glomming up one big string.
-  std::string XmlRpcValue::arrayToXml() const
+  // Each element is written directly into the caller's buffer rather than
+  // being glommed up into its own string first.
+  void XmlRpcValue::arrayToXml(std::string& xml) const
   {
-    std::string xml = VALUE_TAG;
+    xml += VALUE_TAG;
     xml += ARRAY_TAG;
     xml += DATA_TAG;
 
-    int s = int(_value.asArray->size());
+    ValueArray const& elements = arrayData();
+    int s = int(elements.size());
     for (int i=0; i<s; ++i)
-       xml += _value.asArray->at(i).toXml();
+       elements[i].appendXml(xml);
 
     xml += DATA_ETAG;
     xml += ARRAY_ETAG;
     xml += VALUE_ETAG;
-    return xml;
+  }
+
+  // Large arrays are split into about as many runs of elements as there are
+  // threads to encode them, but not into runs too short to be worth a buffer.
+  static const int MIN_PARALLEL_RUN = 256;
+
+  void XmlRpcValue::arrayToXml(std::vector<std::string>& buffers, int parallelElements) const
+  {
+    ValueArray const& elements = arrayData();
+    int s = int(elements.size());
+
+    buffers.back() += VALUE_TAG;
+    buffers.back() += ARRAY_TAG;
+    buffers.back() += DATA_TAG;
+
+    if (parallelElements > 0 && s >= parallelElements && s >= 2 * MIN_PARALLEL_RUN) {
+      XmlRpcThreadPool& pool = XmlRpcThreadPool::shared();
+      int runs = (pool.threads() + 1) * 2;
+      if (runs > s / MIN_PARALLEL_RUN)
+        runs = s / MIN_PARALLEL_RUN;
+
+      // One buffer per run, and one more for the xml that follows the array
+      size_t first = buffers.size();
+      buffers.resize(first + runs + 1);
+      pool.run(runs, [&](int r) {
+        std::string& xml = buffers[first + r];
+        int end = int((long long)s * (r + 1) / runs);
+        for (int i = int((long long)s * r / runs); i < end; ++i)
+          elements[i].appendXml(xml);
+      });
+    } else {
+      for (int i=0; i<s; ++i)
+        elements[i].appendXml(buffers, parallelElements);
+    }
+
+    buffers.back() += DATA_ETAG;
+    buffers.back() += ARRAY_ETAG;
+    buffers.back() += VALUE_ETAG;
   }
 
 
   // Struct
-  bool XmlRpcValue::structFromXml(std::string const& valueXml, int* offset)
+  bool XmlRpcValue::structFromXml(XmlRpcTokenizer& tok, SharedXml const* xml)
   {
     _type = TypeStruct;
-    _value.asStruct = new ValueStruct;
-
-    while (XmlRpcUtil::nextTagIs(MEMBER_TAG, valueXml, offset)) {
-      // name
-      const std::string name = XmlRpcUtil::parseTag(NAME_TAG, valueXml, offset);
-      // value
-      XmlRpcValue val(valueXml, offset);
-      if ( ! val.valid()) {
-        invalidate();
-        return false;
+    _value.asStruct = new SharedStruct;
+    if ( ! membersFromXml(tok, _value.asStruct->data, xml)) {
+      invalidate();
+      return false;
+    }
+    return true;
+  }
+
+  // Decode the members of a struct, each value in place
+  bool XmlRpcValue::membersFromXml(XmlRpcTokenizer& tok, ValueStruct& members, SharedXml const* xml)
+  {
+    std::string name;
+    while (tok.nextTagIs(XmlRpcTokenizer::MemberTag)) {
+      // name, usually found in the intern table
+      name.clear();
+      const char *nameStart, *nameEnd;
+      if (tok.skipTo(XmlRpcTokenizer::NameTag) && tok.text(&nameStart, &nameEnd)) {
+        XmlRpcUtil::xmlDecode(nameStart, size_t(nameEnd - nameStart), name);
+        (void) tok.nextTagIs(XmlRpcTokenizer::NameTag | XmlRpcTokenizer::EndTag);
       }
-      const std::pair<const std::string, XmlRpcValue> p(name, val);
-      _value.asStruct->insert(p);
 
-      (void) XmlRpcUtil::nextTagIs(MEMBER_ETAG, valueXml, offset);
+      // value; a repeated name keeps its first value, the later ones are dropped
+      std::pair<ValueStruct::iterator, bool> member = members.try_emplace(XmlRpcKey(name));
+      XmlRpcValue repeated;
+      if ( ! (member.second ? member.first->second : repeated).valueFromXml(tok, xml))
+        return false;
+
+      (void) tok.nextTagIs(XmlRpcTokenizer::MemberTag | XmlRpcTokenizer::EndTag);
     }
     return true;
   }
 
 
-  // In general, its preferable to generate the xml of each element
-  // as it is needed rather than glomming up one big string.
-  std::string XmlRpcValue::structToXml() const
+  // Lazily decoded arrays and structs. The tokenizer is just past the <array> or
+  // <struct> tag; the element is delimited but its contents are left undecoded.
+  bool XmlRpcValue::lazyFromXml(XmlRpcTokenizer& tok, int tag, SharedXml const& xml)
   {
-    std::string xml = VALUE_TAG;
+    const char* begin = tok.position();
+    if ( ! tok.skipElement(tag))
+      return false;
+
+    LazyXml* lazy = new LazyXml;
+    lazy->malformed = false;
+    lazy->xml = xml;
+    lazy->begin = begin;
+    lazy->end = tok.position();
+
+    if (tag == XmlRpcTokenizer::ArrayTag) {
+      _type = TypeArray;
+      _value.asArray = new SharedArray;
+      _value.asArray->lazy = lazy;
+      _value.asArray->pending.store(true, std::memory_order_relaxed);
+    } else {
+      _type = TypeStruct;
+      _value.asStruct = new SharedStruct;
+      _value.asStruct->lazy = lazy;
+      _value.asStruct->pending.store(true, std::memory_order_relaxed);
+    }
+    return true;
+  }
+
+  // Decode a pending payload. Values sharing it may get here at the same time
+  // from different threads, so the decoding is done exactly once. If the xml is
+  // malformed the payload is left empty and pending, and marked as malformed.
+  bool XmlRpcValue::decodePending() const
+  {
+    auto decodeOnce = [](auto* payload, auto decode) {
+      LazyXml* lazy = payload->lazy;
+      std::call_once(lazy->once, [payload, lazy, decode]() {
+        XmlRpcTokenizer tok(lazy->begin, lazy->end);
+        if ( ! decode(tok, payload->data, &lazy->xml)) {
+          payload->data.clear();
+          lazy->malformed = true;
+          return;
+        }
+        lazy->xml.reset();      // Nested values hold their own references
+        payload->pending.store(false, std::memory_order_release);
+      });
+      return ! lazy->malformed;
+    };
+
+    if (_type == TypeArray)
+      return decodeOnce(_value.asArray, elementsFromXml);
+    if (_type == TypeStruct)
+      return decodeOnce(_value.asStruct, membersFromXml);
+    return true;
+  }
+
+  void XmlRpcValue::requireDecoded() const
+  {
+    if ( ! decodePending())
+      throw XmlRpcException("parse error: malformed array or struct");
+  }
+
+
+  // Each member is written directly into the caller's buffer rather than
+  // being glommed up into its own string first.
+  void XmlRpcValue::structToXml(std::string& xml) const
+  {
+    xml += VALUE_TAG;
     xml += STRUCT_TAG;
 
+    ValueStruct const& members = structData();
     ValueStruct::const_iterator it;
-    for (it=_value.asStruct->begin(); it!=_value.asStruct->end(); ++it) {
+    for (it=members.begin(); it!=members.end(); ++it) {
       xml += MEMBER_TAG;
       xml += NAME_TAG;
-      xml += XmlRpcUtil::xmlEncode(it->first);
+      XmlRpcUtil::xmlEncode(it->first.data(), it->first.size(), xml);
       xml += NAME_ETAG;
-      xml += it->second.toXml();
+      it->second.appendXml(xml);
       xml += MEMBER_ETAG;
     }
 
     xml += STRUCT_ETAG;
     xml += VALUE_ETAG;
-    return xml;
   }
 
+  void XmlRpcValue::structToXml(std::vector<std::string>& buffers, int parallelElements) const
+  {
+    buffers.back() += VALUE_TAG;
+    buffers.back() += STRUCT_TAG;
+
+    ValueStruct const& members = structData();
+    ValueStruct::const_iterator it;
+    for (it=members.begin(); it!=members.end(); ++it) {
+      std::string& xml = buffers.back();
+      xml += MEMBER_TAG;
+      xml += NAME_TAG;
+      XmlRpcUtil::xmlEncode(it->first.data(), it->first.size(), xml);
+      xml += NAME_ETAG;
+      it->second.appendXml(buffers, parallelElements);
+      buffers.back() += MEMBER_ETAG;
+    }
+
+    buffers.back() += STRUCT_ETAG;
+    buffers.back() += VALUE_ETAG;
+  }
+
+
+
+  // Binary encoding. Each value is a type byte followed by its data. Counts,
+  // lengths and ints (zigzag-mapped) are written as base-128 varints, low
+  // bits first, and doubles as their 8 IEEE bytes, least significant first.
+  // An array of doubles is packed, without a type byte per element.
+  enum BinaryTag {
+    BINARY_INVALID, BINARY_FALSE, BINARY_TRUE, BINARY_INT, BINARY_DOUBLE, BINARY_STRING,
+    BINARY_DATETIME, BINARY_BASE64, BINARY_ARRAY, BINARY_STRUCT, BINARY_DOUBLES
+  };
+
+  // Arrays and structs nested deeper than this are rejected rather than
+  // decoded recursively.
+  static const int MAX_BINARY_DEPTH = 256;
+
+  static void putVarint(std::string& data, uint64_t n)
+  {
+    while (n >= 0x80) {
+      data += char(uint8_t(n) | 0x80);
+      n >>= 7;
+    }
+    data += char(uint8_t(n));
+  }
+
+  static bool getVarint(const char*& cp, const char* end, uint64_t* n)
+  {
+    *n = 0;
+    for (int shift = 0; cp < end && shift < 64; shift += 7) {
+      uint8_t byte = uint8_t(*cp++);
+      *n |= uint64_t(byte & 0x7f) << shift;
+      if ( ! (byte & 0x80))
+        return true;
+    }
+    return false;
+  }
+
+  static void putInt(std::string& data, int i)
+  {
+    putVarint(data, (uint32_t(i) << 1) ^ uint32_t(i >> 31));
+  }
+
+  static bool getInt(const char*& cp, const char* end, int* i)
+  {
+    uint64_t n;
+    if ( ! getVarint(cp, end, &n) || n > 0xffffffffu)
+      return false;
+    *i = int(uint32_t(n >> 1) ^ -uint32_t(n & 1));
+    return true;
+  }
+
+  static void putDouble(std::string& data, double d)
+  {
+    uint64_t bits;
+    memcpy(&bits, &d, sizeof(bits));
+    char bytes[8];
+    for (int i = 0; i < 8; ++i, bits >>= 8)
+      bytes[i] = char(uint8_t(bits));
+    data.append(bytes, 8);
+  }
+
+  static double getDouble(const char*& cp)
+  {
+    uint64_t bits = 0;
+    for (int i = 7; i >= 0; --i)
+      bits = (bits << 8) | uint8_t(cp[i]);
+    cp += 8;
+    double d;
+    memcpy(&d, &bits, sizeof(d));
+    return d;
+  }
+
+  // A length or count, which must fit in the data that remains
+  static bool getLength(const char*& cp, const char* end, size_t unit, size_t* length)
+  {
+    uint64_t n;
+    if ( ! getVarint(cp, end, &n) || n > uint64_t(end - cp) / unit)
+      return false;
+    *length = size_t(n);
+    return true;
+  }
+
+  void XmlRpcValue::appendBinary(std::string& data) const
+  {
+    switch (_type) {
+      case TypeBoolean:
+        data += char(_value.asBool ? BINARY_TRUE : BINARY_FALSE);
+        break;
+      case TypeInt:
+        data += char(BINARY_INT);
+        putInt(data, _value.asInt);
+        break;
+      case TypeDouble:
+        data += char(BINARY_DOUBLE);
+        putDouble(data, _value.asDouble);
+        break;
+      case TypeString:
+        data += char(BINARY_STRING);
+        putVarint(data, _value.asString->size());
+        data += *_value.asString;
+        break;
+      case TypeDateTime: {
+        struct tm* t = _value.asTime;
+        data += char(BINARY_DATETIME);
+        putInt(data, t->tm_year);
+        putInt(data, t->tm_mon);
+        putInt(data, t->tm_mday);
+        putInt(data, t->tm_hour);
+        putInt(data, t->tm_min);
+        putInt(data, t->tm_sec);
+        break;
+      }
+      case TypeBase64:
+        data += char(BINARY_BASE64);
+        putVarint(data, _value.asBinary->size());
+        data.append(_value.asBinary->data(), _value.asBinary->size());
+        break;
+      case TypeArray: {
+        ValueArray const& elements = arrayData();
+        size_t s = elements.size();
+        size_t doubles = 0;
+        while (doubles < s && elements[doubles]._type == TypeDouble)
+          ++doubles;
+        if (s > 1 && doubles == s) {
+          data += char(BINARY_DOUBLES);
+          putVarint(data, s);
+          data.reserve(data.size() + 8 * s);
+          for (size_t i = 0; i < s; ++i)
+            putDouble(data, elements[i]._value.asDouble);
+        } else {
+          data += char(BINARY_ARRAY);
+          putVarint(data, s);
+          for (size_t i = 0; i < s; ++i)
+            elements[i].appendBinary(data);
+        }
+        break;
+      }
+      case TypeStruct: {
+        ValueStruct const& members = structData();
+        data += char(BINARY_STRUCT);
+        putVarint(data, members.size());
+        for (ValueStruct::const_iterator it = members.begin(); it != members.end(); ++it) {
+          putVarint(data, it->first.size());
+          data.append(it->first.data(), it->first.size());
+          it->second.appendBinary(data);
+        }
+        break;
+      }
+      default:
+        data += char(BINARY_INVALID);
+        break;
+    }
+  }
+
+  bool XmlRpcValue::fromBinary(const char*& cp, const char* end)
+  {
+    invalidate();
+    const char* start = cp;
+    if ( ! valueFromBinary(cp, end, 0)) {
+      invalidate();
+      cp = start;
+      return false;
+    }
+    return true;
+  }
+
+  // Decode one value into this (invalid) value. On failure, the value may be
+  // partly built; the caller discards it.
+  bool XmlRpcValue::valueFromBinary(const char*& cp, const char* end, int depth)
+  {
+    if (cp >= end)
+      return false;
+
+    size_t n;
+    switch (uint8_t(*cp++)) {
+      case BINARY_INVALID:
+        return true;
+      case BINARY_FALSE:
+      case BINARY_TRUE:
+        _type = TypeBoolean;
+        _value.asBool = (uint8_t(cp[-1]) == BINARY_TRUE);
+        return true;
+      case BINARY_INT:
+        _type = TypeInt;
+        return getInt(cp, end, &_value.asInt);
+      case BINARY_DOUBLE:
+        if (end - cp < 8) return false;
+        _type = TypeDouble;
+        _value.asDouble = getDouble(cp);
+        return true;
+      case BINARY_STRING:
+        if ( ! getLength(cp, end, 1, &n)) return false;
+        _type = TypeString;
+        _value.asString = new std::string(cp, n);
+        cp += n;
+        return true;
+      case BINARY_DATETIME: {
+        struct tm t;
+        memset(&t, 0, sizeof(t));
+        if ( ! getInt(cp, end, &t.tm_year) || ! getInt(cp, end, &t.tm_mon) || ! getInt(cp, end, &t.tm_mday) ||
+             ! getInt(cp, end, &t.tm_hour) || ! getInt(cp, end, &t.tm_min) || ! getInt(cp, end, &t.tm_sec))
+          return false;
+        t.tm_isdst = -1;
+        _type = TypeDateTime;
+        _value.asTime = new struct tm(t);
+        return true;
+      }
+      case BINARY_BASE64:
+        if ( ! getLength(cp, end, 1, &n)) return false;
+        _type = TypeBase64;
+        _value.asBinary = new BinaryData(cp, cp + n);
+        cp += n;
+        return true;
+      case BINARY_DOUBLES: {
+        if ( ! getLength(cp, end, 8, &n)) return false;
+        _type = TypeArray;
+        _value.asArray = new SharedArray;
+        ValueArray& elements = _value.asArray->data;
+        elements.resize(n);
+        for (size_t i = 0; i < n; ++i) {
+          elements[i]._type = TypeDouble;
+          elements[i]._value.asDouble = getDouble(cp);
+        }
+        return true;
+      }
+      case BINARY_ARRAY: {
+        if (depth >= MAX_BINARY_DEPTH || ! getLength(cp, end, 1, &n)) return false;
+        _type = TypeArray;
+        _value.asArray = new SharedArray;
+        ValueArray& elements = _value.asArray->data;
+        elements.resize(n);
+        for (size_t i = 0; i < n; ++i)
+          if ( ! elements[i].valueFromBinary(cp, end, depth + 1))
+            return false;
+        return true;
+      }
+      case BINARY_STRUCT: {
+        if (depth >= MAX_BINARY_DEPTH || ! getLength(cp, end, 2, &n)) return false;
+        _type = TypeStruct;
+        _value.asStruct = new SharedStruct;
+        ValueStruct& members = _value.asStruct->data;
+        for (size_t i = 0; i < n; ++i) {
+          size_t length;
+          if ( ! getLength(cp, end, 1, &length)) return false;
+          std::string_view name(cp, length);
+          cp += length;
+          ValueStruct::iterator it = members.lower_bound(name);
+          if (it == members.end() || it->first.view() != name)
+            it = members.emplace_hint(it, XmlRpcKey(name), XmlRpcValue());
+          else
+            it->second.invalidate();    // A repeated name replaces the earlier value
+          if ( ! it->second.valueFromBinary(cp, end, depth + 1))
+            return false;
+        }
+        return true;
+      }
+      default:
+        return false;
+    }
+  }
+
+
+  // JSON encoding. Dates and base64 data have no JSON type, so they are written
+  // as strings (as in the xml text), and read back as strings.
+  static const int MAX_JSON_DEPTH = 256;
+
+  static void jsonEncode(const char* s, size_t n, std::string& json)
+  {
+    static const char HEX[] = "0123456789abcdef";
+    json += '"';
+    const char* run = s;
+    const char* end = s + n;
+    for (const char* cp = s; cp < end; ++cp) {
+      unsigned char c = (unsigned char) *cp;
+      if (c >= 0x20 && c != '"' && c != '\\')
+        continue;
+      json.append(run, cp);
+      run = cp + 1;
+      switch (c) {
+        case '"':  json += "\\\""; break;
+        case '\\': json += "\\\\"; break;
+        case '\n': json += "\\n"; break;
+        case '\r': json += "\\r"; break;
+        case '\t': json += "\\t"; break;
+        default:
+          json += "\\u00";
+          json += HEX[c >> 4];
+          json += HEX[c & 0xf];
+          break;
+      }
+    }
+    json.append(run, end);
+    json += '"';
+  }
+
+  void XmlRpcValue::appendJson(std::string& json) const
+  {
+    switch (_type) {
+      case TypeBoolean:
+        json += _value.asBool ? "true" : "false";
+        break;
+      case TypeInt: {
+        char buf[16];
+        json.append(buf, std::to_chars(buf, buf + sizeof(buf), _value.asInt).ptr);
+        break;
+      }
+      case TypeDouble: {
+        if ( ! std::isfinite(_value.asDouble)) {
+          json += "null";       // JSON has no NaN or infinity
+          break;
+        }
+        char buf[32];
+        char* bufEnd = std::to_chars(buf, buf + sizeof(buf), _value.asDouble).ptr;
+        json.append(buf, bufEnd);
+        if (std::find_if(buf, bufEnd, [](char c) { return c == '.' || c == 'e'; }) == bufEnd)
+          json += ".0";         // So that it reads back as a double
+        break;
+      }
+      case TypeString:
+        jsonEncode(_value.asString->data(), _value.asString->size(), json);
+        break;
+      case TypeDateTime: {
+        struct tm* t = _value.asTime;
+        char buf[20];
+        snprintf(buf, sizeof(buf), "%4d%02d%02dT%02d:%02d:%02d",
+          t->tm_year,t->tm_mon,t->tm_mday,t->tm_hour,t->tm_min,t->tm_sec);
+        jsonEncode(buf, strlen(buf), json);
+        break;
+      }
+      case TypeBase64: {
+        std::string encoded;
+        XmlRpcBase64::encode(_value.asBinary->data(), _value.asBinary->size(), encoded);
+        jsonEncode(encoded.data(), encoded.size(), json);
+        break;
+      }
+      case TypeArray: {
+        ValueArray const& elements = arrayData();
+        json += '[';
+        for (size_t i = 0; i < elements.size(); ++i) {
+          if (i > 0) json += ',';
+          elements[i].appendJson(json);
+        }
+        json += ']';
+        break;
+      }
+      case TypeStruct: {
+        ValueStruct const& members = structData();
+        json += '{';
+        for (ValueStruct::const_iterator it = members.begin(); it != members.end(); ++it) {
+          if (it != members.begin()) json += ',';
+          jsonEncode(it->first.data(), it->first.size(), json);
+          json += ':';
+          it->second.appendJson(json);
+        }
+        json += '}';
+        break;
+      }
+      default:
+        json += "null";
+        break;
+    }
+  }
+
+  static void skipJsonSpace(const char*& cp, const char* end)
+  {
+    while (cp < end && (*cp == ' ' || *cp == '\t' || *cp == '\n' || *cp == '\r'))
+      ++cp;
+  }
+
+  static bool hexDigits(const char* cp, unsigned* u)
+  {
+    *u = 0;
+    for (int i = 0; i < 4; ++i) {
+      char c = cp[i];
+      unsigned d = (c >= '0' && c <= '9') ? unsigned(c - '0') :
+                   (c >= 'a' && c <= 'f') ? unsigned(c - 'a' + 10) :
+                   (c >= 'A' && c <= 'F') ? unsigned(c - 'A' + 10) : 16u;
+      if (d > 15) return false;
+      *u = (*u << 4) | d;
+    }
+    return true;
+  }
+
+  static void appendUtf8(unsigned u, std::string& s)
+  {
+    if (u < 0x80)
+      s += char(u);
+    else if (u < 0x800) {
+      s += char(0xc0 | (u >> 6));
+      s += char(0x80 | (u & 0x3f));
+    } else if (u < 0x10000) {
+      s += char(0xe0 | (u >> 12));
+      s += char(0x80 | ((u >> 6) & 0x3f));
+      s += char(0x80 | (u & 0x3f));
+    } else {
+      s += char(0xf0 | (u >> 18));
+      s += char(0x80 | ((u >> 12) & 0x3f));
+      s += char(0x80 | ((u >> 6) & 0x3f));
+      s += char(0x80 | (u & 0x3f));
+    }
+  }
+
+  // Decode a string, cp being just past the opening quote. Text without
+  // escapes is copied in one piece.
+  static bool jsonString(const char*& cp, const char* end, std::string& s)
+  {
+    s.clear();
+    const char* run = cp;
+    while (cp < end) {
+      unsigned char c = (unsigned char) *cp;
+      if (c == '"') {
+        s.append(run, cp);
+        ++cp;
+        return true;
+      }
+      if (c < 0x20)
+        return false;
+      if (c != '\\') {
+        ++cp;
+        continue;
+      }
+
+      s.append(run, cp);
+      if (end - cp < 2) return false;
+      char e = cp[1];
+      cp += 2;
+      switch (e) {
+        case '"': case '\\': case '/': s += e; break;
+        case 'b': s += '\b'; break;
+        case 'f': s += '\f'; break;
+        case 'n': s += '\n'; break;
+        case 'r': s += '\r'; break;
+        case 't': s += '\t'; break;
+        case 'u': {
+          unsigned u;
+          if (end - cp < 4 || ! hexDigits(cp, &u)) return false;
+          cp += 4;
+          if (u >= 0xd800 && u < 0xdc00) {     // High surrogate; a low one must follow
+            unsigned low;
+            if (end - cp < 6 || cp[0] != '\\' || cp[1] != 'u' || ! hexDigits(cp + 2, &low) ||
+                low < 0xdc00 || low >= 0xe000)
+              return false;
+            cp += 6;
+            u = 0x10000 + ((u - 0xd800) << 10) + (low - 0xdc00);
+          } else if (u >= 0xdc00 && u < 0xe000)
+            return false;
+          appendUtf8(u, s);
+          break;
+        }
+        default:
+          return false;
+      }
+      run = cp;
+    }
+    return false;
+  }
+
+  bool XmlRpcValue::fromJson(const char*& cp, const char* end)
+  {
+    invalidate();
+    const char* start = cp;
+    if ( ! valueFromJson(cp, end, 0)) {
+      invalidate();
+      cp = start;
+      return false;
+    }
+    return true;
+  }
+
+  // Decode one value into this (invalid) value. On failure, the value may be
+  // partly built; the caller discards it.
+  bool XmlRpcValue::valueFromJson(const char*& cp, const char* end, int depth)
+  {
+    skipJsonSpace(cp, end);
+    if (cp >= end)
+      return false;
+
+    switch (*cp) {
+      case '"': {
+        std::string* s = new std::string;
+        _type = TypeString;
+        _value.asString = s;
+        ++cp;
+        return jsonString(cp, end, *s);
+      }
+      case '[': {
+        if (depth >= MAX_JSON_DEPTH) return false;
+        _type = TypeArray;
+        _value.asArray = new SharedArray;
+        ValueArray& elements = _value.asArray->data;
+        ++cp;
+        skipJsonSpace(cp, end);
+        if (cp < end && *cp == ']') {
+          ++cp;
+          return true;
+        }
+        for (;;) {
+          elements.emplace_back();
+          if ( ! elements.back().valueFromJson(cp, end, depth + 1))
+            return false;
+          skipJsonSpace(cp, end);
+          if (cp >= end) return false;
+          if (*cp++ == ']') return true;
+          if (cp[-1] != ',') return false;
+        }
+      }
+      case '{': {
+        if (depth >= MAX_JSON_DEPTH) return false;
+        _type = TypeStruct;
+        _value.asStruct = new SharedStruct;
+        ValueStruct& members = _value.asStruct->data;
+        ++cp;
+        skipJsonSpace(cp, end);
+        if (cp < end && *cp == '}') {
+          ++cp;
+          return true;
+        }
+        std::string name;
+        for (;;) {
+          skipJsonSpace(cp, end);
+          if (cp >= end || *cp != '"') return false;
+          ++cp;
+          if ( ! jsonString(cp, end, name)) return false;
+          skipJsonSpace(cp, end);
+          if (cp >= end || *cp++ != ':') return false;
+
+          ValueStruct::iterator it = members.lower_bound(std::string_view(name));
+          if (it == members.end() || it->first.view() != name)
+            it = members.emplace_hint(it, XmlRpcKey(name), XmlRpcValue());
+          else
+            it->second.invalidate();    // A repeated name replaces the earlier value
+          if ( ! it->second.valueFromJson(cp, end, depth + 1))
+            return false;
+
+          skipJsonSpace(cp, end);
+          if (cp >= end) return false;
+          if (*cp++ == '}') return true;
+          if (cp[-1] != ',') return false;
+        }
+      }
+      case 't':
+        if (end - cp < 4 || memcmp(cp, "true", 4) != 0) return false;
+        cp += 4;
+        _type = TypeBoolean;
+        _value.asBool = true;
+        return true;
+      case 'f':
+        if (end - cp < 5 || memcmp(cp, "false", 5) != 0) return false;
+        cp += 5;
+        _type = TypeBoolean;
+        _value.asBool = false;
+        return true;
+      case 'n':
+        if (end - cp < 4 || memcmp(cp, "null", 4) != 0) return false;
+        cp += 4;
+        return true;
+      default:
+        break;
+    }
+
+    // A number. Integers that fit are ints, anything else a double.
+    const char* start = cp;
+    if (cp < end && *cp == '-') ++cp;
+    const char* digits = cp;
+    while (cp < end && *cp >= '0' && *cp <= '9') ++cp;
+    if (cp == digits || (*digits == '0' && cp - digits > 1))
+      return false;
+    bool integral = true;
+    if (cp < end && *cp == '.') {
+      integral = false;
+      const char* fraction = ++cp;
+      while (cp < end && *cp >= '0' && *cp <= '9') ++cp;
+      if (cp == fraction) return false;
+    }
+    if (cp < end && (*cp == 'e' || *cp == 'E')) {
+      integral = false;
+      ++cp;
+      if (cp < end && (*cp == '+' || *cp == '-')) ++cp;
+      const char* exponent = cp;
+      while (cp < end && *cp >= '0' && *cp <= '9') ++cp;
+      if (cp == exponent) return false;
+    }
+
+    if (integral) {
+      int i;
+      if (std::from_chars(start, cp, i).ec == std::errc()) {
+        _type = TypeInt;
+        _value.asInt = i;
+        return true;
+      }
+    }
+    double d;
+    if (std::from_chars(start, cp, d).ec != std::errc())
+      return false;     // Including numbers out of the range of a double
+    _type = TypeDouble;
+    _value.asDouble = d;
+    return true;
+  }
 
 
   // Write the value without xml encoding it
@@ -559,20 +1413,20 @@ namespace XmlRpc {
         }
       case TypeBase64:
         {
-          int iostatus = 0;
-          std::ostreambuf_iterator<char> out(os);
-          base64<char> encoder;
-          encoder.put(_value.asBinary->begin(), _value.asBinary->end(), out, iostatus, base64<>::crlf());
+          std::string encoded;
+          XmlRpcBase64::encode(_value.asBinary->data(), _value.asBinary->size(), encoded);
+          os << encoded;
           break;
         }
       case TypeArray:
         {
-          int s = int(_value.asArray->size());
+          ValueArray const& elements = arrayData();
+          int s = int(elements.size());
           os << '{';
           for (int i=0; i<s; ++i)
           {
             if (i > 0) os << ',';
-            _value.asArray->at(i).write(os);
+            elements[i].write(os);
           }
           os << '}';
           break;
@@ -580,11 +1434,12 @@ namespace XmlRpc {
       case TypeStruct:
         {
           os << '[';
+          ValueStruct const& members = structData();
           ValueStruct::const_iterator it;
-          for (it=_value.asStruct->begin(); it!=_value.asStruct->end(); ++it)
+          for (it=members.begin(); it!=members.end(); ++it)
           {
-            if (it!=_value.asStruct->begin()) os << ',';
-            os << it->first << ':';
+            if (it!=members.begin()) os << ',';
+            os << it->first.view() << ':';
             it->second.write(os);
           }
           os << ']';
@@ -1,31 +1,88 @@
 #include "app/RPCAuthLogin.h"
+#include "XmlRpcResponseTemplate.h"
 using namespace XmlRpc;
 
-RpcAuthLogin::RpcAuthLogin(XmlRpcServer* srv, AppServer& app)
-  : XmlRpcServerMethod("auth.login", srv), app_(app) {}
-
-void RpcAuthLogin::execute(XmlRpcValue& params, XmlRpcValue& result) {
-  // Esperamos un struct con claves: username, password
-  if (params.getType() != XmlRpcValue::TypeArray || params.size() != 1 ||
-      params[0].getType() != XmlRpcValue::TypeStruct ||
-      !params[0].hasMember("username") || !params[0].hasMember("password")) {
-    result["status"]["code"] = 400;
-    result["status"]["msg"]  = "BAD_REQUEST";
-    result["payload"] = ""; // sin payload
-    return;
+// Nombres de miembros, con longitud precalculada
+namespace {
+  constexpr XmlRpcName USERNAME("username");
+  constexpr XmlRpcName PASSWORD("password");
+  constexpr XmlRpcName STATUS("status");
+  constexpr XmlRpcName CODE("code");
+  constexpr XmlRpcName MSG("msg");
+  constexpr XmlRpcName PAYLOAD("payload");
+  constexpr XmlRpcName TOKEN("token");
+
+  // Esperamos un struct con claves: username, password. El esquema ya lo
+  // garantiza; la comprobación queda por si acaso (sin excepciones si faltan)
+  bool credentials(XmlRpcValue& params, const std::string*& username, const std::string*& password) {
+    const XmlRpcValue::ValueArray* args = params.tryGet<XmlRpcValue::ValueArray>();
+    const XmlRpcValue* req = (args && args->size() == 1) ? &(*args)[0] : nullptr;
+    const XmlRpcValue* user = req ? req->find(USERNAME) : nullptr;
+    const XmlRpcValue* pass = req ? req->find(PASSWORD) : nullptr;
+    username = user ? user->tryGet<std::string>() : nullptr;
+    password = pass ? pass->tryGet<std::string>() : nullptr;
+    return username && password;
+  }
+
+  // Resultado de la llamada, común a las dos formas de respuesta: 400 si
+  // faltan credenciales, si no el del servicio de autenticación
+  LoginResult attempt(AppServer& app, XmlRpcValue& params) {
+    const std::string *username, *password;
+    if (!credentials(params, username, password))
+      return { 400, "BAD_REQUEST", "" };
+    return app.auth().login(*username, *password);
+  }
+
+  // Respuestas pre-renderizadas: status{code,msg} + payload{token} o payload vacío
+  const XmlRpcResponseTemplate& okResponse() {
+    static const XmlRpcResponseTemplate tpl = [] {
+      XmlRpcValue shape;
+      shape[STATUS][CODE] = XmlRpcResponseTemplate::slot(0);
+      shape[STATUS][MSG]  = XmlRpcResponseTemplate::slot(1);
+      shape[PAYLOAD][TOKEN] = XmlRpcResponseTemplate::slot(2);
+      return XmlRpcResponseTemplate(shape, XmlRpcResponseTemplate::Result);
+    }();
+    return tpl;
   }
 
-  XmlRpcValue& req = params[0];
-  std::string username = std::string(req["username"]);
-  std::string password = std::string(req["password"]);
+  const XmlRpcResponseTemplate& failResponse() {
+    static const XmlRpcResponseTemplate tpl = [] {
+      XmlRpcValue shape;
+      shape[STATUS][CODE] = XmlRpcResponseTemplate::slot(0);
+      shape[STATUS][MSG]  = XmlRpcResponseTemplate::slot(1);
+      shape[PAYLOAD] = ""; // sin payload
+      return XmlRpcResponseTemplate(shape, XmlRpcResponseTemplate::Result);
+    }();
+    return tpl;
+  }
+}
+
+RpcAuthLogin::RpcAuthLogin(XmlRpcServer* srv, AppServer& app)
+  : XmlRpcServerMethod("auth.login", srv), app_(app) {
+  // El servidor rechaza con un fault los params que no cumplan el esquema,
+  // mientras los decodifica
+  setSignature("struct{username:string,password:string}", "struct");
+}
 
-  auto lr = app_.auth().login(username, password);
+// Llamada directa: escribe la respuesta desde las plantillas
+bool RpcAuthLogin::executeXml(XmlRpcValue& params, std::string& body) {
+  LoginResult lr = attempt(app_, params);
+  if (lr.code == 0)
+    okResponse().render(body, { lr.code, lr.msg, lr.token });
+  else
+    failResponse().render(body, { lr.code, lr.msg });
+  return true;
+}
 
-  result["status"]["code"] = lr.code;
-  result["status"]["msg"]  = lr.msg;
+// Dentro de system.multicall el resultado se construye como valor
+bool RpcAuthLogin::tryExecute(XmlRpcValue& params, XmlRpcValue& result, XmlRpcException&) {
+  LoginResult lr = attempt(app_, params);
+  result[STATUS][CODE] = lr.code;
+  result[STATUS][MSG]  = lr.msg;
   if (lr.code == 0) {
-    result["payload"]["token"] = lr.token;
+    result[PAYLOAD][TOKEN] = lr.token;
   } else {
-    result["payload"] = ""; // sin payload
+    result[PAYLOAD] = ""; // sin payload
   }
+  return true;
 }